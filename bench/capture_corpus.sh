@@ -0,0 +1,28 @@
+#!/bin/sh
+# Snapshot /proc/PID/stat and /proc/PID/status of every process into a
+# directory that parse_bench can replay offline.
+#
+# Usage: bench/capture_corpus.sh DIR
+
+set -eu
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 DIR" >&2
+    exit 1
+fi
+
+out=$1
+mkdir -p "$out"
+
+for proc in /proc/[0-9]*; do
+    pid=${proc#/proc/}
+    mkdir -p "$out/$pid"
+    # Processes may exit mid-capture; keep whatever was read.
+    cat "$proc/stat" > "$out/$pid/stat" 2>/dev/null || true
+    cat "$proc/status" > "$out/$pid/status" 2>/dev/null || true
+    if [ ! -s "$out/$pid/stat" ] || [ ! -s "$out/$pid/status" ]; then
+        rm -rf "${out:?}/$pid"
+    fi
+done
+
+echo "captured $(ls "$out" | wc -l) processes into $out"
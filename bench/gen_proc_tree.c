@@ -0,0 +1,191 @@
+// Builds a synthetic proc tree for refresh_bench and ltop --proc-root: COUNT
+// process directories with stat and status files shaped like the kernel's,
+// plus meminfo and stat. Contents are deterministic, so runs are comparable.
+//
+// Usage: gen_proc_tree DIR COUNT
+
+#include "proc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAX_PROCESSES   4000000
+// Real PIDs leave gaps where processes exited; every PID_STRIDE-th one is
+// skipped so discovery does not see a dense range.
+#define PID_STRIDE      7
+#define PAGE_SIZE_KB    4
+#define FILE_BUFFER_MAX 4096
+
+static const char* const process_names[] = {
+    "bash",        "sshd",      "kworker/0:1", "systemd-journal",
+    "Web Content", "postgres",  "nginx",       "tmux: server",
+    "python3",     "(sd-pam)",  "containerd",  "rcu_sched",
+};
+
+static const char process_states[] = "SSSSSSSSIRRDZ";
+
+static unsigned int next_random(unsigned int* seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static bool write_file(const char* path, const char* contents, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    bool ok = write(fd, contents, size) == (ssize_t)size;
+    return close(fd) == 0 && ok;
+}
+
+static bool make_directory(const char* path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static bool write_process(const char* root, int pid) {
+    unsigned int seed  = (unsigned int)pid * 2654435761u;
+    const char*  name  = process_names[next_random(&seed) %
+                                      (sizeof(process_names) /
+                                       sizeof(process_names[0]))];
+    char         state = process_states[next_random(&seed) %
+                                        (sizeof(process_states) - 1)];
+    int          ppid  = pid > 1 ? 1 + (int)(next_random(&seed) % (unsigned)pid)
+                                 : 0;
+    unsigned long rss_pages  = 64 + next_random(&seed) % 65536;
+    unsigned long utime      = next_random(&seed) % 100000;
+    unsigned long stime      = next_random(&seed) % 20000;
+    unsigned long start_time = 100 + (unsigned long)pid * 3;
+    unsigned long vsize_kb   = rss_pages * PAGE_SIZE_KB * 3;
+
+    char path[PROC_PATH_MAX];
+    char contents[FILE_BUFFER_MAX];
+    int  length;
+
+    snprintf(path, sizeof(path), "%s/%d", root, pid);
+    if (!make_directory(path))
+        return false;
+
+    // Fields 1 to 52 of proc(5), with the same trailing zeros and large
+    // addresses as a real user process.
+    length = snprintf(
+        contents, sizeof(contents),
+        "%d (%s) %c %d %d %d 0 -1 4194560 %lu 0 12 0 %lu %lu 0 0 20 0 1 0 "
+        "%lu %lu %lu 18446744073709551615 94698970972160 94698970992041 "
+        "140730097642800 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0 94698971008048 "
+        "94698971009664 94699019427840 140730097648999 140730097649019 "
+        "140730097649019 140730097651691 0\n",
+        pid, name, state, ppid, pid, ppid, rss_pages * 3, utime, stime,
+        start_time, vsize_kb * 1024, rss_pages);
+
+    snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+    if (!write_file(path, contents, (size_t)length))
+        return false;
+
+    length = snprintf(
+        contents, sizeof(contents),
+        "Name:\t%s\nUmask:\t0022\nState:\t%c (%s)\nTgid:\t%d\nNgid:\t0\n"
+        "Pid:\t%d\nPPid:\t%d\nTracerPid:\t0\nUid:\t1000\t1000\t1000\t1000\n"
+        "Gid:\t1000\t1000\t1000\t1000\nFDSize:\t64\nGroups:\t4 24 27 1000 \n"
+        "NStgid:\t%d\nNSpid:\t%d\nNSpgid:\t%d\nNSsid:\t%d\nKthread:\t0\n"
+        "VmPeak:\t%8lu kB\nVmSize:\t%8lu kB\nVmLck:\t       0 kB\n"
+        "VmPin:\t       0 kB\nVmHWM:\t%8lu kB\nVmRSS:\t%8lu kB\n"
+        "RssAnon:\t%8lu kB\nRssFile:\t%8lu kB\nRssShmem:\t       0 kB\n"
+        "VmData:\t%8lu kB\nVmStk:\t     132 kB\nVmExe:\t    1024 kB\n"
+        "VmLib:\t    4096 kB\nVmPTE:\t      80 kB\nVmSwap:\t       0 kB\n"
+        "HugetlbPages:\t       0 kB\nCoreDumping:\t0\nTHP_enabled:\t1\n"
+        "untag_mask:\t0xffffffffffffffff\nThreads:\t1\nSigQ:\t0/23961\n"
+        "SigPnd:\t0000000000000000\nShdPnd:\t0000000000000000\n"
+        "SigBlk:\t0000000000000000\nSigIgn:\t0000000000001000\n"
+        "SigCgt:\t0000000000000440\nCapInh:\t0000000000000000\n"
+        "CapPrm:\t0000000000000000\nCapEff:\t0000000000000000\n"
+        "CapBnd:\t000001ffffffffff\nCapAmb:\t0000000000000000\n"
+        "NoNewPrivs:\t0\nSeccomp:\t0\nSeccomp_filters:\t0\n"
+        "Speculation_Store_Bypass:\tthread vulnerable\n"
+        "SpeculationIndirectBranch:\tconditional enabled\n"
+        "Cpus_allowed:\tff\nCpus_allowed_list:\t0-7\n"
+        "Mems_allowed:\t00000000,00000001\nMems_allowed_list:\t0\n"
+        "voluntary_ctxt_switches:\t%lu\nnonvoluntary_ctxt_switches:\t%lu\n",
+        name, state, state == 'R' ? "running" : "sleeping", pid, pid, ppid,
+        pid, pid, pid, pid, vsize_kb, vsize_kb, rss_pages * PAGE_SIZE_KB,
+        rss_pages * PAGE_SIZE_KB, rss_pages * PAGE_SIZE_KB / 2,
+        rss_pages * PAGE_SIZE_KB / 2, vsize_kb / 2, utime, stime);
+
+    snprintf(path, sizeof(path), "%s/%d/status", root, pid);
+    return write_file(path, contents, (size_t)length);
+}
+
+// Two CPUs, with the per-CPU lines summing to the aggregate one.
+static bool write_stat(const char* root) {
+    static const char stat[] =
+        "cpu  421000 1200 98000 9120000 5300 0 4100 0 0 0\n"
+        "cpu0 210000 600 49000 4560000 2650 0 2050 0 0 0\n"
+        "cpu1 211000 600 49000 4560000 2650 0 2050 0 0 0\n"
+        "intr 19330212 0 9 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+        "ctxt 40493270\nbtime 1760400000\nprocesses 120000\n"
+        "procs_running 2\nprocs_blocked 0\n";
+    char path[PROC_PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/stat", root);
+    return write_file(path, stat, sizeof(stat) - 1);
+}
+
+static bool write_meminfo(const char* root) {
+    static const char meminfo[] =
+        "MemTotal:       32768000 kB\nMemFree:         8192000 kB\n"
+        "MemAvailable:   20480000 kB\nBuffers:          512000 kB\n"
+        "Cached:         10240000 kB\nSwapCached:            0 kB\n"
+        "Active:         12288000 kB\nInactive:        8192000 kB\n"
+        "SwapTotal:       4194304 kB\nSwapFree:        4194304 kB\n"
+        "Dirty:              128 kB\nWriteback:             0 kB\n"
+        "AnonPages:       9000000 kB\nMapped:          1024000 kB\n"
+        "Shmem:            256000 kB\nSlab:            1024000 kB\n";
+    char path[PROC_PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/meminfo", root);
+    return write_file(path, meminfo, sizeof(meminfo) - 1);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s DIR COUNT\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* root  = argv[1];
+    long        count = atol(argv[2]);
+
+    if (count <= 0 || count > MAX_PROCESSES) {
+        fprintf(stderr, "%s: COUNT must be between 1 and %d\n", argv[0],
+                MAX_PROCESSES);
+        return EXIT_FAILURE;
+    }
+
+    if (strlen(root) >= PROC_ROOT_MAX || !make_directory(root) ||
+        !write_meminfo(root) || !write_stat(root)) {
+        fprintf(stderr, "%s: unable to create %s: %s\n", argv[0], root,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int pid = 0;
+
+    for (long i = 0; i < count; i++) {
+        if (++pid % PID_STRIDE == 0) {
+            pid++;
+        }
+
+        if (!write_process(root, pid)) {
+            fprintf(stderr, "%s: unable to write process %d: %s\n", argv[0],
+                    pid, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("generated %ld processes in %s\n", count, root);
+    return EXIT_SUCCESS;
+}
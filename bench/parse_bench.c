@@ -0,0 +1,164 @@
+// Compares the /proc/PID/stat and /proc/PID/status parsers on a corpus
+// captured with bench/capture_corpus.sh. Files are loaded into memory up
+// front so only parsing is measured.
+//
+// Usage: parse_bench CORPUS_DIR [ROUNDS]
+
+#include "proc.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ROUNDS  2000
+#define CORPUS_PATH_MAX 512
+
+typedef struct {
+    char stat[PROC_READ_BUFFER_SIZE];
+    char status[PROC_READ_BUFFER_SIZE];
+} CorpusEntry;
+
+static bool load_file(const char* path, char* buf, size_t size) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    size_t len = fread(buf, 1, size - 1, file);
+    fclose(file);
+
+    buf[len] = '\0';
+    return len > 0;
+}
+
+static CorpusEntry* load_corpus(const char* dir_path, size_t* count) {
+    DIR* dir = opendir(dir_path);
+    if (dir == NULL)
+        return NULL;
+
+    size_t       capacity = INITIAL_CAPACITY_SIZE;
+    size_t       size     = 0;
+    CorpusEntry* entries  = malloc(capacity * sizeof(CorpusEntry));
+
+    if (entries == NULL) {
+        closedir(dir);
+        return NULL;
+    }
+
+    struct dirent* dirent;
+    char           path[CORPUS_PATH_MAX];
+
+    while ((dirent = readdir(dir)) != NULL) {
+        if (dirent->d_name[0] == '.')
+            continue;
+
+        if (size >= capacity) {
+            CorpusEntry* grown =
+                realloc(entries, capacity * 2 * sizeof(CorpusEntry));
+            if (grown == NULL)
+                break;
+            entries = grown;
+            capacity *= 2;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s/stat", dir_path, dirent->d_name);
+        if (!load_file(path, entries[size].stat, sizeof(entries[size].stat)))
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s/status", dir_path, dirent->d_name);
+        if (!load_file(path, entries[size].status,
+                       sizeof(entries[size].status)))
+            continue;
+
+        size++;
+    }
+
+    closedir(dir);
+    *count = size;
+
+    return entries;
+}
+
+static double elapsed_ns(const struct timespec* start,
+                         const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+        (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static double bench_parser(bool (*parse)(const char*, ProcessInfo*),
+                           const CorpusEntry* entries, size_t count,
+                           bool use_stat, int rounds) {
+    ProcessInfo     info;
+    unsigned long   checksum = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < count; i++) {
+            parse(use_stat ? entries[i].stat : entries[i].status, &info);
+            checksum += info.vm_rss_kb + (unsigned char)info.state;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Keeps the compiler from discarding the parse results.
+    if (checksum == 1) {
+        fprintf(stderr, " ");
+    }
+
+    return elapsed_ns(&start, &end) / ((double)rounds * (double)count);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s CORPUS_DIR [ROUNDS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int rounds = argc == 3 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+    if (rounds <= 0) {
+        fprintf(stderr, "%s: ROUNDS must be positive\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t       count   = 0;
+    CorpusEntry* entries = load_corpus(argv[1], &count);
+
+    if (entries == NULL || count == 0) {
+        fprintf(stderr, "%s: no stat/status pairs found in %s\n", argv[0],
+                argv[1]);
+        free(entries);
+        return EXIT_FAILURE;
+    }
+
+    // The parsers should agree; live processes that changed between the two
+    // reads during capture show up as mismatches.
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        ProcessInfo from_stat, from_status;
+
+        if (!parse_process_stat(entries[i].stat, &from_stat) ||
+            !parse_process_status(entries[i].status, &from_status) ||
+            from_stat.state != from_status.state ||
+            from_stat.vm_rss_kb != from_status.vm_rss_kb) {
+            mismatches++;
+        }
+    }
+
+    double stat_ns =
+        bench_parser(parse_process_stat, entries, count, true, rounds);
+    double status_ns =
+        bench_parser(parse_process_status, entries, count, false, rounds);
+
+    printf("corpus: %zu processes, %d rounds, %zu parser mismatches\n", count,
+           rounds, mismatches);
+    printf("stat   parser: %8.1f ns/process\n", stat_ns);
+    printf("status parser: %8.1f ns/process\n", status_ns);
+    printf("speedup      : %8.2fx\n", status_ns / stat_ns);
+
+    free(entries);
+    return EXIT_SUCCESS;
+}
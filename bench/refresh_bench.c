@@ -0,0 +1,232 @@
+// Measures discovery, parsing and full refreshes against a proc tree, by
+// default one built with bench/gen_proc_tree so runs are reproducible.
+// Every figure is wall time per process (per read for meminfo), averaged
+// over ROUNDS passes after one warm-up pass.
+//
+// Usage: refresh_bench PROC_ROOT [ROUNDS] [JOBS]
+
+#include "pool.h"
+#include "proc.h"
+#include "table.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ROUNDS 20
+
+typedef struct {
+    const char*  root;
+    const int*   pids;
+    size_t       count;
+    int          rounds;
+    ProcessTable table;
+} Bench;
+
+static double now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static double per_process(const Bench* bench, double started) {
+    return (now_ns() - started) /
+           ((double)bench->rounds * (double)bench->count);
+}
+
+static double bench_discovery(const Bench* bench) {
+    PidList list = {0};
+
+    discover_pids(&list);
+
+    double started = now_ns();
+    for (int round = 0; round < bench->rounds; round++) {
+        discover_pids(&list);
+    }
+    double result = per_process(bench, started);
+
+    pid_list_destroy(&list);
+    return result;
+}
+
+// The stat parser alone, over every stat file loaded into memory first.
+static double bench_parse(const Bench* bench) {
+    char* files = malloc(bench->count * PROC_READ_BUFFER_SIZE);
+    if (files == NULL)
+        return 0;
+
+    for (size_t i = 0; i < bench->count; i++) {
+        char  path[PROC_PATH_MAX];
+        char* buf = files + i * PROC_READ_BUFFER_SIZE;
+
+        snprintf(path, sizeof(path), "%s/%d/stat", bench->root, bench->pids[i]);
+        buf[0] = '\0';
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ssize_t len = pread(fd, buf, PROC_READ_BUFFER_SIZE - 1, 0);
+            buf[len > 0 ? len : 0] = '\0';
+            close(fd);
+        }
+    }
+
+    ProcessInfo   process;
+    unsigned long checksum = 0;
+    double        started  = now_ns();
+
+    for (int round = 0; round < bench->rounds; round++) {
+        for (size_t i = 0; i < bench->count; i++) {
+            parse_process_stat(files + i * PROC_READ_BUFFER_SIZE, &process);
+            checksum += process.vm_rss_kb;
+        }
+    }
+
+    double result = per_process(bench, started);
+
+    // Keeps the compiler from discarding the parse results.
+    if (checksum == 1) {
+        fprintf(stderr, " ");
+    }
+
+    free(files);
+    return result;
+}
+
+// read_process_info over every PID, opening each file or through a cache.
+static double bench_read(const Bench* bench, ProcParser parser,
+                         FdCache* cache) {
+    double started = 0;
+
+    for (int round = -1; round < bench->rounds; round++) {
+        if (round == 0) {
+            started = now_ns();
+        }
+
+        fd_cache_begin_scan(cache);
+        for (size_t i = 0; i < bench->count; i++) {
+            ProcessInfo process = {.pid = bench->pids[i]};
+            read_process_info(cache, parser, &process);
+        }
+        fd_cache_end_scan(cache);
+    }
+
+    return per_process(bench, started);
+}
+
+// read_system_memory_info per call, reopening the file with a NULL
+// collector or through the descriptor the collector keeps.
+static double bench_meminfo(const Bench* bench, ProcCollector* collector) {
+    SystemMemoryInfo mem_info;
+    int              reads   = bench->rounds * 100;
+    double           started = 0;
+
+    for (int i = -1; i < reads; i++) {
+        if (i == 0) {
+            started = now_ns();
+        }
+
+        read_system_memory_info(collector, &mem_info);
+    }
+
+    return (now_ns() - started) / reads;
+}
+
+// collect_processes as ltop runs it: discovery, reads and the table.
+static double bench_refresh(Bench* bench, ProcCollector* collector) {
+    double started = 0;
+
+    for (int round = -1; round < bench->rounds; round++) {
+        if (round == 0) {
+            started = now_ns();
+        }
+
+        collect_processes(collector, &bench->table);
+    }
+
+    return per_process(bench, started);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "Usage: %s PROC_ROOT [ROUNDS] [JOBS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int rounds = argc >= 3 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+    int jobs   = argc >= 4 ? atoi(argv[3]) : DEFAULT_COLLECT_JOBS;
+
+    if (rounds <= 0 || jobs <= 0) {
+        fprintf(stderr, "%s: ROUNDS and JOBS must be positive\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!proc_set_root(argv[1])) {
+        fprintf(stderr, "%s: proc root too long\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    PidList pids = {0};
+    if (!discover_pids(&pids) || pids.count == 0) {
+        fprintf(stderr, "%s: no processes found in %s\n", argv[0], argv[1]);
+        pid_list_destroy(&pids);
+        return EXIT_FAILURE;
+    }
+
+    Bench bench = {.root   = argv[1],
+                   .pids   = pids.pids,
+                   .count  = pids.count,
+                   .rounds = rounds};
+
+    FdCache cache;
+    if (!fd_cache_init(&cache, 1)) {
+        fprintf(stderr, "%s: unable to set up the fd cache\n", argv[0]);
+        pid_list_destroy(&pids);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %zu processes, %d rounds, fd budget %zu\n", argv[1],
+           bench.count, rounds, cache.fd_budget);
+    printf("discovery             : %9.1f ns/process\n",
+           bench_discovery(&bench));
+    printf("stat parse            : %9.1f ns/process\n", bench_parse(&bench));
+    printf("stat read, uncached   : %9.1f ns/process\n",
+           bench_read(&bench, PROC_PARSER_STAT, NULL));
+    printf("stat read, fd cache   : %9.1f ns/process\n",
+           bench_read(&bench, PROC_PARSER_STAT, &cache));
+    printf("status read, uncached : %9.1f ns/process\n",
+           bench_read(&bench, PROC_PARSER_STATUS, NULL));
+    fd_cache_destroy(&cache);
+
+    ProcCollector collector;
+    proc_collector_init(&collector, PROC_PARSER_STAT);
+
+    printf("meminfo read, reopened: %9.1f ns/read\n",
+           bench_meminfo(&bench, NULL));
+    printf("meminfo read, kept    : %9.1f ns/read\n",
+           bench_meminfo(&bench, &collector));
+    printf("refresh, uncached     : %9.1f ns/process\n",
+           bench_refresh(&bench, &collector));
+
+    if (fd_cache_init(&cache, 1)) {
+        collector.cache = &cache;
+        printf("refresh, fd cache     : %9.1f ns/process\n",
+               bench_refresh(&bench, &collector));
+        fd_cache_destroy(&cache);
+        collector.cache = NULL;
+    }
+
+    collector.pool = jobs > 1 ? worker_pool_create(jobs, true) : NULL;
+    if (collector.pool != NULL) {
+        printf("refresh, %2d jobs      : %9.1f ns/process\n", jobs,
+               bench_refresh(&bench, &collector));
+    }
+
+    proc_collector_destroy(&collector);
+    process_table_destroy(&bench.table);
+    pid_list_destroy(&pids);
+    return EXIT_SUCCESS;
+}
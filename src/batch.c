@@ -0,0 +1,400 @@
+#include "batch.h"
+#include "model.h"
+#include "output.h"
+#include "profile.h"
+#include "record.h"
+#include "sampler.h"
+#include "table.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define KB_TO_MB      1024
+#define MS_PER_SECOND 1000
+#define NS_PER_MS     1000000L
+#define NS_PER_SECOND 1000000000L
+
+static void write_time(OutputBuffer* out, const struct timespec* now) {
+    char millis[4] = {(char)('0' + now->tv_nsec / 100000000),
+                      (char)('0' + now->tv_nsec / 10000000 % 10),
+                      (char)('0' + now->tv_nsec / 1000000 % 10), '\0'};
+
+    output_unsigned(out, (unsigned long long)now->tv_sec);
+    output_char(out, '.');
+    output_string(out, millis);
+}
+
+// One line per stage, then the syscall and process counts.
+static void write_profile_text(OutputBuffer* out, const Profiler* profiler) {
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        StageSummary summary;
+        profile_summarize(profiler, (ProfileStage)stage, &summary);
+
+        output_printf(
+            out, "Profile %-8s last %9.3f ms, avg %9.3f ms, p99 %9.3f ms\n",
+            profile_stage_name((ProfileStage)stage),
+            (double)summary.last_ns / NS_PER_MS,
+            (double)summary.avg_ns / NS_PER_MS,
+            (double)summary.p99_ns / NS_PER_MS);
+    }
+
+    output_printf(out, "Profile %lu /proc syscalls for %zu processes\n",
+                  profiler->syscalls, profiler->processes);
+}
+
+static void write_text(OutputBuffer* out, const struct timespec* now,
+                       const ProcessTable* table,
+                       const SystemMemoryInfo* mem_info,
+                       const SystemCpuTimes* cpu_delta,
+                       const Profiler* profiler) {
+    struct tm local;
+    char      stamp[32];
+
+    localtime_r(&now->tv_sec, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    double mem_total_mb  = (double)mem_info->mem_total_kb / KB_TO_MB;
+    double mem_free_mb   = (double)mem_info->mem_free_kb / KB_TO_MB;
+    double mem_cached_mb = (double)mem_info->mem_cached_kb / KB_TO_MB;
+    double swap_total_mb = (double)mem_info->swap_total_kb / KB_TO_MB;
+    double swap_free_mb  = (double)mem_info->swap_free_kb / KB_TO_MB;
+
+    double mem_used_mb = mem_total_mb - mem_free_mb - mem_cached_mb;
+    if (mem_used_mb < 0)
+        mem_used_mb = 0;
+
+    double swap_used_mb = swap_total_mb - swap_free_mb;
+    if (swap_used_mb < 0)
+        swap_used_mb = 0;
+
+    output_printf(out, "ltop %s, %zu processes\n", stamp, table->count);
+    output_printf(out, "%%Cpu(s): %5.1f us, %5.1f sy, %5.1f id\n",
+                  cpu_times_percent(cpu_delta, cpu_delta->user),
+                  cpu_times_percent(cpu_delta, cpu_delta->system),
+                  cpu_times_percent(cpu_delta, cpu_delta->idle));
+    output_printf(
+        out, "MiB Mem : %8.1f total, %8.1f free, %8.1f used, %8.1f buff/cache\n",
+        mem_total_mb, mem_free_mb, mem_used_mb, mem_cached_mb);
+    output_printf(
+        out, "MiB Swap: %8.1f total, %8.1f free, %8.1f used, %8.1f avail Mem\n",
+        swap_total_mb, swap_free_mb, swap_used_mb,
+        (double)mem_info->mem_available_kb / KB_TO_MB);
+
+    if (profiler != NULL) {
+        write_profile_text(out, profiler);
+    }
+
+    output_char(out, '\n');
+    output_printf(out, "%-8s %-22s %-6s %5s %s\n", "PID", "NAME", "STATE",
+                  "%CPU", "MEM (KB)");
+
+    for (size_t row = 0; row < table->count; row++) {
+        output_printf(out, "%-8d %-22.22s %-6c %3u.%u %lu\n", table->pids[row],
+                      process_table_name(table, row), table->states[row],
+                      table->cpu_tenths[row] / 10, table->cpu_tenths[row] % 10,
+                      table->rss_kb[row]);
+    }
+
+    output_char(out, '\n');
+}
+
+// A tenths count as a decimal with one fractional digit.
+static void write_tenths(OutputBuffer* out, unsigned long long tenths) {
+    output_unsigned(out, tenths / 10);
+    output_char(out, '.');
+    output_char(out, (char)('0' + tenths % 10));
+}
+
+static void write_csv(OutputBuffer* out, const struct timespec* now,
+                      const ProcessTable* table) {
+    for (size_t row = 0; row < table->count; row++) {
+        write_time(out, now);
+        output_char(out, ',');
+        output_unsigned(out, (unsigned long long)table->pids[row]);
+        output_char(out, ',');
+        output_csv_field(out, process_table_name(table, row));
+        output_char(out, ',');
+        output_char(out, table->states[row]);
+        output_char(out, ',');
+        output_unsigned(out, table->rss_kb[row]);
+        output_char(out, ',');
+        write_tenths(out, table->cpu_tenths[row]);
+        output_char(out, '\n');
+    }
+}
+
+static void write_json_field(OutputBuffer* out, const char* name, long value) {
+    output_char(out, '"');
+    output_string(out, name);
+    output_string(out, "\":");
+    output_unsigned(out, value > 0 ? (unsigned long long)value : 0);
+}
+
+// "profile":{"collect":{"last_ns":..,"avg_ns":..,"p99_ns":..},...,
+// "syscalls":..,"processes":..}
+static void write_profile_json(OutputBuffer* out, const Profiler* profiler) {
+    output_string(out, ",\"profile\":{");
+
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        StageSummary summary;
+        profile_summarize(profiler, (ProfileStage)stage, &summary);
+
+        output_char(out, '"');
+        output_string(out, profile_stage_name((ProfileStage)stage));
+        output_string(out, "\":{\"last_ns\":");
+        output_unsigned(out, summary.last_ns);
+        output_string(out, ",\"avg_ns\":");
+        output_unsigned(out, summary.avg_ns);
+        output_string(out, ",\"p99_ns\":");
+        output_unsigned(out, summary.p99_ns);
+        output_string(out, "},");
+    }
+
+    output_string(out, "\"syscalls\":");
+    output_unsigned(out, profiler->syscalls);
+    output_string(out, ",\"processes\":");
+    output_unsigned(out, profiler->processes);
+    output_char(out, '}');
+}
+
+static void write_json(OutputBuffer* out, const struct timespec* now,
+                       const ProcessTable* table,
+                       const SystemMemoryInfo* mem_info,
+                       const SystemCpuTimes* cpu_delta,
+                       const Profiler* profiler) {
+    output_string(out, "{\"time\":");
+    write_time(out, now);
+
+    // Percentages in tenths, like the per-process figures.
+    double user   = cpu_times_percent(cpu_delta, cpu_delta->user);
+    double system = cpu_times_percent(cpu_delta, cpu_delta->system);
+    double idle   = cpu_times_percent(cpu_delta, cpu_delta->idle);
+
+    output_string(out, ",\"cpu\":{\"user_percent\":");
+    write_tenths(out, (unsigned long long)(user * 10 + 0.5));
+    output_string(out, ",\"system_percent\":");
+    write_tenths(out, (unsigned long long)(system * 10 + 0.5));
+    output_string(out, ",\"idle_percent\":");
+    write_tenths(out, (unsigned long long)(idle * 10 + 0.5));
+    output_char(out, '}');
+
+    output_string(out, ",\"memory\":{");
+    write_json_field(out, "total_kb", mem_info->mem_total_kb);
+    output_char(out, ',');
+    write_json_field(out, "free_kb", mem_info->mem_free_kb);
+    output_char(out, ',');
+    write_json_field(out, "available_kb", mem_info->mem_available_kb);
+    output_char(out, ',');
+    write_json_field(out, "cached_kb", mem_info->mem_cached_kb);
+    output_char(out, ',');
+    write_json_field(out, "buffers_kb", mem_info->buffers_kb);
+    output_char(out, ',');
+    write_json_field(out, "swap_total_kb", mem_info->swap_total_kb);
+    output_char(out, ',');
+    write_json_field(out, "swap_free_kb", mem_info->swap_free_kb);
+    output_char(out, '}');
+
+    if (profiler != NULL) {
+        write_profile_json(out, profiler);
+    }
+
+    output_string(out, ",\"processes\":[");
+
+    for (size_t row = 0; row < table->count; row++) {
+        output_string(out, row > 0 ? ",{\"pid\":" : "{\"pid\":");
+        output_unsigned(out, (unsigned long long)table->pids[row]);
+        output_string(out, ",\"name\":");
+        output_json_string(out, process_table_name(table, row));
+        output_string(out, ",\"state\":\"");
+        output_char(out, table->states[row]);
+        output_string(out, "\",\"rss_kb\":");
+        output_unsigned(out, table->rss_kb[row]);
+        output_string(out, ",\"cpu_percent\":");
+        write_tenths(out, table->cpu_tenths[row]);
+        output_char(out, '}');
+    }
+
+    output_string(out, "]}\n");
+}
+
+// CPU time used by the whole process, worker threads included, since start.
+static double cpu_ms_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+
+    return (double)(now.tv_sec - start->tv_sec) * MS_PER_SECOND +
+           (double)(now.tv_nsec - start->tv_nsec) / NS_PER_MS;
+}
+
+// Sleeps until deadline on CLOCK_MONOTONIC, across signal interruptions.
+static void sleep_until(const struct timespec* deadline) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) ==
+           EINTR) {
+    }
+}
+
+bool batch_parse_format(const char* name, BatchFormat* format) {
+    if (name == NULL || format == NULL)
+        return false;
+
+    if (strcmp(name, "text") == 0) {
+        *format = BATCH_FORMAT_TEXT;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = BATCH_FORMAT_CSV;
+    } else if (strcmp(name, "json") == 0) {
+        *format = BATCH_FORMAT_JSON;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool batch_run(ProcCollector* collector, const BatchOptions* options) {
+    if (collector == NULL || options == NULL)
+        return false;
+
+    OutputBuffer out;
+    if (!output_buffer_init(&out, options->fd, options->buffer_size))
+        return false;
+
+    // Scans are diffed through a model, which works out %CPU from tick
+    // deltas and whose record slots give every process the stable id the
+    // log is keyed by.
+    RecordWriter* writer  = NULL;
+    ProcessModel  model   = {0};
+    ProcessTable  tracked = {0};
+
+    if (options->record_path != NULL) {
+        writer = record_writer_create(options->record_path);
+        if (writer == NULL) {
+            fprintf(stderr, "ltop: unable to create %s: %s\n",
+                    options->record_path, strerror(errno));
+            output_buffer_destroy(&out);
+            return false;
+        }
+    }
+
+    ProcessTable     table = {0};
+    SystemMemoryInfo mem_info;
+    struct timespec  deadline;
+    double           cost_ms = 0; // CPU time of the last sample
+    bool             ok      = true;
+
+    // The render stage of a snapshot is formatting and writing the one
+    // before it, which is what its profile line can report.
+    Profiler  profiler = {0};
+    Profiler* shown    = options->profile ? &profiler : NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    if (options->format == BATCH_FORMAT_CSV && writer == NULL) {
+        output_string(&out, "time,pid,name,state,rss_kb,cpu_percent\n");
+    }
+
+    for (long i = 0; options->iterations == 0 || i < options->iterations;
+         i++) {
+        // Deadlines advance by a fixed step, so the time spent collecting
+        // does not stretch the interval.
+        if (i > 0) {
+            long delay_ms = sampler_adaptive_interval(
+                options->delay_ms, options->cpu_share, cost_ms);
+
+            deadline.tv_sec += delay_ms / MS_PER_SECOND;
+            deadline.tv_nsec += delay_ms % MS_PER_SECOND * NS_PER_MS;
+            if (deadline.tv_nsec >= NS_PER_SECOND) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= NS_PER_SECOND;
+            }
+            sleep_until(&deadline);
+        }
+
+        struct timespec started;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &started);
+
+        unsigned long long stage_started = profile_now_ns();
+
+        if (!collect_processes(collector, &table)) {
+            fprintf(stderr, "ltop: unable to read process information\n");
+            ok = false;
+            break;
+        }
+
+        profile_record(&profiler, PROFILE_COLLECT,
+                       profile_now_ns() - stage_started);
+        profile_record(&profiler, PROFILE_READ, collector->stats.read_ns);
+        profiler.syscalls  = collector->stats.syscalls;
+        profiler.processes = table.count;
+
+        stage_started = profile_now_ns();
+        if (!read_system_memory_info(collector, &mem_info)) {
+            memset(&mem_info, 0, sizeof(mem_info));
+        }
+        profile_record(&profiler, PROFILE_MEMINFO,
+                       profile_now_ns() - stage_started);
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        SystemCpuTimes cpu_times;
+        bool           have_cpu = read_system_cpu_times(collector, &cpu_times);
+
+        if (!process_model_update(&model, &table,
+                                  have_cpu ? &cpu_times : NULL) ||
+            !process_model_export(&model, &tracked)) {
+            fprintf(stderr, "ltop: out of memory\n");
+            ok = false;
+            break;
+        }
+
+        if (writer != NULL) {
+            if (!record_write_frame(writer, &tracked, &mem_info,
+                                    &model.cpu_delta, &now)) {
+                fprintf(stderr, "ltop: unable to write %s\n",
+                        options->record_path);
+                ok = false;
+                break;
+            }
+
+            cost_ms = cpu_ms_since(&started);
+            continue;
+        }
+
+        stage_started = profile_now_ns();
+
+        switch (options->format) {
+            case BATCH_FORMAT_CSV:
+                write_csv(&out, &now, &tracked);
+                break;
+
+            case BATCH_FORMAT_JSON:
+                write_json(&out, &now, &tracked, &mem_info, &model.cpu_delta,
+                           shown);
+                break;
+
+            default:
+                write_text(&out, &now, &tracked, &mem_info, &model.cpu_delta,
+                           shown);
+                break;
+        }
+
+        if (!output_flush(&out)) {
+            ok = false;
+            break;
+        }
+
+        profile_record(&profiler, PROFILE_RENDER,
+                       profile_now_ns() - stage_started);
+
+        cost_ms = cpu_ms_since(&started);
+    }
+
+    record_writer_destroy(writer);
+    process_model_destroy(&model);
+    process_table_destroy(&tracked);
+    process_table_destroy(&table);
+    output_buffer_destroy(&out);
+    return ok;
+}
@@ -0,0 +1,36 @@
+#ifndef LTOP_BATCH_H
+#define LTOP_BATCH_H
+
+#include "proc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEFAULT_BATCH_BUFFER_SIZE (64 * 1024)
+
+typedef enum {
+    BATCH_FORMAT_TEXT,
+    BATCH_FORMAT_CSV,
+    BATCH_FORMAT_JSON // one JSON object per line and snapshot
+} BatchFormat;
+
+typedef struct {
+    BatchFormat format;
+    long        iterations; // 0 samples until killed
+    long        delay_ms;   // between the starts of two samples
+    double      cpu_share;  // stretch delay_ms to stay below this, 0: fixed
+    int         fd;
+    size_t      buffer_size; // output is written once per snapshot if it fits
+    const char* record_path; // log snapshots here (see record.h), not to fd
+    bool        profile; // add ltop's own costs to text and JSON snapshots
+} BatchOptions;
+
+// "text", "csv" or "json".
+bool batch_parse_format(const char* name, BatchFormat* format);
+
+// Samples through collector and writes every snapshot without a terminal
+// UI, formatted to fd or appended to a snapshot log. Returns false if /proc
+// could not be read or the output failed.
+bool batch_run(ProcCollector* collector, const BatchOptions* options);
+
+#endif
@@ -0,0 +1,295 @@
+#include "cgroup.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CGROUP_READ_BUFFER_SIZE (16 * 1024)
+#define BYTES_PER_KB            1024
+
+// Set once before sampling starts, then only read.
+static char cgroup_root_path[CGROUP_ROOT_MAX] = CGROUP_ROOT_DEFAULT;
+
+bool cgroup_set_root(const char* root) {
+    if (root == NULL || root[0] == '\0' || strlen(root) >= CGROUP_ROOT_MAX)
+        return false;
+
+    snprintf(cgroup_root_path, sizeof(cgroup_root_path), "%s", root);
+    return true;
+}
+
+void cgroup_find_root(void) {
+    FILE* mounts = fopen("/proc/self/mounts", "re");
+    if (mounts == NULL)
+        return;
+
+    char line[1024];
+
+    while (fgets(line, sizeof(line), mounts) != NULL) {
+        char point[CGROUP_ROOT_MAX];
+        char type[32];
+
+        // Mount points with spaces come escaped as \040 and are left alone.
+        if (sscanf(line, "%*s %255s %31s", point, type) == 2 &&
+            strcmp(type, "cgroup2") == 0) {
+            cgroup_set_root(point);
+            break;
+        }
+    }
+
+    fclose(mounts);
+}
+
+// Reads the file name of the group at path, relative to the root.
+static ssize_t read_cgroup_file(const char* path, const char* name, char* buf,
+                                size_t size) {
+    char file[CGROUP_ROOT_MAX + CGROUP_PATH_MAX + 32];
+
+    // The root group is "/", and others start with one too.
+    snprintf(file, sizeof(file), "%s%s/%s", cgroup_root_path,
+             strcmp(path, "/") == 0 ? "" : path, name);
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+
+    if (len <= 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
+}
+
+bool parse_cgroup_memory_stat(const char* buf, CgroupMemory* memory) {
+    if (buf == NULL || memory == NULL)
+        return false;
+
+    bool anon_found = false;
+    bool file_found = false;
+
+    for (const char* line = buf; *line != '\0' && !(anon_found && file_found);) {
+        if (strncmp(line, "anon ", 5) == 0) {
+            memory->anon_kb = strtoul(line + 5, NULL, 10) / BYTES_PER_KB;
+            anon_found      = true;
+        } else if (strncmp(line, "file ", 5) == 0) {
+            memory->file_kb = strtoul(line + 5, NULL, 10) / BYTES_PER_KB;
+            file_found      = true;
+        }
+
+        const char* line_end = strchr(line, '\n');
+        if (line_end == NULL)
+            break;
+        line = line_end + 1;
+    }
+
+    return anon_found && file_found;
+}
+
+bool read_cgroup_memory(const char* path, CgroupMemory* memory) {
+    if (path == NULL || memory == NULL)
+        return false;
+
+    memset(memory, 0, sizeof(CgroupMemory));
+
+    char buf[CGROUP_READ_BUFFER_SIZE];
+
+    if (read_cgroup_file(path, "memory.current", buf, sizeof(buf)) < 0)
+        return false;
+
+    memory->current_kb = strtoul(buf, NULL, 10) / BYTES_PER_KB;
+    memory->known      = true;
+
+    // Without the stat the total still stands on its own.
+    if (read_cgroup_file(path, "memory.stat", buf, sizeof(buf)) > 0) {
+        parse_cgroup_memory_stat(buf, memory);
+    }
+
+    return true;
+}
+
+// FNV-1a, folded to 32 bits.
+static uint32_t hash_path(const char* path) {
+    uint32_t hash = 2166136261u;
+
+    for (const char* c = path; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+
+    return hash;
+}
+
+static void index_insert(CgroupSet* set, uint32_t id) {
+    size_t mask = set->index_capacity - 1;
+    size_t i    = set->entries[id - 1].hash & mask;
+
+    while (set->index[i] != 0) {
+        i = (i + 1) & mask;
+    }
+
+    set->index[i] = id;
+}
+
+static bool reserve(CgroupSet* set, size_t count) {
+    if (count > set->capacity) {
+        size_t capacity = set->capacity > 0 ? set->capacity * 2
+                                            : INITIAL_CAPACITY_SIZE;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+
+        CgroupEntry* entries =
+            realloc(set->entries, capacity * sizeof(CgroupEntry));
+        if (entries == NULL)
+            return false;
+
+        set->entries  = entries;
+        set->capacity = capacity;
+    }
+
+    if (count * 2 <= set->index_capacity)
+        return true;
+
+    size_t index_capacity = set->index_capacity > 0 ? set->index_capacity * 2
+                                                    : INITIAL_CAPACITY_SIZE;
+    while (index_capacity < count * 2) {
+        index_capacity *= 2;
+    }
+
+    uint32_t* index = calloc(index_capacity, sizeof(uint32_t));
+    if (index == NULL)
+        return false;
+
+    free(set->index);
+    set->index          = index;
+    set->index_capacity = index_capacity;
+
+    for (uint32_t id = 1; id <= set->count; id++) {
+        index_insert(set, id);
+    }
+
+    return true;
+}
+
+void cgroup_set_destroy(CgroupSet* set) {
+    if (set == NULL)
+        return;
+
+    free(set->entries);
+    free(set->index);
+    name_arena_destroy(&set->paths);
+    memset(set, 0, sizeof(CgroupSet));
+}
+
+uint32_t cgroup_set_intern(CgroupSet* set, const char* path) {
+    if (set == NULL || path == NULL)
+        return 0;
+
+    uint32_t hash = hash_path(path);
+
+    if (set->index_capacity > 0) {
+        size_t mask = set->index_capacity - 1;
+
+        for (size_t i = hash & mask; set->index[i] != 0; i = (i + 1) & mask) {
+            uint32_t id = set->index[i];
+
+            if (set->entries[id - 1].hash == hash &&
+                strcmp(cgroup_set_path(set, id), path) == 0)
+                return id;
+        }
+    }
+
+    if (!reserve(set, set->count + 1))
+        return 0;
+
+    CgroupEntry* entry = &set->entries[set->count];
+
+    if (!name_arena_append(&set->paths, path, &entry->path_offset))
+        return 0;
+
+    entry->hash             = hash;
+    entry->process_count    = 0;
+    entry->tally_generation = 0;
+
+    uint32_t id = (uint32_t)++set->count;
+    index_insert(set, id);
+    return id;
+}
+
+const char* cgroup_set_path(const CgroupSet* set, uint32_t id) {
+    if (set == NULL || id == 0 || id > set->count)
+        return NULL;
+
+    return set->paths.data + set->entries[id - 1].path_offset;
+}
+
+void cgroup_set_begin_tally(CgroupSet* set) {
+    if (set != NULL) {
+        set->generation++;
+    }
+}
+
+void cgroup_set_count(CgroupSet* set, uint32_t id) {
+    if (set == NULL || id == 0 || id > set->count)
+        return;
+
+    CgroupEntry* entry = &set->entries[id - 1];
+
+    if (entry->tally_generation != set->generation) {
+        entry->tally_generation = set->generation;
+        entry->process_count    = 0;
+    }
+    entry->process_count++;
+}
+
+bool cgroup_set_export(const CgroupSet* set, CgroupList* list) {
+    if (set == NULL || list == NULL)
+        return false;
+
+    list->count      = 0;
+    list->paths.size = 0;
+
+    for (uint32_t id = 1; id <= set->count; id++) {
+        const CgroupEntry* entry = &set->entries[id - 1];
+
+        if (entry->tally_generation != set->generation)
+            continue;
+
+        if (list->count == list->capacity) {
+            size_t capacity = list->capacity > 0 ? list->capacity * 2
+                                                 : INITIAL_CAPACITY_SIZE;
+            CgroupRow* rows = realloc(list->rows, capacity * sizeof(CgroupRow));
+            if (rows == NULL)
+                return false;
+
+            list->rows     = rows;
+            list->capacity = capacity;
+        }
+
+        CgroupRow* row = &list->rows[list->count];
+
+        if (!name_arena_append(&list->paths, cgroup_set_path(set, id),
+                               &row->path_offset))
+            return false;
+
+        row->id            = id;
+        row->process_count = entry->process_count;
+        read_cgroup_memory(cgroup_set_path(set, id), &row->memory);
+        list->count++;
+    }
+
+    return true;
+}
+
+void cgroup_list_destroy(CgroupList* list) {
+    if (list == NULL)
+        return;
+
+    free(list->rows);
+    name_arena_destroy(&list->paths);
+    memset(list, 0, sizeof(CgroupList));
+}
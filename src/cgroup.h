@@ -0,0 +1,102 @@
+#ifndef LTOP_CGROUP_H
+#define LTOP_CGROUP_H
+
+#include "table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CGROUP_ROOT_DEFAULT "/sys/fs/cgroup"
+#define CGROUP_ROOT_MAX     256
+#define CGROUP_PATH_MAX     512
+// The id of a process whose /proc/PID/cgroup could not be read. 0 means not
+// read yet.
+#define CGROUP_UNREADABLE   UINT32_MAX
+
+// A group's own accounting, read from the cgroup filesystem rather than
+// summed over its processes, so it includes the page cache they caused and
+// the memory of processes that already exited.
+typedef struct {
+    unsigned long current_kb; // memory.current
+    unsigned long anon_kb;    // the anon and file lines of memory.stat
+    unsigned long file_kb;
+    bool          known; // false for the root and without the memory
+                         // controller
+} CgroupMemory;
+
+// One cgroup that holds processes in a snapshot.
+typedef struct {
+    uint32_t     id;          // as in ProcessTable::cgroups
+    uint32_t     path_offset; // into CgroupList::paths
+    size_t       process_count;
+    CgroupMemory memory;
+} CgroupRow;
+
+typedef struct {
+    CgroupRow* rows;
+    size_t     count;
+    size_t     capacity;
+    NameArena  paths;
+} CgroupList;
+
+typedef struct {
+    uint32_t     path_offset;   // into CgroupSet::paths
+    uint32_t     hash;
+    size_t       process_count; // in the tally of tally_generation
+    unsigned int tally_generation;
+} CgroupEntry;
+
+// Every cgroup path seen so far, each interned once under a stable id (its
+// position in entries, from 1), so a process keeps the id of its group for
+// life and the paths are only stored here.
+typedef struct {
+    CgroupEntry* entries;
+    size_t       count;
+    size_t       capacity;
+    uint32_t*    index; // open-addressed ids by path hash, 0 when empty
+    size_t       index_capacity;
+    NameArena    paths;
+    unsigned int generation; // bumped by cgroup_set_begin_tally
+} CgroupSet;
+
+// Makes the readers below use root as the cgroup v2 mount. Must be called
+// before sampling starts. Returns false if root does not fit CGROUP_ROOT_MAX.
+bool cgroup_set_root(const char* root);
+
+// Uses the first cgroup2 mount listed in /proc/self/mounts, which on hybrid
+// hosts is not /sys/fs/cgroup itself. Keeps CGROUP_ROOT_DEFAULT if there is
+// none.
+void cgroup_find_root(void);
+
+// Reads memory.current and memory.stat of path, relative to the root. Leaves
+// memory unknown if memory.current cannot be read.
+bool read_cgroup_memory(const char* path, CgroupMemory* memory);
+
+// Parser over the NUL-terminated contents of memory.stat.
+bool parse_cgroup_memory_stat(const char* buf, CgroupMemory* memory);
+
+void cgroup_set_destroy(CgroupSet* set);
+
+// The id of path, interned if it is new, or 0 if the set could not grow.
+uint32_t    cgroup_set_intern(CgroupSet* set, const char* path);
+const char* cgroup_set_path(const CgroupSet* set, uint32_t id);
+
+// Starts counting processes per group afresh; cgroup_set_count adds one to
+// id's group.
+void cgroup_set_begin_tally(CgroupSet* set);
+void cgroup_set_count(CgroupSet* set, uint32_t id);
+
+// Refills list with the groups counted since the last begin_tally, reading
+// their memory accounting. Returns false if the list could not grow; it
+// then holds the groups added so far.
+bool cgroup_set_export(const CgroupSet* set, CgroupList* list);
+
+void cgroup_list_destroy(CgroupList* list);
+
+static inline const char* cgroup_list_path(const CgroupList* list,
+                                           size_t            index) {
+    return list->paths.data + list->rows[index].path_offset;
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include "events.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+
+#define NS_PER_MS 1000000L
+
+// An nlmsghdr-aligned receive buffer.
+typedef union {
+    struct nlmsghdr header;
+    char            bytes[PROC_EVENTS_BUFFER_SIZE];
+} EventBuffer;
+
+static unsigned long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long long)now.tv_sec * 1000000000ull +
+           (unsigned long long)now.tv_nsec;
+}
+
+static bool send_operation(int fd, enum proc_cn_mcast_op operation) {
+    union {
+        struct nlmsghdr header;
+        char bytes[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(operation))];
+    } request;
+
+    memset(&request, 0, sizeof(request));
+
+    struct cn_msg* message = NLMSG_DATA(&request.header);
+
+    request.header.nlmsg_len  = NLMSG_LENGTH(sizeof(*message) +
+                                             sizeof(operation));
+    request.header.nlmsg_type = NLMSG_DONE;
+    message->id.idx           = CN_IDX_PROC;
+    message->id.val           = CN_VAL_PROC;
+    message->len              = sizeof(operation);
+    memcpy(message->data, &operation, sizeof(operation));
+
+    return send(fd, &request, request.header.nlmsg_len, 0) ==
+           (ssize_t)request.header.nlmsg_len;
+}
+
+// The proc event carried by header, or NULL if it carries none.
+static const struct proc_event* event_of(const struct nlmsghdr* header) {
+    if (header->nlmsg_type != NLMSG_DONE ||
+        header->nlmsg_len < NLMSG_LENGTH(sizeof(struct cn_msg)))
+        return NULL;
+
+    const struct cn_msg* message = NLMSG_DATA(header);
+
+    if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC ||
+        message->len < sizeof(struct proc_event) ||
+        header->nlmsg_len < NLMSG_LENGTH(sizeof(*message) + message->len))
+        return NULL;
+
+    return (const struct proc_event*)message->data;
+}
+
+// Waits for the kernel's answer to the subscription. Outside the initial
+// namespaces the request is dropped without one. Events that arrive first
+// are thrown away; the set is built from a listing of /proc afterwards.
+static bool wait_for_ack(int fd) {
+    EventBuffer        buffer;
+    unsigned long long deadline =
+        monotonic_ns() + (unsigned long long)PROC_EVENTS_ACK_MS * NS_PER_MS;
+
+    for (unsigned long long now = monotonic_ns(); now < deadline;
+         now                    = monotonic_ns()) {
+        struct pollfd wait = {.fd = fd, .events = POLLIN};
+        int timeout_ms     = (int)((deadline - now) / NS_PER_MS) + 1;
+
+        if (poll(&wait, 1, timeout_ms) <= 0)
+            return false;
+
+        ssize_t length = recv(fd, &buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (length < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS)
+                continue;
+            return false;
+        }
+
+        for (const struct nlmsghdr* header = &buffer.header;
+             NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+            const struct proc_event* event = event_of(header);
+
+            if (event != NULL && event->what == PROC_EVENT_NONE)
+                return event->event_data.ack.err == 0;
+        }
+    }
+
+    return false;
+}
+
+ProcEvents* proc_events_open(void) {
+    int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd < 0)
+        return NULL;
+
+    struct sockaddr_nl address  = {.nl_family = AF_NETLINK,
+                                   .nl_groups = CN_IDX_PROC};
+    int                rcvbuf   = PROC_EVENTS_RCVBUF_SIZE;
+
+    // Going past net.core.rmem_max takes CAP_NET_ADMIN, which subscribing
+    // needs anyway; without it the kernel's default has to do.
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+                   sizeof(rcvbuf)) != 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    ProcEvents* events = NULL;
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        !send_operation(fd, PROC_CN_MCAST_LISTEN) || !wait_for_ack(fd) ||
+        (events = calloc(1, sizeof(ProcEvents))) == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    events->fd = fd;
+    return events;
+}
+
+void proc_events_close(ProcEvents* events) {
+    if (events == NULL)
+        return;
+
+    // The kernel only stops generating events once every listener has
+    // said so.
+    send_operation(events->fd, PROC_CN_MCAST_IGNORE);
+    close(events->fd);
+    pid_list_destroy(&events->pids);
+    free(events->slots);
+    free(events);
+}
+
+static size_t slot_home(const ProcEvents* events, int pid) {
+    return ((unsigned int)pid * 2654435769u) & (events->slot_capacity - 1);
+}
+
+// The slot holding pid, or the empty one where it belongs.
+static ProcEventsSlot* find_slot(ProcEvents* events, int pid) {
+    size_t mask = events->slot_capacity - 1;
+    size_t i    = slot_home(events, pid);
+
+    while (events->slots[i].pid != 0 && events->slots[i].pid != pid) {
+        i = (i + 1) & mask;
+    }
+
+    return &events->slots[i];
+}
+
+// Makes room for count processes, rehashing the ones in the set.
+static bool reserve_slots(ProcEvents* events, size_t count) {
+    if (count * 2 <= events->slot_capacity)
+        return true;
+
+    size_t capacity = events->slot_capacity > 0 ? events->slot_capacity
+                                                : INITIAL_CAPACITY_SIZE;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+
+    ProcEventsSlot* slots = calloc(capacity, sizeof(ProcEventsSlot));
+    if (slots == NULL)
+        return false;
+
+    ProcEventsSlot* old_slots    = events->slots;
+    size_t          old_capacity = events->slot_capacity;
+
+    events->slots         = slots;
+    events->slot_capacity = capacity;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i].pid != 0) {
+            *find_slot(events, old_slots[i].pid) = old_slots[i];
+        }
+    }
+
+    free(old_slots);
+    return true;
+}
+
+static bool add_process(ProcEvents* events, int pid, bool fresh) {
+    if (pid <= 0 || !reserve_slots(events, events->pids.count + 1))
+        return false;
+
+    ProcEventsSlot* slot = find_slot(events, pid);
+
+    if (slot->pid == pid) {
+        slot->fresh = slot->fresh || fresh;
+        return true;
+    }
+
+    *slot = (ProcEventsSlot){.pid = pid, .fresh = fresh};
+    return pid_list_push(&events->pids, pid);
+}
+
+static bool apply_event(ProcEvents* events, const struct proc_event* event) {
+    switch (event->what) {
+        // Threads are announced as forks too; only a new thread group is a
+        // new process.
+        case PROC_EVENT_FORK: {
+            int pid = event->event_data.fork.child_pid;
+
+            if (pid != event->event_data.fork.child_tgid)
+                return true;
+
+            // A process forked before the last kept scan started is in
+            // the set because that scan read it, so it is not fresh.
+            ProcEventsSlot* slot = find_slot(events, pid);
+            bool            seen = slot->pid == pid &&
+                        event->timestamp_ns < events->kept_scan_ns;
+
+            return add_process(events, pid, !seen);
+        }
+
+        case PROC_EVENT_EXIT: {
+            int pid = event->event_data.exit.process_pid;
+
+            if (pid != event->event_data.exit.process_tgid)
+                return true;
+
+            ProcEventsSlot* slot = find_slot(events, pid);
+
+            // No scan read it: it was forked after the last one and is
+            // gone before the next.
+            if (slot->pid != pid || slot->fresh) {
+                events->short_lived++;
+                slot->fresh = false;
+            }
+            return true;
+        }
+
+        default:
+            return true;
+    }
+}
+
+bool proc_events_pids(ProcEvents* events, PidList* pids) {
+    if (events == NULL || pids == NULL)
+        return false;
+
+    events->scan_started_ns = monotonic_ns();
+    events->short_lived     = 0;
+    events->recvs           = 0;
+
+    if (!events->synced)
+        return false;
+
+    // Events are only read here, once per refresh, so the buffer lives on
+    // the sampling thread's stack.
+    EventBuffer buffer;
+    bool        ok = true;
+
+    for (;;) {
+        ssize_t length = recv(events->fd, &buffer, sizeof(buffer),
+                              MSG_DONTWAIT);
+        events->recvs++;
+
+        if (length < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                events->overruns++;
+                ok = false;
+                continue;
+            }
+            // EAGAIN once the queue is empty.
+            ok = ok && (errno == EAGAIN || errno == EWOULDBLOCK);
+            break;
+        }
+
+        for (const struct nlmsghdr* header = &buffer.header;
+             NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+            const struct proc_event* event = event_of(header);
+
+            if (event != NULL) {
+                ok = apply_event(events, event) && ok;
+            }
+        }
+    }
+
+    events->synced = ok;
+    return ok && pid_list_assign(pids, events->pids.pids, events->pids.count);
+}
+
+bool proc_events_keep(ProcEvents* events, const ProcessTable* table) {
+    if (events == NULL || table == NULL)
+        return false;
+
+    events->synced = false;
+
+    if (!reserve_slots(events, table->count))
+        return false;
+
+    memset(events->slots, 0, events->slot_capacity * sizeof(ProcEventsSlot));
+    events->pids.count = 0;
+
+    for (size_t row = 0; row < table->count; row++) {
+        if (table->tgids[row] == 0 &&
+            !add_process(events, table->pids[row], false))
+            return false;
+    }
+
+    events->kept_scan_ns = events->scan_started_ns;
+    events->synced       = true;
+    return true;
+}
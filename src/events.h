@@ -0,0 +1,64 @@
+#ifndef LTOP_EVENTS_H
+#define LTOP_EVENTS_H
+
+#include "proc.h"
+#include "table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PROC_EVENTS_BUFFER_SIZE (64 * 1024)
+// Socket receive buffer asked for, so a burst of forks between two
+// refreshes does not overrun it.
+#define PROC_EVENTS_RCVBUF_SIZE (4 * 1024 * 1024)
+// How long proc_events_open waits for the kernel to acknowledge the
+// subscription.
+#define PROC_EVENTS_ACK_MS      200
+
+// One process in the set, found by open addressing on its PID.
+typedef struct {
+    int  pid;   // 0 marks an empty slot
+    bool fresh; // forked since the last proc_events_keep
+} ProcEventsSlot;
+
+// Live processes kept up to date by the kernel's proc connector (netlink
+// fork and exit events), so a refresh can read the processes it knows
+// instead of listing /proc.
+//
+// Forks add processes as their events are drained. Exits remove nothing:
+// an exited process stays in /proc as a zombie until its parent reaps it,
+// and that is not announced, so the set only drops a process once a scan
+// could no longer read it (proc_events_keep). A listing of /proc is still
+// needed once after subscribing, and again whenever the socket overran
+// and events were lost.
+struct ProcEvents {
+    int             fd; // netlink socket
+    PidList         pids; // the set, in no particular order
+    ProcEventsSlot* slots;
+    size_t          slot_capacity; // power of two, at most half full
+    bool            synced; // false until the first keep and after overruns
+    unsigned long long scan_started_ns; // CLOCK_MONOTONIC, the running scan
+    unsigned long long kept_scan_ns;    // and the one last kept
+
+    unsigned long short_lived; // processes that forked and exited, unseen,
+                               // among the events the last drain applied
+    unsigned long overruns;    // times events were lost
+    unsigned long recvs;       // recv calls of the last drain
+};
+
+// Subscribes to process events. Returns NULL when the connector cannot be
+// used: without CAP_NET_ADMIN, outside the initial PID namespace, or on a
+// kernel built without it.
+ProcEvents* proc_events_open(void);
+void        proc_events_close(ProcEvents* events);
+
+// Applies the queued events and refills pids with the set. Returns false,
+// leaving pids alone, if the set has to be rebuilt from a listing of /proc
+// first: before the first keep, or because events were lost.
+bool proc_events_pids(ProcEvents* events, PidList* pids);
+
+// Replaces the set with the processes of table, the ones a scan could
+// read, and marks it synced.
+bool proc_events_keep(ProcEvents* events, const ProcessTable* table);
+
+#endif
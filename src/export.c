@@ -0,0 +1,663 @@
+#include "export.h"
+#include "output.h"
+#include "profile.h"
+#include "sampler.h"
+#include "table.h"
+#include "view.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define BYTES_PER_KB    1024
+#define NS_PER_MS       1000000ull
+#define NS_PER_SECOND   1e9
+#define PERCENT         100.0
+#define LISTEN_BACKLOG  64
+#define HTTP_HEADER_MAX 192
+// Every client may still be sending a different older response while
+// another is being served, so with one more a free one is always left for
+// the next snapshot. Bodies are only allocated once a response is used.
+#define EXPORT_RESPONSES_MAX (EXPORT_CLIENTS_MAX + 2)
+
+// One snapshot, formatted.
+typedef struct {
+    OutputBuffer body; // grows, see output.h
+    char         header[HTTP_HEADER_MAX];
+    size_t       header_size;
+    size_t       readers; // clients still sending it
+} Response;
+
+typedef struct {
+    int                fd; // -1 for a free slot
+    char               request[EXPORT_REQUEST_MAX]; // then an error reply
+    size_t             request_size;
+    bool               replying;
+    struct iovec       parts[2]; // what is left to send
+    Response*          response; // that parts point into, if any
+    unsigned long long deadline_ns;
+} Client;
+
+typedef struct {
+    int         listen_fd;
+    char        socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    Client      clients[EXPORT_CLIENTS_MAX];
+    Response    responses[EXPORT_RESPONSES_MAX];
+    Response*   current; // NULL until the first snapshot
+    ProcessView view;    // orders the processes for options->top
+    size_t      top;
+} Exporter;
+
+static volatile sig_atomic_t export_stopping = 0;
+
+static void stop_serving(int signo) {
+    (void)signo;
+    export_stopping = 1;
+}
+
+// Binds a Unix socket at path, replacing a socket left by an earlier run
+// but no other kind of file.
+static int listen_unix(Exporter* exporter, const char* path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    struct stat        info;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    snprintf(exporter->socket_path, sizeof(exporter->socket_path), "%s",
+             path);
+    return fd;
+}
+
+static int listen_tcp(const char* address) {
+    char        host[256] = "127.0.0.1";
+    const char* port      = address;
+    const char* colon     = strrchr(address, ':');
+
+    if (colon != NULL) {
+        size_t length = (size_t)(colon - address);
+
+        // [::1]:9100 names an IPv6 address.
+        if (length >= 2 && address[0] == '[' && address[length - 1] == ']') {
+            address++;
+            length -= 2;
+        }
+        if (length >= sizeof(host)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+
+        memcpy(host, address, length);
+        host[length] = '\0';
+        port         = colon + 1;
+    }
+
+    struct addrinfo  hints = {.ai_family   = AF_UNSPEC,
+                              .ai_socktype = SOCK_STREAM,
+                              .ai_flags    = AI_PASSIVE | AI_NUMERICSERV};
+    struct addrinfo* found = NULL;
+
+    if (getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &found) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = -1;
+
+    for (struct addrinfo* option = found; option != NULL && fd < 0;
+         option = option->ai_next) {
+        int one = 1;
+
+        fd = socket(option->ai_family,
+                    option->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    option->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (bind(fd, option->ai_addr, option->ai_addrlen) < 0) {
+            int error = errno;
+
+            close(fd);
+            fd    = -1;
+            errno = error;
+        }
+    }
+
+    freeaddrinfo(found);
+    return fd;
+}
+
+static bool listen_on(Exporter* exporter, const char* address) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        exporter->listen_fd = listen_unix(exporter, address + 5);
+    } else if (strchr(address, '/') != NULL) {
+        exporter->listen_fd = listen_unix(exporter, address);
+    } else {
+        exporter->listen_fd = listen_tcp(address);
+    }
+
+    if (exporter->listen_fd < 0)
+        return false;
+
+    if (listen(exporter->listen_fd, LISTEN_BACKLOG) < 0) {
+        int error = errno;
+
+        close(exporter->listen_fd);
+        exporter->listen_fd = -1;
+        errno               = error;
+        return false;
+    }
+
+    return true;
+}
+
+// A label value with the backslashes, quotes and newlines escaped.
+static void write_label_value(OutputBuffer* out, const char* value) {
+    output_char(out, '"');
+
+    for (const char* c = value; *c != '\0'; c++) {
+        if (*c == '\\' || *c == '"') {
+            output_char(out, '\\');
+            output_char(out, *c);
+        } else if (*c == '\n') {
+            output_string(out, "\\n");
+        } else {
+            output_char(out, *c);
+        }
+    }
+
+    output_char(out, '"');
+}
+
+static void write_family(OutputBuffer* out, const char* name, const char* type,
+                         const char* help) {
+    output_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_bytes(OutputBuffer* out, const char* name, const char* help,
+                        long kb) {
+    write_family(out, name, "gauge", help);
+    output_string(out, name);
+    output_char(out, ' ');
+    output_unsigned(out, kb > 0 ? (unsigned long long)kb * BYTES_PER_KB : 0);
+    output_char(out, '\n');
+}
+
+// {pid="1",name="systemd"}
+static void write_process_labels(OutputBuffer* out, const ProcessTable* table,
+                                 size_t row) {
+    output_string(out, "{pid=\"");
+    output_unsigned(out, (unsigned long long)table->pids[row]);
+    output_string(out, "\",name=");
+    write_label_value(out, process_table_name(table, row));
+    output_char(out, '}');
+}
+
+// The rows to export: the top ones in the view, else every row of table.
+typedef struct {
+    const uint32_t* rows; // NULL for every row
+    size_t          count;
+} ExportRows;
+
+static void write_process_rss(OutputBuffer* out, const ProcessTable* table,
+                              ExportRows rows) {
+    write_family(out, "ltop_process_resident_bytes", "gauge",
+                 "Resident set size of the process.");
+
+    for (size_t i = 0; i < rows.count; i++) {
+        size_t row = rows.rows != NULL ? rows.rows[i] : i;
+
+        if (table->tgids[row] != 0)
+            continue;
+
+        output_string(out, "ltop_process_resident_bytes");
+        write_process_labels(out, table, row);
+        output_char(out, ' ');
+        output_unsigned(out,
+                        (unsigned long long)table->rss_kb[row] * BYTES_PER_KB);
+        output_char(out, '\n');
+    }
+}
+
+static void write_process_cpu(OutputBuffer* out, const ProcessTable* table,
+                              ExportRows rows) {
+    write_family(out, "ltop_process_cpu_ratio", "gauge",
+                 "Share of one CPU the process used between the last two "
+                 "snapshots.");
+
+    for (size_t i = 0; i < rows.count; i++) {
+        size_t       row    = rows.rows != NULL ? rows.rows[i] : i;
+        unsigned int tenths = table->cpu_tenths[row];
+
+        if (table->tgids[row] != 0)
+            continue;
+
+        output_string(out, "ltop_process_cpu_ratio");
+        write_process_labels(out, table, row);
+        output_printf(out, " %u.%03u\n", tenths / 1000, tenths % 1000);
+    }
+}
+
+static void write_metrics(Exporter* exporter, OutputBuffer* out,
+                          const Snapshot* snapshot) {
+    const SystemMemoryInfo* mem_info  = &snapshot->mem_info;
+    const SystemCpuTimes*   cpu_delta = &snapshot->cpu_delta;
+    const ProcessTable*     table     = &snapshot->processes;
+
+    write_bytes(out, "ltop_memory_total_bytes", "MemTotal of /proc/meminfo.",
+                mem_info->mem_total_kb);
+    write_bytes(out, "ltop_memory_free_bytes", "MemFree of /proc/meminfo.",
+                mem_info->mem_free_kb);
+    write_bytes(out, "ltop_memory_available_bytes",
+                "MemAvailable of /proc/meminfo.", mem_info->mem_available_kb);
+    write_bytes(out, "ltop_memory_cached_bytes", "Cached of /proc/meminfo.",
+                mem_info->mem_cached_kb);
+    write_bytes(out, "ltop_memory_buffers_bytes", "Buffers of /proc/meminfo.",
+                mem_info->buffers_kb);
+    write_bytes(out, "ltop_swap_total_bytes", "SwapTotal of /proc/meminfo.",
+                mem_info->swap_total_kb);
+    write_bytes(out, "ltop_swap_free_bytes", "SwapFree of /proc/meminfo.",
+                mem_info->swap_free_kb);
+
+    write_family(out, "ltop_cpu_ratio", "gauge",
+                 "Share of all CPU time spent in each mode between the last "
+                 "two snapshots.");
+    output_printf(out, "ltop_cpu_ratio{mode=\"user\"} %.4f\n",
+                  cpu_times_percent(cpu_delta, cpu_delta->user) / PERCENT);
+    output_printf(out, "ltop_cpu_ratio{mode=\"system\"} %.4f\n",
+                  cpu_times_percent(cpu_delta, cpu_delta->system) / PERCENT);
+    output_printf(out, "ltop_cpu_ratio{mode=\"idle\"} %.4f\n",
+                  cpu_times_percent(cpu_delta, cpu_delta->idle) / PERCENT);
+
+    size_t states[256] = {0};
+
+    for (size_t row = 0; row < table->count; row++) {
+        if (table->tgids[row] == 0) {
+            states[(unsigned char)table->states[row]]++;
+        }
+    }
+
+    write_family(out, "ltop_processes", "gauge", "Processes in each state.");
+    for (size_t state = 1; state < 256; state++) {
+        if (states[state] > 0) {
+            output_printf(out, "ltop_processes{state=\"%c\"} %zu\n",
+                          (char)state, states[state]);
+        }
+    }
+
+    ExportRows rows = {.rows = NULL, .count = table->count};
+
+    // The top processes are only selected, not sorted in full.
+    if (exporter->top > 0 &&
+        process_view_update(&exporter->view, table, false)) {
+        rows.rows  = exporter->view.rows;
+        rows.count = exporter->view.count < exporter->top ? exporter->view.count
+                                                          : exporter->top;
+    }
+
+    write_process_rss(out, table, rows);
+    write_process_cpu(out, table, rows);
+
+    write_family(out, "ltop_collect_seconds", "gauge",
+                 "Wall time of the last /proc scan.");
+    output_printf(out, "ltop_collect_seconds %.6f\n",
+                  (double)snapshot->collect_ns / NS_PER_SECOND);
+    write_family(out, "ltop_collect_syscalls", "gauge",
+                 "/proc syscalls of the last scan.");
+    output_printf(out, "ltop_collect_syscalls %lu\n",
+                  snapshot->collect_stats.syscalls);
+    write_family(out, "ltop_snapshots_total", "counter",
+                 "Snapshots taken since ltop started.");
+    output_printf(out, "ltop_snapshots_total %lu\n", snapshot->sequence);
+}
+
+// Formats snapshot into a response no client is sending and makes it the
+// one served. On failure the previous snapshot goes on being served.
+static void publish(Exporter* exporter, const Snapshot* snapshot) {
+    Response* response = NULL;
+
+    for (size_t i = 0; i < EXPORT_RESPONSES_MAX && response == NULL; i++) {
+        Response* candidate = &exporter->responses[i];
+
+        if (candidate != exporter->current && candidate->readers == 0) {
+            response = candidate;
+        }
+    }
+
+    if (response == NULL ||
+        (response->body.data == NULL &&
+         !output_buffer_init(&response->body, -1,
+                             DEFAULT_EXPORT_BUFFER_SIZE)))
+        return;
+
+    output_reset(&response->body);
+    write_metrics(exporter, &response->body, snapshot);
+
+    if (response->body.failed)
+        return;
+
+    response->header_size = (size_t)snprintf(
+        response->header, sizeof(response->header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n\r\n",
+        response->body.size);
+    exporter->current = response;
+}
+
+// Replies with status and text, formatted over the request, which is no
+// longer needed.
+static void reply_error(Client* client, const char* status, const char* text) {
+    int length = snprintf(client->request, sizeof(client->request),
+                          "HTTP/1.1 %s\r\n"
+                          "Content-Type: text/plain; charset=utf-8\r\n"
+                          "Content-Length: %zu\r\n"
+                          "Connection: close\r\n\r\n%s",
+                          status, strlen(text), text);
+
+    client->parts[0] = (struct iovec){.iov_base = client->request,
+                                      .iov_len  = (size_t)length};
+}
+
+// Picks the reply once the request's header is complete. Returns false while
+// more of the request is to come.
+static bool handle_request(Exporter* exporter, Client* client) {
+    client->request[client->request_size] = '\0';
+
+    bool complete = strstr(client->request, "\r\n\r\n") != NULL ||
+                    strstr(client->request, "\n\n") != NULL;
+
+    if (!complete && client->request_size + 1 < sizeof(client->request))
+        return false;
+
+    char method[8] = "";
+    char path[256] = "";
+
+    sscanf(client->request, "%7s %255s", method, path);
+    path[strcspn(path, "?")] = '\0';
+
+    bool head = strcmp(method, "HEAD") == 0;
+
+    client->replying = true;
+    client->parts[0] = (struct iovec){0};
+    client->parts[1] = (struct iovec){0};
+
+    if (!complete) {
+        reply_error(client, "431 Request Header Fields Too Large",
+                    "Request too large\n");
+    } else if (!head && strcmp(method, "GET") != 0) {
+        reply_error(client, "405 Method Not Allowed", "Only GET is served\n");
+    } else if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+        reply_error(client, "404 Not Found", "Metrics are at /metrics\n");
+    } else if (exporter->current == NULL) {
+        reply_error(client, "503 Service Unavailable", "No snapshot yet\n");
+    } else {
+        Response* response = exporter->current;
+
+        response->readers++;
+        client->response = response;
+        client->parts[0] = (struct iovec){.iov_base = response->header,
+                                          .iov_len  = response->header_size};
+        if (!head) {
+            client->parts[1] = (struct iovec){.iov_base = response->body.data,
+                                              .iov_len  = response->body.size};
+        }
+    }
+
+    return true;
+}
+
+// Sends what the socket takes of the reply. Returns false once the client
+// is done with: sent in full or failed.
+static bool send_reply(Client* client) {
+    while (client->parts[0].iov_len + client->parts[1].iov_len > 0) {
+        struct msghdr message = {.msg_iov = client->parts, .msg_iovlen = 2};
+        ssize_t       sent    = sendmsg(client->fd, &message, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        for (size_t i = 0; i < 2; i++) {
+            size_t used = (size_t)sent < client->parts[i].iov_len
+                              ? (size_t)sent
+                              : client->parts[i].iov_len;
+
+            client->parts[i].iov_base = (char*)client->parts[i].iov_base + used;
+            client->parts[i].iov_len -= used;
+            sent -= (ssize_t)used;
+        }
+    }
+
+    return false;
+}
+
+static void close_client(Client* client) {
+    if (client->response != NULL) {
+        client->response->readers--;
+        client->response = NULL;
+    }
+
+    close(client->fd);
+    client->fd = -1;
+}
+
+static void serve_client(Exporter* exporter, Client* client) {
+    if (!client->replying) {
+        ssize_t got = recv(client->fd, client->request + client->request_size,
+                           sizeof(client->request) - 1 - client->request_size,
+                           0);
+
+        if (got < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+
+        if (got <= 0) {
+            close_client(client);
+            return;
+        }
+
+        client->request_size += (size_t)got;
+        if (!handle_request(exporter, client))
+            return;
+    }
+
+    if (!send_reply(client)) {
+        close_client(client);
+    }
+}
+
+// Takes every pending connection, turning away those beyond
+// EXPORT_CLIENTS_MAX.
+static void accept_clients(Exporter* exporter) {
+    for (;;) {
+        int fd = accept(exporter->listen_fd, NULL, NULL);
+
+        if (fd < 0 && errno == EINTR)
+            continue;
+        if (fd < 0)
+            return;
+
+        Client* client = NULL;
+
+        for (size_t i = 0; i < EXPORT_CLIENTS_MAX && client == NULL; i++) {
+            if (exporter->clients[i].fd < 0) {
+                client = &exporter->clients[i];
+            }
+        }
+
+        if (client == NULL ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0 ||
+            fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            close(fd);
+            continue;
+        }
+
+        *client = (Client){
+            .fd          = fd,
+            .deadline_ns = profile_now_ns() +
+                           EXPORT_CLIENT_TIMEOUT_MS * NS_PER_MS,
+        };
+    }
+}
+
+static void exporter_destroy(Exporter* exporter) {
+    for (size_t i = 0; i < EXPORT_CLIENTS_MAX; i++) {
+        if (exporter->clients[i].fd >= 0) {
+            close_client(&exporter->clients[i]);
+        }
+    }
+
+    for (size_t i = 0; i < EXPORT_RESPONSES_MAX; i++) {
+        output_buffer_destroy(&exporter->responses[i].body);
+    }
+
+    if (exporter->listen_fd >= 0) {
+        close(exporter->listen_fd);
+    }
+
+    if (exporter->socket_path[0] != '\0') {
+        unlink(exporter->socket_path);
+    }
+
+    process_view_destroy(&exporter->view);
+    free(exporter);
+}
+
+bool export_run(ProcCollector* collector, const ExportOptions* options) {
+    if (collector == NULL || options == NULL || options->address == NULL)
+        return false;
+
+    // The clients' request buffers make it too big for the stack.
+    Exporter* exporter = calloc(1, sizeof(Exporter));
+    if (exporter == NULL)
+        return false;
+
+    for (size_t i = 0; i < EXPORT_CLIENTS_MAX; i++) {
+        exporter->clients[i].fd = -1;
+    }
+    exporter->top = options->top;
+    process_view_set_sort(&exporter->view, SORT_BY_RSS, true);
+    process_view_set_limit(&exporter->view, options->top);
+
+    if (!listen_on(exporter, options->address)) {
+        fprintf(stderr, "ltop: unable to listen on %s: %s\n",
+                options->address, strerror(errno));
+        exporter_destroy(exporter);
+        return false;
+    }
+
+    Sampler* sampler =
+        sampler_create(collector, options->delay_ms, options->cpu_share);
+    if (sampler == NULL) {
+        fprintf(stderr, "ltop: unable to start the sampler thread\n");
+        exporter_destroy(exporter);
+        return false;
+    }
+
+    // Without SA_RESTART the signal interrupts poll, so the loop sees it.
+    struct sigaction stop = {.sa_handler = stop_serving};
+
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    struct pollfd fds[2 + EXPORT_CLIENTS_MAX];
+    Client*       polled[EXPORT_CLIENTS_MAX];
+    bool          ok = true;
+
+    while (!export_stopping) {
+        unsigned long long now     = profile_now_ns();
+        int                timeout = -1;
+        size_t             count   = 2;
+
+        fds[0] = (struct pollfd){.fd = exporter->listen_fd, .events = POLLIN};
+        fds[1] = (struct pollfd){.fd     = sampler_event_fd(sampler),
+                                 .events = POLLIN};
+
+        for (size_t i = 0; i < EXPORT_CLIENTS_MAX; i++) {
+            Client* client = &exporter->clients[i];
+
+            if (client->fd < 0)
+                continue;
+
+            if (now >= client->deadline_ns) {
+                close_client(client);
+                continue;
+            }
+
+            int left_ms = (int)((client->deadline_ns - now) / NS_PER_MS) + 1;
+
+            if (timeout < 0 || left_ms < timeout) {
+                timeout = left_ms;
+            }
+
+            polled[count - 2] = client;
+            fds[count++]      = (struct pollfd){
+                     .fd     = client->fd,
+                     .events = client->replying ? POLLOUT : POLLIN};
+        }
+
+        if (poll(fds, count, timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            fprintf(stderr, "ltop: poll failed: %s\n", strerror(errno));
+            ok = false;
+            break;
+        }
+
+        // Formatted once here, however many scrapers read it.
+        if (fds[1].revents & POLLIN) {
+            const Snapshot* snapshot = sampler_acquire(sampler);
+
+            if (snapshot != NULL && snapshot->have_processes) {
+                publish(exporter, snapshot);
+            }
+        }
+
+        for (size_t i = 2; i < count; i++) {
+            if (fds[i].revents != 0) {
+                serve_client(exporter, polled[i - 2]);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            accept_clients(exporter);
+        }
+    }
+
+    sampler_destroy(sampler);
+    exporter_destroy(exporter);
+    return ok;
+}
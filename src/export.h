@@ -0,0 +1,34 @@
+#ifndef LTOP_EXPORT_H
+#define LTOP_EXPORT_H
+
+#include "proc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEFAULT_EXPORT_BUFFER_SIZE (64 * 1024)
+// Scrapers served at once; more are turned away until one finishes.
+#define EXPORT_CLIENTS_MAX         64
+#define EXPORT_REQUEST_MAX         2048
+// A scraper that takes longer than this to send its request or read the
+// response is dropped.
+#define EXPORT_CLIENT_TIMEOUT_MS   10000
+
+typedef struct {
+    const char* address;   // unix:PATH or a path with a slash for a Unix
+                           // socket, else [HOST:]PORT (HOST defaults to
+                           // 127.0.0.1, an empty one to every address)
+    size_t      top;       // export the processes with the most RSS, 0: all
+    long        delay_ms;  // between the starts of two samples
+    double      cpu_share; // stretch delay_ms to stay below this, 0: fixed
+} ExportOptions;
+
+// Samples through collector and serves the latest snapshot over HTTP at
+// options->address in the Prometheus text format, until SIGINT or SIGTERM.
+// Each snapshot is formatted once, when it is published, and every scrape
+// until the next one is sent that same response, so scrapers cost no
+// collection or formatting of their own. Returns false if the address could
+// not be listened on or the sampler could not start.
+bool export_run(ProcCollector* collector, const ExportOptions* options);
+
+#endif
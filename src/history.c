@@ -0,0 +1,191 @@
+#include "history.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define SPARK_PER_CHAR (HISTORY_SAMPLES / HISTORY_SPARK_WIDTH)
+
+// Lowest to highest. ltop draws with plain ncurses and no locale, which
+// shows block characters as escapes.
+static const char spark_levels[] = "_.:-=+*#";
+
+#define SPARK_LEVELS (sizeof(spark_levels) - 1)
+
+void history_ring_push(HistoryRing* ring, unsigned long value) {
+    ring->values[ring->head] = value;
+    ring->head               = (ring->head + 1) % HISTORY_SAMPLES;
+
+    if (ring->count < HISTORY_SAMPLES) {
+        ring->count++;
+    }
+}
+
+// The value pushed age samples before the newest.
+static unsigned long ring_value(const HistoryRing* ring, size_t age) {
+    return ring->values[(ring->head + HISTORY_SAMPLES - 1 - age) %
+                        HISTORY_SAMPLES];
+}
+
+void history_push_system(History* history, const SystemMemoryInfo* mem_info) {
+    if (history == NULL || mem_info == NULL)
+        return;
+
+    long used = mem_info->mem_total_kb - mem_info->mem_free_kb -
+                mem_info->mem_cached_kb;
+
+    history_ring_push(&history->mem_used_kb,
+                      used > 0 ? (unsigned long)used : 0);
+    history_ring_push(&history->mem_available_kb,
+                      mem_info->mem_available_kb > 0
+                          ? (unsigned long)mem_info->mem_available_kb
+                          : 0);
+}
+
+// Fills history->ranked with the process rows of table other than skip
+// that have the most RSS, largest first. Returns how many there are.
+static size_t rank_processes(History* history, const ProcessTable* table,
+                             size_t skip, size_t limit) {
+    uint32_t* ranked = history->ranked;
+    size_t    count  = 0;
+
+    for (size_t row = 0; row < table->count; row++) {
+        unsigned long rss = table->rss_kb[row];
+
+        if (row == skip || table->tgids[row] != 0 ||
+            (count == limit && rss <= table->rss_kb[ranked[count - 1]]))
+            continue;
+
+        size_t i = count < limit ? count++ : count - 1;
+
+        while (i > 0 && table->rss_kb[ranked[i - 1]] < rss) {
+            ranked[i] = ranked[i - 1];
+            i--;
+        }
+        ranked[i] = (uint32_t)row;
+    }
+
+    return count;
+}
+
+// The slot of the process, or HISTORY_PROCESSES if it has none.
+static size_t find_slot(const History* history, int pid,
+                        unsigned long long start_time) {
+    for (size_t i = 0; i < HISTORY_PROCESSES; i++) {
+        const ProcessHistory* slot = &history->processes[i];
+
+        if (slot->pid == pid && slot->start_time == start_time)
+            return i;
+    }
+
+    return HISTORY_PROCESSES;
+}
+
+void history_push_processes(History* history, const ProcessTable* table,
+                            size_t selected) {
+    if (history == NULL || table == NULL)
+        return;
+
+    bool   has_selected = selected < table->count &&
+                          table->tgids[selected] == 0;
+    size_t count        = rank_processes(history, table, selected,
+                                         HISTORY_PROCESSES - 1);
+
+    if (has_selected) {
+        history->ranked[count++] = (uint32_t)selected;
+    }
+
+    for (size_t i = 0; i < HISTORY_PROCESSES; i++) {
+        history->processes[i].wanted = false;
+    }
+
+    // Processes that already have a slot keep it; the others take one of
+    // the slots left unwanted, which there are enough of.
+    for (size_t i = 0; i < count; i++) {
+        uint32_t row   = history->ranked[i];
+        size_t   index = find_slot(history, table->pids[row],
+                                   table->start_times[row]);
+
+        if (index < HISTORY_PROCESSES) {
+            ProcessHistory* slot = &history->processes[index];
+
+            slot->wanted = true;
+            history_ring_push(&slot->rss_kb, table->rss_kb[row]);
+            history->ranked[i] = UINT32_MAX;
+        }
+    }
+
+    size_t free_slot = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t row = history->ranked[i];
+
+        if (row == UINT32_MAX)
+            continue;
+
+        while (history->processes[free_slot].wanted) {
+            free_slot++;
+        }
+
+        ProcessHistory* slot = &history->processes[free_slot];
+
+        slot->pid          = table->pids[row];
+        slot->start_time   = table->start_times[row];
+        slot->rss_kb.head  = 0;
+        slot->rss_kb.count = 0;
+        slot->wanted       = true;
+        history_ring_push(&slot->rss_kb, table->rss_kb[row]);
+    }
+
+    for (size_t i = 0; i < HISTORY_PROCESSES; i++) {
+        if (!history->processes[i].wanted) {
+            history->processes[i].pid = 0;
+        }
+    }
+}
+
+const HistoryRing* history_find_process(const History* history, int pid,
+                                        unsigned long long start_time) {
+    if (history == NULL || pid <= 0)
+        return NULL;
+
+    size_t index = find_slot(history, pid, start_time);
+
+    return index < HISTORY_PROCESSES ? &history->processes[index].rss_kb
+                                     : NULL;
+}
+
+void history_format_sparkline(const HistoryRing* ring, unsigned long high,
+                              char* text) {
+    size_t columns = (ring->count + SPARK_PER_CHAR - 1) / SPARK_PER_CHAR;
+
+    memset(text, ' ', HISTORY_SPARK_WIDTH);
+    text[HISTORY_SPARK_WIDTH] = '\0';
+
+    bool scaled = high == 0;
+
+    for (size_t age = 0; scaled && age < ring->count; age++) {
+        if (ring_value(ring, age) > high) {
+            high = ring_value(ring, age);
+        }
+    }
+
+    // Columns fill in from the right, the newest samples first.
+    for (size_t column = 0; column < columns; column++) {
+        unsigned long peak = 0;
+
+        for (size_t i = 0; i < SPARK_PER_CHAR; i++) {
+            size_t age = column * SPARK_PER_CHAR + i;
+
+            if (age < ring->count && ring_value(ring, age) > peak) {
+                peak = ring_value(ring, age);
+            }
+        }
+
+        size_t level = high > 0 ? (size_t)((double)peak / (double)high *
+                                           (SPARK_LEVELS - 1) + 0.5)
+                                : 0;
+
+        text[HISTORY_SPARK_WIDTH - 1 - column] =
+            spark_levels[level < SPARK_LEVELS ? level : SPARK_LEVELS - 1];
+    }
+}
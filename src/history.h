@@ -0,0 +1,62 @@
+#ifndef LTOP_HISTORY_H
+#define LTOP_HISTORY_H
+
+#include "proc.h"
+#include "table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Samples kept per series, and the width of a sparkline over all of them:
+// each of its characters stands for HISTORY_SAMPLES / HISTORY_SPARK_WIDTH
+// samples, the largest of which it shows.
+#define HISTORY_SAMPLES     60
+#define HISTORY_SPARK_WIDTH 20
+// Processes with a history: the largest by RSS and the selected one.
+#define HISTORY_PROCESSES   32
+
+// The last HISTORY_SAMPLES values of one series, oldest overwritten first.
+typedef struct {
+    unsigned long values[HISTORY_SAMPLES];
+    size_t        head;  // where the next value goes
+    size_t        count; // up to HISTORY_SAMPLES
+} HistoryRing;
+
+typedef struct {
+    int                pid; // 0 for a free slot
+    unsigned long long start_time;
+    HistoryRing        rss_kb;
+    bool               wanted; // during history_push_processes
+} ProcessHistory;
+
+// Everything is preallocated, so memory stays the same however long ltop
+// runs and pushing samples never allocates.
+typedef struct {
+    HistoryRing    mem_used_kb; // as render_memory_info works it out
+    HistoryRing    mem_available_kb;
+    ProcessHistory processes[HISTORY_PROCESSES];
+    uint32_t       ranked[HISTORY_PROCESSES]; // rows, largest RSS first
+} History;
+
+void history_ring_push(HistoryRing* ring, unsigned long value);
+
+void history_push_system(History* history, const SystemMemoryInfo* mem_info);
+
+// Adds a sample for the HISTORY_PROCESSES - 1 processes of table with the
+// most RSS and for the process at row selected, if it is one (pass
+// table->count for none). Processes left out lose their history, so one
+// only has a history from when it was last among these.
+void history_push_processes(History* history, const ProcessTable* table,
+                            size_t selected);
+
+// The history of the process, or NULL if it has none.
+const HistoryRing* history_find_process(const History* history, int pid,
+                                        unsigned long long start_time);
+
+// Draws ring as HISTORY_SPARK_WIDTH characters of an ASCII ramp, newest on
+// the right, scaled from 0 to high, or to the largest value for a high of
+// 0. text must hold HISTORY_SPARK_WIDTH + 1 characters.
+void history_format_sparkline(const HistoryRing* ring, unsigned long high,
+                              char* text);
+
+#endif
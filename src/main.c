@@ -1,6 +1,22 @@
-#include <dirent.h>
+#include "batch.h"
+#include "cgroup.h"
+#include "events.h"
+#include "export.h"
+#include "history.h"
+#include "pool.h"
+#include "profile.h"
+#include "record.h"
+#include "proc.h"
+#include "sampler.h"
+#include "screen.h"
+#include "signals.h"
+#include "table.h"
+#include "view.h"
+
 #include <ctype.h>
 #include <errno.h>
+#include <getopt.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,331 +25,992 @@
 #include <ncurses.h>
 #include <signal.h>
 #include <time.h>
-
-#define PROC_PATH_MAX         64
-#define PROC_NAME_MAX         128
-#define LINE_BUFFER_SIZE      256
-#define KB_TO_MB              1024
-#define REFRESH_INTERVAL_MS   3000
-#define INITIAL_CAPACITY_SIZE 128
-
-typedef struct {
-    int           pid;
-    char          name[PROC_NAME_MAX];
-    char          state;
-    unsigned long vm_rss_kb;
-} ProcessInfo;
+#include <poll.h>
+
+#define KB_TO_MB            1024
+// Long options without a short form.
+#define OPTION_RECORD       256
+#define OPTION_REPLAY       257
+#define OPTION_PROFILE      258
+#define OPTION_PROC_ROOT    259
+#define OPTION_PROC_EVENTS  260
+#define OPTION_CGROUP_ROOT  261
+#define OPTION_SERVE        262
+#define OPTION_SERVE_TOP    263
+#define REFRESH_INTERVAL_MS 3000
+#define PERCENT             100.0
+#define MS_PER_SECOND       1000
+// In top mode, rows ordered per snapshot, in screens: the visible page plus
+// this much to scroll into before the rest has to be sorted too.
+#define TOP_MODE_PAGES      2
+// Profile overlay: a line per stage and one with the counts.
+#define PROFILE_LINES       (PROFILE_STAGE_COUNT + 1)
+#define NS_PER_MS           1e6
+
+// Tree mode widens the name column for the indentation, which stops
+// growing below this many levels.
+#define TREE_NAME_WIDTH     30
+#define TREE_DEPTH_SHOWN    8
+
+#define KEY_ESCAPE          27
+// How long ncurses waits after ESC for the rest of an escape sequence.
+#define ESCAPE_DELAY_MS     25
+
+// Reasons the next frame has to be drawn. With none set the loop sleeps in
+// poll without formatting anything.
+#define FRAME_DIRTY_DATA   0x1 // new snapshot or sort order
+#define FRAME_DIRTY_INPUT  0x2 // a key moved the cursor or toggled a panel
+#define FRAME_DIRTY_RESIZE 0x4 // SIGWINCH
+#define FRAME_DIRTY_DIALOG 0x8 // a dialog closed over the list
 
 typedef struct {
-    long mem_total_kb;
-    long mem_free_kb;
-    long mem_available_kb;
-    long mem_cached_kb;
-    long swap_total_kb;
-    long swap_free_kb;
-    long buffers_kb;
-} SystemMemoryInfo;
-
-typedef struct {
-    int             selected_index;
-    bool            should_quit;
-    bool            needs_refresh;
-    struct timespec last_update;
+    int                selected_index; // position in the sorted view
+    int                scroll_offset;  // view position on the first list
+                                       // line, moved only to follow the
+                                       // cursor or by a page
+    int                selected_pid;   // process under the cursor, followed
+    unsigned long long selected_start; // across re-sorts and refreshes
+    bool               should_quit;
+    bool               data_stale;  // the sampler should take a snapshot now
+    bool               order_stale; // the sort order changed
+    unsigned int       frame_dirty; // FRAME_DIRTY_* reasons to redraw
+    bool               top_only;    // order only the rows within scroll reach
+    long               interval_ms;    // base sampling interval
+    double             cpu_share;      // adaptive sampling cap, 0 if fixed
+    bool               interval_stale; // interval_ms changed by a key
+    size_t             replay_frame;   // frame shown from a replayed log
+    size_t             replay_frames;  // 0 unless replaying
+    bool               show_profile;   // overlay ltop's own costs
+    bool               proc_events;    // processes tracked by fork and exit
+                                       // events, see events.h
+    bool               can_signal;     // PIDs name live processes: not a
+                                       // replay or another proc root
+    SignalTargets      tagged;         // processes the next signal goes to
+    char               message[96];    // shown over the key help until the
+                                       // next key
+    Profiler           profiler;
+    ProcessView        view;
+    PidList            watch;      // processes whose threads to list
+    PidList            watch_sent; // the list last given to the sampler
+    bool               show_memory;   // smaps_rollup columns
+    MemoryWatch*       memory_watch;  // processes on screen, for the sampler
+    MemoryWatch*       memory_sent;   // the list last given to it
+    size_t             memory_watch_count;
+    size_t             memory_sent_count;
+    size_t             memory_capacity; // of both lists
+    bool               show_cgroups;    // the groups replace the processes
+    bool               cgroups_sampled; // as last given to the sampler
+    const CgroupRow**  cgroup_order;    // of the shown snapshot's groups
+    size_t             cgroup_order_count;
+    size_t             cgroup_order_capacity;
+    size_t             cgroup_index;         // the group under the cursor
+    size_t             cgroup_scroll_offset; // as scroll_offset, for groups
+    char               cgroup_path[CGROUP_PATH_MAX]; // of view.filter.cgroup
+    History            history; // of live snapshots, for the sparklines
+    bool               filter_editing; // keys go to the filter query
+    bool               filter_invalid; // a term of the query was left out
+    char               filter_query[VIEW_FILTER_QUERY_MAX];
 } AppState;
 
-static bool         is_numeric_string(const char* str);
-static bool         read_process_info(ProcessInfo* process);
-static bool         read_system_memory_info(SystemMemoryInfo* mem_info);
-static ProcessInfo* collect_processes(size_t* count);
-static void handle_user_input(AppState* state, const ProcessInfo* processes,
-                              size_t count);
-static void terminate_process_with_dialog(const ProcessInfo* proc);
-static void render_memory_info(const SystemMemoryInfo* mem_info);
-static void render_process_list(const AppState*    state,
-                                const ProcessInfo* processes, size_t count);
+// Signals offered by the K menu, picked by their position from 1.
+static const struct {
+    int         signo;
+    const char* name;
+} menu_signals[] = {
+    {SIGTERM, "SIGTERM"}, {SIGKILL, "SIGKILL"}, {SIGINT, "SIGINT"},
+    {SIGHUP, "SIGHUP"},   {SIGSTOP, "SIGSTOP"}, {SIGCONT, "SIGCONT"},
+    {SIGUSR1, "SIGUSR1"}, {SIGUSR2, "SIGUSR2"},
+};
+
+#define MENU_SIGNAL_COUNT (sizeof(menu_signals) / sizeof(menu_signals[0]))
+
+static bool handle_user_input(AppState* state, const ProcessTable* table,
+                              const CgroupList* groups);
+static bool handle_filter_key(AppState* state, int ch);
+static void apply_filter(AppState* state);
+static void set_sort_key(AppState* state, SortKey key);
+static void toggle_threads(AppState* state, const ProcessTable* table);
+static void toggle_tree(AppState* state);
+static void toggle_collapsed(AppState* state, const ProcessTable* table);
+static void toggle_tag(AppState* state, const ProcessTable* table);
+static void signal_processes(AppState* state, const ProcessTable* table);
+static void watch_threads(AppState* state, Sampler* sampler,
+                          const ProcessTable* table);
+static void watch_memory(AppState* state, Sampler* sampler,
+                         const ProcessTable* table);
+static void toggle_memory(AppState* state);
+static void toggle_cgroups(AppState* state);
+static void enter_cgroup(AppState* state, const CgroupList* groups);
+static bool order_cgroups(AppState* state, const CgroupList* groups);
+static void step_replay(AppState* state, long frames);
+static void step_interval(AppState* state, int direction);
+static void remember_selection(AppState* state, const ProcessTable* table);
+static void update_view(AppState* state, const ProcessTable* table,
+                        bool same_rows);
+static size_t find_selected(const AppState* state, const ProcessTable* table);
+static void ensure_window_sorted(AppState* state, const ProcessTable* table);
+static int visible_row_count(const AppState* state);
+static long follow_cursor(long offset, long cursor, long count,
+                          long visible);
+static void scroll_to_cursor(AppState* state);
+static void scroll_cgroups_to_cursor(AppState* state);
+static void move_cursor(AppState* state, long rows, bool page);
+static int choose_signal(const char* subject);
+static void render_memory_info(ScreenCache*            screen,
+                               const SystemMemoryInfo* mem_info,
+                               const SystemCpuTimes*   cpu_delta,
+                               const History*          history,
+                               const char*             title);
+static int format_name_prefix(const ProcessView* view, bool thread,
+                              size_t index, char* prefix, size_t size);
+static void format_memory_detail(const MemoryDetail* memory, char* text,
+                                 size_t size);
+static void render_process_list(ScreenCache* screen, const AppState* state,
+                                const Snapshot* snapshot);
+static void render_cgroup_list(ScreenCache* screen, const AppState* state,
+                               const Snapshot* snapshot);
+static void render_profile(ScreenCache* screen, const AppState* state);
+static void format_interval(char* text, size_t size, long interval_ms);
+static void format_title(char* title, size_t size, const AppState* state,
+                         const Replay* replay, const Snapshot* snapshot);
 static void init_ncurses(void);
 static void cleanup_ncurses(void);
-static bool should_refresh(AppState* state);
 
-static bool is_numeric_string(const char* str) {
-    if (str == NULL || *str == '\0')
+// Handles one pending key. Returns false once no input is left.
+static bool handle_user_input(AppState* state, const ProcessTable* table,
+                              const CgroupList* groups) {
+    if (state == NULL || table == NULL || groups == NULL)
         return false;
 
-    for (int i = 0; str[i]; i++) {
-        if (str[i] < '0' || str[i] > '9')
-            return false;
-    }
-
-    return true;
-}
+    int ch = getch();
 
-static bool read_process_info(ProcessInfo* process) {
-    if (process == NULL || process->pid <= 0) {
+    if (ch == ERR)
         return false;
+
+    if (state->message[0] != '\0') {
+        state->message[0] = '\0';
+        state->frame_dirty |= FRAME_DIRTY_INPUT;
     }
 
-    char proc_path[PROC_PATH_MAX];
-    char line[LINE_BUFFER_SIZE];
+    if (state->filter_editing && handle_filter_key(state, ch))
+        return true;
 
-    snprintf(proc_path, sizeof(proc_path), "/proc/%d/status", process->pid);
+    // The group list leaves the cursor's process hidden, so keys that act
+    // on it, or on the hidden list, wait until it is shown again.
+    if (state->show_cgroups && ch > 0 && ch < KEY_MIN &&
+        strchr("kKxXeE /", ch) != NULL)
+        return true;
 
-    FILE* file = fopen(proc_path, "r");
-    if (file == NULL) {
-        return false;
-    }
+    switch (ch) {
+        case 'q':
+        case 'Q':
+            state->should_quit = true;
+            break;
 
-    bool name_found  = false;
-    bool state_found = false;
-    bool rss_found   = false;
+        case KEY_UP:
+            move_cursor(state, -1, false);
+            break;
 
-    while (fgets(line, sizeof(line), file) != NULL) {
-        if (!name_found && strncmp(line, "Name:", 5) == 0) {
-            char* name_start = line + 5;
-            while (*name_start != '\0' && isspace((unsigned char)*name_start)) {
-                name_start++;
-            }
+        case KEY_DOWN:
+            move_cursor(state, 1, false);
+            break;
 
-            strncpy(process->name, name_start, sizeof(process->name) - 1);
-            process->name[sizeof(process->name) - 1] = '\0';
+        case KEY_PPAGE:
+            move_cursor(state, -visible_row_count(state), true);
+            break;
 
-            char* newline = strchr(process->name, '\n');
-            if (newline != NULL) {
-                *newline = '\0';
-            }
-            name_found = true;
-        } else if (!state_found && strncmp(line, "State:", 6) == 0) {
-            char* state_ptr = line + 6;
-            while (*state_ptr != '\0' && isspace((unsigned char)*state_ptr)) {
-                state_ptr++;
-            }
-            if (*state_ptr != '\0') {
-                process->state = *state_ptr;
-                state_found    = true;
+        case KEY_NPAGE:
+            move_cursor(state, visible_row_count(state), true);
+            break;
+
+        case KEY_HOME:
+            move_cursor(state, -LONG_MAX, false);
+            break;
+
+        case KEY_END:
+            move_cursor(state, LONG_MAX, false);
+            break;
+
+        case '\n':
+        case KEY_ENTER:
+            if (state->show_cgroups) {
+                enter_cgroup(state, groups);
             }
-        } else if (!rss_found && strncmp(line, "VmRSS:", 6) == 0) {
-            if (sscanf(line + 6, "%lu", &process->vm_rss_kb) == 1) {
-                rss_found = true;
+            break;
+
+        case '+':
+            step_interval(state, 1);
+            break;
+
+        case '-':
+            step_interval(state, -1);
+            break;
+
+        case KEY_LEFT:
+            step_replay(state, -1);
+            break;
+
+        case KEY_RIGHT:
+            step_replay(state, 1);
+            break;
+
+        case '<':
+            step_replay(state, -RECORD_KEYFRAME_INTERVAL);
+            break;
+
+        case '>':
+            step_replay(state, RECORD_KEYFRAME_INTERVAL);
+            break;
+
+        case 'k':
+        case 'K':
+            signal_processes(state, table);
+            break;
+
+        case 'x':
+        case 'X':
+            toggle_tag(state, table);
+            break;
+
+        case 'u':
+        case 'U':
+            if (state->tagged.count > 0) {
+                signal_targets_clear(&state->tagged);
+                state->frame_dirty |= FRAME_DIRTY_INPUT;
             }
-        }
+            break;
 
-        if (name_found && state_found && rss_found) {
+        case 'r':
+        case 'R':
+            state->data_stale = true;
             break;
-        }
-    }
 
-    fclose(file);
+        case 'e':
+        case 'E':
+            toggle_threads(state, table);
+            break;
 
-    if (!name_found) {
-        snprintf(process->name, sizeof(process->name), "?");
-    }
-    if (!state_found) {
-        process->state = '?';
+        case 't':
+        case 'T':
+            toggle_tree(state);
+            break;
+
+        case ' ':
+            toggle_collapsed(state, table);
+            break;
+
+        case '/':
+            state->filter_editing = true;
+            state->frame_dirty |= FRAME_DIRTY_INPUT;
+            break;
+
+        case 'd':
+        case 'D':
+            toggle_memory(state);
+            break;
+
+        case 'g':
+        case 'G':
+            toggle_cgroups(state);
+            break;
+
+        case 'o':
+        case 'O':
+            state->show_profile = !state->show_profile;
+            state->frame_dirty |= FRAME_DIRTY_INPUT;
+            break;
+
+        case 'm':
+        case 'M':
+            set_sort_key(state, SORT_BY_RSS);
+            break;
+
+        case 'p':
+        case 'P':
+            set_sort_key(state, SORT_BY_PID);
+            break;
+
+        case 'n':
+        case 'N':
+            set_sort_key(state, SORT_BY_NAME);
+            break;
+
+        case 's':
+        case 'S':
+            set_sort_key(state, SORT_BY_STATE);
+            break;
+
+        case 'c':
+        case 'C':
+            set_sort_key(state, SORT_BY_CPU);
+            break;
+
+        case KEY_RESIZE:
+            state->frame_dirty |= FRAME_DIRTY_RESIZE;
+            break;
+
+        default:
+            break;
     }
-    if (!rss_found) {
-        process->vm_rss_kb = 0;
+
+    return true;
+}
+
+// Edits the filter query while its prompt is open. Keys that do not edit
+// it, such as the arrows, are left to handle_user_input.
+static bool handle_filter_key(AppState* state, int ch) {
+    size_t length = strlen(state->filter_query);
+
+    switch (ch) {
+        case '\n':
+        case '\r':
+        case KEY_ENTER:
+            state->filter_editing = false;
+            break;
+
+        case KEY_ESCAPE:
+            state->filter_editing  = false;
+            state->filter_query[0] = '\0';
+            apply_filter(state);
+            break;
+
+        case KEY_BACKSPACE:
+        case 127:
+        case '\b':
+            if (length > 0) {
+                state->filter_query[length - 1] = '\0';
+                apply_filter(state);
+            }
+            break;
+
+        default:
+            if (ch > 127 || !isprint(ch))
+                return false;
+
+            if (length + 1 < sizeof(state->filter_query)) {
+                state->filter_query[length]     = (char)ch;
+                state->filter_query[length + 1] = '\0';
+                apply_filter(state);
+            }
+            break;
     }
 
+    state->frame_dirty |= FRAME_DIRTY_INPUT;
     return true;
 }
 
-static bool read_system_memory_info(SystemMemoryInfo* mem_info) {
-    if (mem_info == NULL)
-        return false;
+// Refilters the shown snapshot; nothing is read from /proc.
+static void apply_filter(AppState* state) {
+    state->filter_invalid =
+        !process_view_set_filter(&state->view, state->filter_query);
+    state->order_stale = true;
+}
 
-    // Initialize with zeros
-    memset(mem_info, 0, sizeof(SystemMemoryInfo));
+// Selecting the current sort key again flips its direction; a new key starts
+// in its natural direction (largest first for memory and CPU).
+static void set_sort_key(AppState* state, SortKey key) {
+    bool descending = key == SORT_BY_RSS || key == SORT_BY_CPU;
 
-    char  line[LINE_BUFFER_SIZE];
+    if (key == state->view.key) {
+        descending = !state->view.descending;
+    }
 
-    FILE* file = fopen("/proc/meminfo", "r");
+    process_view_set_sort(&state->view, key, descending);
+    state->order_stale = true;
+}
 
-    if (file == NULL)
-        return false;
+// Shows or hides the threads of the process under the cursor, or of the
+// process a selected thread belongs to. Recordings hold no threads.
+static void toggle_threads(AppState* state, const ProcessTable* table) {
+    if (state->replay_frames > 0 || state->selected_index < 0 ||
+        (size_t)state->selected_index >= state->view.count)
+        return;
+
+    uint32_t row       = state->view.rows[state->selected_index];
+    int      pid       = table->tgids[row] != 0 ? table->tgids[row]
+                                                : table->pids[row];
+    bool     expanding = !process_view_is_expanded(&state->view, pid);
+
+    if (!process_view_toggle_expanded(&state->view, pid))
+        return;
+
+    // Collapsing only hides rows the snapshot already has; expanding may
+    // need the threads listed first.
+    state->order_stale = true;
+    state->data_stale  = state->data_stale || expanding;
+}
+
+// Tags or untags the process under the cursor and moves on to the next row,
+// so a run of processes is tagged by holding the key. A recorded PID may
+// belong to a different process by now, so replay tags nothing.
+static void toggle_tag(AppState* state, const ProcessTable* table) {
+    if (!state->can_signal || state->selected_index < 0 ||
+        (size_t)state->selected_index >= state->view.count)
+        return;
+
+    uint32_t row = state->view.rows[state->selected_index];
 
-    while (fgets(line, sizeof(line), file) != NULL) {
-        if (strncmp(line, "MemTotal:", 9) == 0) {
-            sscanf(line, "MemTotal: %ld", &mem_info->mem_total_kb);
-        } else if (strncmp(line, "MemFree:", 8) == 0) {
-            sscanf(line, "MemFree: %ld", &mem_info->mem_free_kb);
-        } else if (strncmp(line, "MemAvailable:", 13) == 0) {
-            sscanf(line, "MemAvailable: %ld", &mem_info->mem_available_kb);
-        } else if (strncmp(line, "Cached:", 7) == 0) {
-            sscanf(line, "Cached: %ld", &mem_info->mem_cached_kb);
-        } else if (strncmp(line, "SwapTotal:", 10) == 0) {
-            sscanf(line, "SwapTotal: %ld", &mem_info->swap_total_kb);
-        } else if (strncmp(line, "SwapFree:", 9) == 0) {
-            sscanf(line, "SwapFree: %ld", &mem_info->swap_free_kb);
-        } else if (strncmp(line, "Buffers:", 8) == 0) {
-            sscanf(line, "Buffers: %ld", &mem_info->buffers_kb);
+    // Signals go to whole processes; pidfd_open refuses a thread's TID.
+    if (table->tgids[row] != 0 ||
+        !signal_targets_toggle(&state->tagged, table->pids[row],
+                               table->start_times[row]))
+        return;
+
+    if ((size_t)state->selected_index + 1 < state->view.count) {
+        state->selected_index++;
+    }
+    state->frame_dirty |= FRAME_DIRTY_INPUT;
+}
+
+// Sends the signal picked from the menu to every tagged process at once, or
+// to the process under the cursor when none is tagged. The outcome is shown
+// in place of the key help.
+static void signal_processes(AppState* state, const ProcessTable* table) {
+    if (!state->can_signal)
+        return;
+
+    const SignalTarget* targets = state->tagged.targets;
+    size_t              count   = state->tagged.count;
+    SignalTarget        selected;
+    char                subject[64];
+
+    if (count == 0) {
+        if (state->selected_index < 0 ||
+            (size_t)state->selected_index >= state->view.count)
+            return;
+
+        uint32_t row = state->view.rows[state->selected_index];
+
+        if (table->tgids[row] != 0) {
+            snprintf(state->message, sizeof(state->message),
+                     "Select the process to signal, not one of its threads");
+            state->frame_dirty |= FRAME_DIRTY_INPUT;
+            return;
         }
+
+        selected = (SignalTarget){.pid        = table->pids[row],
+                                  .start_time = table->start_times[row]};
+        targets  = &selected;
+        count    = 1;
+        snprintf(subject, sizeof(subject), "%.32s PID %d",
+                 process_table_name(table, row), selected.pid);
+    } else {
+        snprintf(subject, sizeof(subject), "%zu tagged processes", count);
     }
 
-    fclose(file);
+    int choice = choose_signal(subject);
 
-    return true;
+    state->data_stale = true;
+    state->frame_dirty |= FRAME_DIRTY_DIALOG;
+
+    if (choice < 0)
+        return;
+
+    SignalResult result = signal_send(targets, count,
+                                      menu_signals[choice].signo);
+    int          length = snprintf(state->message, sizeof(state->message),
+                                   "%s sent to %zu of %zu",
+                                   menu_signals[choice].name, result.sent,
+                                   count);
+
+    if (result.gone > 0 && length < (int)sizeof(state->message)) {
+        length += snprintf(state->message + length,
+                           sizeof(state->message) - length, ", %zu gone",
+                           result.gone);
+    }
+    if (result.failed > 0 && length < (int)sizeof(state->message)) {
+        snprintf(state->message + length, sizeof(state->message) - length,
+                 ", %zu failed: %s", result.failed, strerror(result.error));
+    }
+
+    // Tags stay on when some failed, so the batch can be retried.
+    if (result.failed == 0) {
+        signal_targets_clear(&state->tagged);
+    }
+}
+
+static void toggle_tree(AppState* state) {
+    process_view_set_tree(&state->view, !state->view.tree);
+    state->order_stale = true;
+}
+
+// Hides or shows the descendants of the process under the cursor in tree
+// mode. The process itself stays where it is, so the cursor does too.
+static void toggle_collapsed(AppState* state, const ProcessTable* table) {
+    if (!state->view.tree || state->selected_index < 0 ||
+        (size_t)state->selected_index >= state->view.count)
+        return;
+
+    uint32_t row = state->view.rows[state->selected_index];
+    int      pid = table->tgids[row] != 0 ? table->tgids[row]
+                                          : table->pids[row];
+
+    if (process_view_toggle_collapsed(&state->view, pid)) {
+        state->order_stale = true;
+    }
 }
 
-static ProcessInfo* collect_processes(size_t* count) {
-    if (count == NULL)
-        return NULL;
+static int compare_pids(const void* a, const void* b) {
+    int left  = *(const int*)a;
+    int right = *(const int*)b;
+
+    return (left > right) - (left < right);
+}
 
-    DIR* proc_dir = opendir("/proc");
+// Has the sampler list the threads of expanded processes and of the ones on
+// screen, so expanding one of those shows its threads at once. The list is
+// only handed over when it changed.
+static void watch_threads(AppState* state, Sampler* sampler,
+                          const ProcessTable* table) {
+    const ProcessView* view  = &state->view;
+    PidList*           watch = &state->watch;
 
-    if (proc_dir == NULL)
-        return NULL;
+    if (!pid_list_assign(watch, view->expanded, view->expanded_count))
+        return;
 
-    size_t       capacity = INITIAL_CAPACITY_SIZE;
-    size_t       size     = 0;
+    int first = state->scroll_offset;
+    int last  = first + visible_row_count(state);
 
-    ProcessInfo* processes = malloc(capacity * sizeof(ProcessInfo));
+    for (int i = first; i < last && i < (int)view->count; i++) {
+        uint32_t row = view->rows[i];
 
-    if (processes == NULL) {
-        closedir(proc_dir);
-        return NULL;
+        if (table->tgids[row] == 0 &&
+            !process_view_is_expanded(view, table->pids[row]) &&
+            !pid_list_push(watch, table->pids[row]))
+            return;
     }
 
-    struct dirent* entry;
+    if (watch->count > 1) {
+        qsort(watch->pids, watch->count, sizeof(int), compare_pids);
+    }
 
-    while ((entry = readdir(proc_dir)) != NULL) {
-        if (!is_numeric_string(entry->d_name))
-            continue;
+    if (watch->count == state->watch_sent.count &&
+        (watch->count == 0 ||
+         memcmp(watch->pids, state->watch_sent.pids,
+                watch->count * sizeof(int)) == 0))
+        return;
 
-        int pid = atoi(entry->d_name);
+    if (sampler_watch_threads(sampler, watch->pids, watch->count)) {
+        pid_list_assign(&state->watch_sent, watch->pids, watch->count);
+    }
+}
 
-        if (pid <= 0)
+// Has the sampler keep the memory detail of the processes on screen
+// current, or of none while the columns are hidden. Threads share their
+// process's memory, so they are left out. The list is only sent when it
+// changed.
+static void watch_memory(AppState* state, Sampler* sampler,
+                         const ProcessTable* table) {
+    const ProcessView* view  = &state->view;
+    int                first = state->scroll_offset;
+    int                last  = first + visible_row_count(state);
+    size_t             count = 0;
+
+    for (int i = first; state->show_memory && i < last &&
+                        i < (int)view->count;
+         i++) {
+        uint32_t row = view->rows[i];
+
+        if (table->tgids[row] != 0)
             continue;
 
-        if (size >= capacity) {
-            size_t       new_capacity = capacity * 2;
-            ProcessInfo* new_processes =
-                realloc(processes, new_capacity * sizeof(ProcessInfo));
+        if (count == state->memory_capacity) {
+            size_t capacity = count > 0 ? count * 2 : (size_t)last - first;
+            MemoryWatch* watch =
+                realloc(state->memory_watch, capacity * sizeof(MemoryWatch));
+            if (watch == NULL)
+                return;
+            state->memory_watch = watch;
+
+            MemoryWatch* sent =
+                realloc(state->memory_sent, capacity * sizeof(MemoryWatch));
+            if (sent == NULL)
+                return;
+            state->memory_sent     = sent;
+            state->memory_capacity = capacity;
+        }
 
-            if (new_processes == NULL) {
-                free(processes);
-                closedir(proc_dir);
-                return NULL;
-            }
+        state->memory_watch[count++] =
+            (MemoryWatch){.id = table->ids[row], .pid = table->pids[row]};
+    }
+    state->memory_watch_count = count;
 
-            processes = new_processes;
-            capacity  = new_capacity;
-        }
+    if (count == state->memory_sent_count &&
+        (count == 0 || memcmp(state->memory_watch, state->memory_sent,
+                              count * sizeof(MemoryWatch)) == 0))
+        return;
 
-        processes[size].pid = pid;
-        if (read_process_info(&processes[size])) {
-            size++;
+    if (sampler_watch_memory(sampler, state->memory_watch, count)) {
+        if (count > 0) {
+            memcpy(state->memory_sent, state->memory_watch,
+                   count * sizeof(MemoryWatch));
         }
+        state->memory_sent_count = count;
     }
+}
 
-    closedir(proc_dir);
-    *count = size;
+// Shows or hides the memory detail columns. Recordings hold no memory
+// detail. The processes on screen are read on the next snapshot, which is
+// taken right away.
+static void toggle_memory(AppState* state) {
+    if (state->replay_frames > 0)
+        return;
 
-    return processes;
+    state->show_memory = !state->show_memory;
+    state->data_stale  = state->data_stale || state->show_memory;
+    state->frame_dirty |= FRAME_DIRTY_INPUT;
 }
 
-static void handle_user_input(AppState* state, const ProcessInfo* processes,
-                              size_t count) {
-    if (state == NULL || processes == NULL)
+// Switches between the process list and the list of cgroups. Going to the
+// groups also lifts a restriction to one group's processes, so coming back
+// shows all of them. Recordings hold no cgroups.
+static void toggle_cgroups(AppState* state) {
+    if (state->replay_frames > 0)
         return;
 
-    int ch = getch();
+    state->show_cgroups = !state->show_cgroups;
+    if (state->show_cgroups && state->view.filter.cgroup != 0) {
+        process_view_set_cgroup(&state->view, 0);
+        state->order_stale = true;
+    }
+    state->frame_dirty |= FRAME_DIRTY_INPUT;
+}
 
-    switch (ch) {
-        case 'q':
-        case 'Q':
-            state->should_quit = true;
-            break;
+// Shows the processes of the group under the cursor.
+static void enter_cgroup(AppState* state, const CgroupList* groups) {
+    if (state->cgroup_index >= state->cgroup_order_count)
+        return;
 
-        case KEY_UP:
-            if (state->selected_index > 0) {
-                state->selected_index--;
-                state->needs_refresh = true;
-            }
-            break;
+    const CgroupRow* group = state->cgroup_order[state->cgroup_index];
 
-        case KEY_DOWN:
-            if (state->selected_index < (int)count - 1) {
-                state->selected_index++;
-                state->needs_refresh = true;
-            }
-            break;
+    snprintf(state->cgroup_path, sizeof(state->cgroup_path), "%s",
+             cgroup_list_path(groups, (size_t)(group - groups->rows)));
+    process_view_set_cgroup(&state->view, group->id);
 
-        case 'k':
-        case 'K':
-            if (count > 0 && state->selected_index >= 0 &&
-                state->selected_index < (int)count) {
-                terminate_process_with_dialog(
-                    &processes[state->selected_index]);
-                state->needs_refresh = true;
-            }
-            break;
+    state->show_cgroups   = false;
+    state->selected_index = 0;
+    state->order_stale    = true;
+    state->frame_dirty |= FRAME_DIRTY_INPUT;
+}
 
-        case 'r':
-        case 'R':
-            state->needs_refresh = true;
-            break;
+// Groups with accounting first, the most memory first, then by id so the
+// order holds still between snapshots.
+static int compare_cgroups(const void* a, const void* b) {
+    const CgroupRow* left  = *(const CgroupRow* const*)a;
+    const CgroupRow* right = *(const CgroupRow* const*)b;
 
-        default:
-            break;
+    if (left->memory.known != right->memory.known)
+        return right->memory.known - left->memory.known;
+
+    if (left->memory.current_kb != right->memory.current_kb)
+        return left->memory.current_kb < right->memory.current_kb ? 1 : -1;
+
+    return (left->id > right->id) - (left->id < right->id);
+}
+
+// Orders the groups of the shown snapshot for the group list and keeps the
+// cursor on one of them.
+static bool order_cgroups(AppState* state, const CgroupList* groups) {
+    if (groups->count > state->cgroup_order_capacity) {
+        const CgroupRow** order = realloc(
+            state->cgroup_order, groups->count * sizeof(const CgroupRow*));
+        if (order == NULL) {
+            state->cgroup_order_count = 0;
+            return false;
+        }
+
+        state->cgroup_order          = order;
+        state->cgroup_order_capacity = groups->count;
+    }
+
+    for (size_t i = 0; i < groups->count; i++) {
+        state->cgroup_order[i] = &groups->rows[i];
+    }
+    state->cgroup_order_count = groups->count;
+
+    if (groups->count > 1) {
+        qsort(state->cgroup_order, groups->count, sizeof(const CgroupRow*),
+              compare_cgroups);
+    }
+
+    if (state->cgroup_index >= groups->count) {
+        state->cgroup_index = groups->count > 0 ? groups->count - 1 : 0;
     }
+    scroll_cgroups_to_cursor(state);
+
+    return true;
 }
 
-static void terminate_process_with_dialog(const ProcessInfo* proc) {
-    if (proc == NULL)
+// Moves the replay by frames, clamped to the log. No-op when live.
+static void step_replay(AppState* state, long frames) {
+    if (state->replay_frames == 0)
         return;
 
-    int max_y, max_x;
-    getmaxyx(stdscr, max_y, max_x);
+    long target = (long)state->replay_frame + frames;
 
-    WINDOW* terminate_dialog = newwin(8, 60, max_y / 2 - 4, max_x / 2 - 30);
+    if (target < 0) {
+        target = 0;
+    } else if (target >= (long)state->replay_frames) {
+        target = (long)state->replay_frames - 1;
+    }
 
-    if (terminate_dialog == NULL)
+    state->replay_frame = (size_t)target;
+}
+
+// Moves the base interval to the next longer (direction > 0) or shorter
+// preset, starting from wherever -d put it.
+static void step_interval(AppState* state, int direction) {
+    static const long presets_ms[] = {100,   250,   500,   1000,  2000,
+                                      3000,  5000,  10000, 30000, 60000};
+    size_t            count = sizeof(presets_ms) / sizeof(presets_ms[0]);
+    long              next  = state->interval_ms;
+
+    if (direction > 0) {
+        for (size_t i = 0; i < count && next == state->interval_ms; i++) {
+            if (presets_ms[i] > state->interval_ms) {
+                next = presets_ms[i];
+            }
+        }
+    } else {
+        for (size_t i = count; i-- > 0 && next == state->interval_ms;) {
+            if (presets_ms[i] < state->interval_ms) {
+                next = presets_ms[i];
+            }
+        }
+    }
+
+    if (next != state->interval_ms) {
+        state->interval_ms    = next;
+        state->interval_stale = true;
+        state->frame_dirty |= FRAME_DIRTY_INPUT;
+    }
+}
+
+static void remember_selection(AppState* state, const ProcessTable* table) {
+    if (state->selected_index < 0 ||
+        (size_t)state->selected_index >= state->view.count)
         return;
 
-    box(terminate_dialog, 0, 0);
-    keypad(terminate_dialog, TRUE);
+    uint32_t row          = state->view.rows[state->selected_index];
+    state->selected_pid   = table->pids[row];
+    state->selected_start = table->start_times[row];
+}
 
-    mvwprintw(terminate_dialog, 1, 2, "Terminate process: %s PID %d",
-              proc->name, proc->pid);
-    mvwprintw(terminate_dialog, 2, 2, "--------------------------------");
-    mvwprintw(terminate_dialog, 3, 4, "1. SIGTERM (graceful termination)");
-    mvwprintw(terminate_dialog, 4, 4, "2. Cancel");
-    mvwprintw(terminate_dialog, 5, 4, "Select option [1-2]: ");
+// Position of the selected process in the view, or view.count if it is gone.
+static size_t find_selected(const AppState* state, const ProcessTable* table) {
+    for (size_t i = 0; i < state->view.count; i++) {
+        uint32_t row = state->view.rows[i];
 
-    wrefresh(terminate_dialog);
+        if (table->pids[row] == state->selected_pid &&
+            table->start_times[row] == state->selected_start)
+            return i;
+    }
 
-    int choice = wgetch(terminate_dialog);
+    return state->view.count;
+}
 
-    if (choice == '1') {
-        if (kill(proc->pid, SIGTERM) == 0) {
-            mvwprintw(terminate_dialog, 1, 2,
-                      "Successfully sent SIGTERM to %s PID %d", proc->name,
-                      proc->pid);
-        } else {
-            mvwprintw(terminate_dialog, 1, 2,
-                      "Failed to send SIGTERM to %s PID %d", proc->name,
-                      proc->pid);
-            mvwprintw(terminate_dialog, 2, 4, "Error: %s", strerror(errno));
+// Re-sorts the view for table and moves the cursor to wherever the selected
+// process ended up. It stays at the same position if that process is gone.
+// same_rows is true when table is the snapshot the view was last updated
+// for.
+static void update_view(AppState* state, const ProcessTable* table,
+                        bool same_rows) {
+    size_t limit = 0;
+
+    // Top mode selects just the rows the screen can reach. Once the cursor
+    // has scrolled past them, every snapshot is sorted in full instead.
+    if (state->top_only) {
+        size_t window = (size_t)visible_row_count(state) * TOP_MODE_PAGES;
+
+        if ((size_t)state->selected_index < window) {
+            limit = window > 0 ? window : 1;
         }
-        mvwprintw(terminate_dialog, 4, 4, "Press any key to continue...");
-        wrefresh(terminate_dialog);
-        wgetch(terminate_dialog);
     }
 
-    delwin(terminate_dialog);
-    touchwin(stdscr);
-    wrefresh(stdscr);
+    process_view_set_limit(&state->view, limit);
+    process_view_update(&state->view, table, same_rows);
+
+    // Tags follow processes, so the ones that exited are dropped.
+    if (!same_rows) {
+        signal_targets_retain(&state->tagged, table);
+    }
+
+    size_t position = find_selected(state, table);
+
+    // Beyond the selected top rows the order is arbitrary, so the position
+    // only means something once those are sorted too.
+    if (position < state->view.count &&
+        position >= state->view.sorted_count) {
+        process_view_sort_all(&state->view, table);
+        position = find_selected(state, table);
+    }
+
+    if (position < state->view.count) {
+        state->selected_index = (int)position;
+    }
+
+    if (state->view.count > 0) {
+        if (state->selected_index >= (int)state->view.count) {
+            state->selected_index = state->view.count - 1;
+        }
+    } else {
+        state->selected_index = 0;
+    }
+
+    state->order_stale = false;
+    state->frame_dirty |= FRAME_DIRTY_DATA;
+    scroll_to_cursor(state);
+    ensure_window_sorted(state, table);
+}
+
+// Sorts the rest of a top-mode view once the visible window reaches past the
+// rows it ordered.
+static void ensure_window_sorted(AppState* state, const ProcessTable* table) {
+    size_t window_end = (size_t)state->selected_index + 1;
+    size_t visible    = (size_t)state->scroll_offset +
+                     (size_t)visible_row_count(state);
+
+    if (window_end < visible) {
+        window_end = visible;
+    }
+
+    if (window_end > state->view.sorted_count) {
+        process_view_sort_all(&state->view, table);
+    }
 }
 
-static void render_memory_info(const SystemMemoryInfo* mem_info) {
-    if (mem_info == NULL)
+static int visible_row_count(const AppState* state) {
+    int max_y = getmaxy(stdscr);
+    int rows  = max_y - 7 - (state->show_profile ? PROFILE_LINES : 0);
+
+    return rows > 0 ? rows : 0;
+}
+
+// offset scrolled just far enough to bring cursor on screen, and back from
+// beyond the last page after the list shrank or the window grew.
+static long follow_cursor(long offset, long cursor, long count,
+                          long visible) {
+    long last_page = count > visible ? count - visible : 0;
+
+    if (cursor < offset) {
+        offset = cursor;
+    } else if (visible > 0 && cursor >= offset + visible) {
+        offset = cursor - visible + 1;
+    }
+
+    if (offset > last_page) {
+        offset = last_page;
+    }
+
+    return offset > 0 ? offset : 0;
+}
+
+static void scroll_to_cursor(AppState* state) {
+    state->scroll_offset = (int)follow_cursor(
+        state->scroll_offset, state->selected_index, (long)state->view.count,
+        visible_row_count(state));
+}
+
+static void scroll_cgroups_to_cursor(AppState* state) {
+    state->cgroup_scroll_offset = (size_t)follow_cursor(
+        (long)state->cgroup_scroll_offset, (long)state->cgroup_index,
+        (long)state->cgroup_order_count, visible_row_count(state));
+}
+
+// index moved by rows within a list of count, without overflowing for the
+// LONG_MAX of Home and End.
+static long clamp_move(long index, long rows, long count) {
+    if (count <= 0 || rows <= -index)
+        return 0;
+
+    if (rows >= count - index)
+        return count - 1;
+
+    return index + rows;
+}
+
+// Moves the cursor of the shown list by rows. A page move scrolls the
+// list as far, so the cursor keeps its line.
+static void move_cursor(AppState* state, long rows, bool page) {
+    if (state->show_cgroups) {
+        size_t index = (size_t)clamp_move((long)state->cgroup_index, rows,
+                                          (long)state->cgroup_order_count);
+
+        if (index == state->cgroup_index)
+            return;
+
+        if (page) {
+            long offset = (long)state->cgroup_scroll_offset +
+                          (long)index - (long)state->cgroup_index;
+
+            state->cgroup_scroll_offset = offset > 0 ? (size_t)offset : 0;
+        }
+        state->cgroup_index = index;
+        scroll_cgroups_to_cursor(state);
+        state->frame_dirty |= FRAME_DIRTY_INPUT;
+        return;
+    }
+
+    int index = (int)clamp_move(state->selected_index, rows,
+                                (long)state->view.count);
+
+    if (index == state->selected_index)
         return;
 
-    int max_x = getmaxx(stdscr);
+    if (page) {
+        state->scroll_offset += index - state->selected_index;
+    }
+    state->selected_index = index;
+    scroll_to_cursor(state);
+    state->frame_dirty |= FRAME_DIRTY_INPUT;
+}
+
+// Asks which signal to send to subject. Returns its index in menu_signals,
+// or -1 if the menu was dismissed.
+static int choose_signal(const char* subject) {
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+
+    int     rows   = (int)(MENU_SIGNAL_COUNT + 1) / 2;
+    WINDOW* dialog = newwin(rows + 5, 60, max_y / 2 - (rows + 5) / 2,
+                            max_x / 2 - 30);
+
+    if (dialog == NULL)
+        return -1;
 
-    for (int i = 0; i < 3; i++) {
-        move(i, 0);
-        clrtoeol();
+    box(dialog, 0, 0);
+    keypad(dialog, TRUE);
+
+    mvwprintw(dialog, 1, 2, "Send a signal to %s", subject);
+    mvwprintw(dialog, 2, 2, "--------------------------------");
+    for (size_t i = 0; i < MENU_SIGNAL_COUNT; i++) {
+        mvwprintw(dialog, 3 + (int)i / 2, 4 + (int)(i % 2) * 24, "%zu. %s",
+                  i + 1, menu_signals[i].name);
     }
+    mvwprintw(dialog, 3 + rows, 2, "Select [1-%zu], any other key cancels: ",
+              MENU_SIGNAL_COUNT);
+
+    wrefresh(dialog);
+
+    int choice = wgetch(dialog) - '1';
+
+    delwin(dialog);
+    touchwin(stdscr);
+    wrefresh(stdscr);
+
+    return choice >= 0 && choice < (int)MENU_SIGNAL_COUNT ? choice : -1;
+}
+
+// The memory lines end in sparklines of the used and available memory,
+// against the total, unless history is NULL.
+static void render_memory_info(ScreenCache*            screen,
+                               const SystemMemoryInfo* mem_info,
+                               const SystemCpuTimes*   cpu_delta,
+                               const History*          history,
+                               const char*             title) {
+    if (screen == NULL || mem_info == NULL || cpu_delta == NULL ||
+        title == NULL)
+        return;
 
     double mem_total_mb     = (double)mem_info->mem_total_kb / KB_TO_MB;
     double mem_free_mb      = (double)mem_info->mem_free_kb / KB_TO_MB;
@@ -350,99 +1027,393 @@ static void render_memory_info(const SystemMemoryInfo* mem_info) {
     if (swap_used_mb < 0)
         swap_used_mb = 0;
 
-    attron(A_BOLD);
-    mvprintw(0, 0, "System Memory Information (auto-refresh every 3s):");
-    attroff(A_BOLD);
+    char used[HISTORY_SPARK_WIDTH + 8]      = "";
+    char available[HISTORY_SPARK_WIDTH + 8] = "";
+
+    if (history != NULL) {
+        unsigned long total_kb = mem_info->mem_total_kb > 0
+                                     ? (unsigned long)mem_info->mem_total_kb
+                                     : 0;
+        char          spark[HISTORY_SPARK_WIDTH + 1];
+
+        history_format_sparkline(&history->mem_used_kb, total_kb, spark);
+        snprintf(used, sizeof(used), "  %s", spark);
+        history_format_sparkline(&history->mem_available_kb, total_kb, spark);
+        snprintf(available, sizeof(available), "  %s", spark);
+    }
+
+    screen_put_line(screen, 0, A_BOLD,
+                    "%s  CPU %4.1f%% us %4.1f%% sy %4.1f%% id", title,
+                    cpu_times_percent(cpu_delta, cpu_delta->user),
+                    cpu_times_percent(cpu_delta, cpu_delta->system),
+                    cpu_times_percent(cpu_delta, cpu_delta->idle));
 
-    mvprintw(1, 0,
-             "MiB Mem : %8.1f total, %8.1f free, %8.1f used, %8.1f buff/cache",
-             mem_total_mb, mem_free_mb, mem_used_mb, mem_cached_mb);
+    screen_put_line(
+        screen, 1, A_NORMAL,
+        "MiB Mem : %8.1f total, %8.1f free, %8.1f used, %8.1f buff/cache%s",
+        mem_total_mb, mem_free_mb, mem_used_mb, mem_cached_mb, used);
 
-    mvprintw(2, 0,
-             "MiB Swap: %8.1f total, %8.1f free, %8.1f used, %8.1f avail Mem",
-             swap_total_mb, swap_free_mb, swap_used_mb, mem_available_mb);
+    screen_put_line(
+        screen, 2, A_NORMAL,
+        "MiB Swap: %8.1f total, %8.1f free, %8.1f used, %8.1f avail Mem%s",
+        swap_total_mb, swap_free_mb, swap_used_mb, mem_available_mb,
+        available);
 
-    // Draw separator line
-    for (int i = 0; i < max_x; i++) {
-        mvaddch(4, i, '-');
+    screen_put_hline(screen, 4, '-');
+}
+
+// Fills prefix with what goes before the name of the row at index in the
+// view and returns the width left for the name. Threads are indented under
+// their process; in tree mode a process also gets a branch, + when its
+// descendants are collapsed.
+static int format_name_prefix(const ProcessView* view, bool thread,
+                              size_t index, char* prefix, size_t size) {
+    if (!view->tree) {
+        snprintf(prefix, size, "%s", thread ? "  " : "");
+        return thread ? 20 : 22;
+    }
+
+    unsigned int depth  = view->tree_rows.depths[index];
+    unsigned int indent = depth < TREE_DEPTH_SHOWN ? depth : TREE_DEPTH_SHOWN;
+    unsigned int flags  = view->tree_rows.flags[index];
+    int          length = 0;
+
+    if (thread) {
+        length = snprintf(prefix, size, "%*s", (int)(2 * indent + 2), "");
+    } else if (depth == 0) {
+        length = snprintf(prefix, size, "%s",
+                          flags & VIEW_TREE_COLLAPSED ? "+ " : "");
+    } else {
+        length = snprintf(prefix, size, "%*s%c%c ", (int)(2 * (indent - 1)),
+                          "", flags & VIEW_TREE_LAST ? '`' : '|',
+                          flags & VIEW_TREE_COLLAPSED ? '+' : '-');
     }
+
+    return TREE_NAME_WIDTH - length;
 }
 
-static void render_process_list(const AppState*    state,
-                                const ProcessInfo* processes, size_t count) {
-    if (processes == NULL || state == NULL)
+// The PSS, USS, swap and shared columns of one process, each ten wide, or
+// dashes until its smaps_rollup has been read.
+static void format_memory_detail(const MemoryDetail* memory, char* text,
+                                 size_t size) {
+    if (!memory->known) {
+        snprintf(text, size, "%-10s%-10s%-10s%-10s", "-", "-", "-", "-");
         return;
+    }
 
-    int max_y, max_x;
-    getmaxyx(stdscr, max_y, max_x);
+    snprintf(text, size, "%-9lu %-9lu %-9lu %-9lu ", memory->pss_kb,
+             memory->uss_kb, memory->swap_kb, memory->shared_kb);
+}
+
+static void render_process_list(ScreenCache* screen, const AppState* state,
+                                const Snapshot* snapshot) {
+    if (screen == NULL || snapshot == NULL || state == NULL)
+        return;
+
+    const ProcessTable* table = &snapshot->processes;
+    const ProcessView*  view  = &state->view;
+    size_t              count = view->count;
+
+    int max_y = getmaxy(stdscr);
+
+    static const char* const column_titles[SORT_KEY_COUNT] = {
+        [SORT_BY_PID]   = "PID",
+        [SORT_BY_NAME]  = "NAME",
+        [SORT_BY_STATE] = "STATE",
+        [SORT_BY_RSS]   = "MEM (KB)",
+        [SORT_BY_CPU]   = "%CPU",
+    };
+    char titles[SORT_KEY_COUNT][16];
+
+    for (int key = 0; key < SORT_KEY_COUNT; key++) {
+        snprintf(titles[key], sizeof(titles[key]), "%s%s", column_titles[key],
+                 key == (int)view->key ? (view->descending ? "v" : "^") : "");
+    }
+
+    // Tree mode adds each process's memory together with its descendants'.
+    screen_put_line(screen, 3, A_UNDERLINE, "%-8s %-*s %-6s %6s %-12s %s%s",
+                    titles[SORT_BY_PID], view->tree ? TREE_NAME_WIDTH : 22,
+                    titles[SORT_BY_NAME], titles[SORT_BY_STATE],
+                    titles[SORT_BY_CPU], titles[SORT_BY_RSS],
+                    state->show_memory ? "PSS (KB)  USS (KB)  SWAP (KB) "
+                                         "SHARED    "
+                                       : "",
+                    view->tree ? "TREE (KB)" : "");
+    screen_put_hline(screen, 4, '-');
+
+    int visible_rows = visible_row_count(state);
+    int start_idx    = state->scroll_offset;
+
+    // Every line is formatted, but only the ones whose text or highlight
+    // changed since the last frame reach ncurses.
+    for (int i = 0; i < visible_rows; i++) {
+        int process_idx = i + start_idx;
+
+        if (process_idx >= (int)count) {
+            screen_put_line(screen, i + 5, A_NORMAL, "%s", "");
+            continue;
+        }
 
-    for (int i = 5; i < max_y - 2; i++) {
-        move(i, 0);
-        clrtoeol();
+        uint32_t row    = view->rows[process_idx];
+        bool     thread = table->tgids[row] != 0;
+        bool     tagged = !thread &&
+                      signal_targets_contains(&state->tagged, table->pids[row],
+                                              table->start_times[row]);
+        attr_t   attrs  = process_idx == state->selected_index ? A_REVERSE
+                                                               : A_NORMAL;
+
+        char prefix[2 * TREE_DEPTH_SHOWN + 4];
+        char subtree[24] = "";
+        char detail[48]  = "";
+        char trend[HISTORY_SPARK_WIDTH + 4] = "";
+        int  width  = format_name_prefix(view, thread, (size_t)process_idx,
+                                         prefix, sizeof(prefix));
+
+        if (state->show_memory && !thread) {
+            format_memory_detail(&table->memory[row], detail, sizeof(detail));
+        } else if (state->show_memory) {
+            snprintf(detail, sizeof(detail), "%40s", "");
+        }
+
+        if (view->tree && !thread) {
+            snprintf(subtree, sizeof(subtree), "%lu",
+                     view->tree_rows.subtree_rss_kb[process_idx]);
+        }
+
+        // The selected process's RSS over time, against its own peak.
+        const HistoryRing* rss_history =
+            process_idx == state->selected_index && !thread
+                ? history_find_process(&state->history, table->pids[row],
+                                       table->start_times[row])
+                : NULL;
+
+        if (rss_history != NULL) {
+            char spark[HISTORY_SPARK_WIDTH + 1];
+
+            history_format_sparkline(rss_history, 0, spark);
+            snprintf(trend, sizeof(trend), "  %s", spark);
+        }
+
+        if (thread) {
+            attrs |= A_DIM;
+        } else if (tagged) {
+            attrs |= A_BOLD;
+        }
+
+        screen_put_line(screen, i + 5, attrs,
+                        "%-8d%c%s%-*.*s %-6c %4u.%u %-12lu %s%s%s",
+                        table->pids[row], tagged ? '*' : ' ', prefix, width,
+                        width, process_table_name(table, row),
+                        table->states[row], table->cpu_tenths[row] / 10,
+                        table->cpu_tenths[row] % 10, table->rss_kb[row],
+                        detail, subtree, trend);
     }
 
-    attron(A_UNDERLINE);
-    mvprintw(3, 0, "%-8s %-22s %-6s %-12s", "PID", "NAME", "STATE", "MEM (KB)");
-    attroff(A_UNDERLINE);
+    char tags[32] = "";
 
-    for (int i = 0; i < max_x; i++) {
-        mvaddch(4, i, '-');
+    if (state->tagged.count > 0) {
+        snprintf(tags, sizeof(tags), " | Tagged %zu", state->tagged.count);
     }
 
-    int visible_rows = max_y - 7;
+    if (process_view_filtered(view)) {
+        bool queried = view->filter.term_count > 0;
+        bool grouped = view->filter.cgroup != 0;
+
+        screen_put_line(screen, max_y - 2, A_NORMAL,
+                        "Processes: %zu%s%s%s%s%s, %zu threads shown | "
+                        "Selected %d of %zu%s",
+                        view->matched_count, queried ? " matching \"" : "",
+                        queried ? state->filter_query : "",
+                        queried ? "\"" : "", grouped ? " in " : "",
+                        grouped ? state->cgroup_path : "", view->thread_count,
+                        state->selected_index + 1, count, tags);
+    } else {
+        char short_lived[48] = "";
+
+        if (state->proc_events) {
+            snprintf(short_lived, sizeof(short_lived), ", %zu short-lived",
+                     snapshot->short_lived_count);
+        }
 
-    if (visible_rows < 0) {
-        visible_rows = 0;
+        screen_put_line(screen, max_y - 2, A_NORMAL,
+                        "Processes: %zu (+%zu -%zu%s), %zu threads shown | "
+                        "Selected %d of %zu%s",
+                        count - view->thread_count +
+                            (view->tree ? view->tree_rows.hidden_count : 0),
+                        snapshot->new_count, snapshot->exited_count,
+                        short_lived, view->thread_count,
+                        state->selected_index + 1, count, tags);
     }
 
-    int start_idx = 0;
+    if (state->filter_editing) {
+        screen_put_line(screen, max_y - 1, A_BOLD,
+                        "Filter: %s_  %s(words, pid:N, state:RS, re:REGEX; "
+                        "Enter:Keep  Esc:Clear)",
+                        state->filter_query,
+                        state->filter_invalid ? "[bad term] " : "");
+        return;
+    }
 
-    if (count > 0 && state->selected_index >= visible_rows) {
-        start_idx = state->selected_index - visible_rows + 1;
+    if (state->message[0] != '\0') {
+        screen_put_line(screen, max_y - 1, A_BOLD, "%s", state->message);
+        return;
     }
 
-    for (int i = 0; i < visible_rows && (i + start_idx) < (int)count; i++) {
-        int                process_idx = i + start_idx;
-        const ProcessInfo* proc        = &processes[process_idx];
+    screen_put_line(screen, max_y - 1, A_NORMAL, "%s",
+                    state->replay_frames > 0
+                        ? "Q:Quit  ↑↓/PgUp/PgDn:Navigate  Left/Right:Frame  "
+                          "</>:Skip 64 frames  /:Filter  T:Tree  Space:Fold  "
+                          "M/C/P/N/S:Sort"
+                        : "Q:Quit  ↑↓/PgUp/PgDn:Navigate  K:Signal  X:Tag  "
+                          "U:Untag  "
+                          "R:Refresh Now  E:Threads  T:Tree  Space:Fold  "
+                          "/:Filter  +/-:Interval  D:Memory  G:Cgroups  "
+                          "O:Profile  "
+                          "M/C/P/N/S:Sort by mem/cpu/pid/name/state");
+}
+
+// Drawn instead of the process list while the groups are shown. Each
+// group's memory is its own accounting, which the root group does not have.
+static void render_cgroup_list(ScreenCache* screen, const AppState* state,
+                               const Snapshot* snapshot) {
+    if (screen == NULL || snapshot == NULL || state == NULL)
+        return;
+
+    const CgroupList* groups    = &snapshot->cgroups;
+    size_t            count     = state->cgroup_order_count;
+    size_t            processes = 0;
+
+    int max_y = getmaxy(stdscr);
+
+    screen_put_line(screen, 3, A_UNDERLINE, "%-44s %7s %12s %12s %12s",
+                    "CGROUP", "PROCS", "MEMORY (KB)", "ANON (KB)",
+                    "FILE (KB)");
+    screen_put_hline(screen, 4, '-');
 
-        if (process_idx == state->selected_index) {
-            attron(A_REVERSE);
+    size_t visible_rows = (size_t)visible_row_count(state);
+    size_t start_idx    = state->cgroup_scroll_offset;
+
+    for (size_t i = 0; i < visible_rows; i++) {
+        size_t index = i + start_idx;
+
+        if (index >= count) {
+            screen_put_line(screen, (int)i + 5, A_NORMAL, "%s", "");
+            continue;
         }
 
-        mvprintw(i + 5, 0, "%-8d %-22.22s %-6c %-12lu", proc->pid, proc->name,
-                 proc->state, proc->vm_rss_kb);
+        const CgroupRow*    group  = state->cgroup_order[index];
+        const CgroupMemory* memory = &group->memory;
+        const char*         path   = cgroup_list_path(
+            groups, (size_t)(group - groups->rows));
+        size_t              length = strlen(path);
+        char                amounts[3][16];
 
-        if (process_idx == state->selected_index) {
-            attroff(A_REVERSE);
+        // Deep paths keep their end, which names the group.
+        if (length > 44) {
+            path += length - 41;
         }
+
+        snprintf(amounts[0], sizeof(amounts[0]), memory->known ? "%lu" : "-",
+                 memory->current_kb);
+        snprintf(amounts[1], sizeof(amounts[1]), memory->known ? "%lu" : "-",
+                 memory->anon_kb);
+        snprintf(amounts[2], sizeof(amounts[2]), memory->known ? "%lu" : "-",
+                 memory->file_kb);
+
+        screen_put_line(screen, (int)i + 5,
+                        index == state->cgroup_index ? A_REVERSE : A_NORMAL,
+                        "%s%-*s %7zu %12s %12s %12s", length > 44 ? "..." : "",
+                        length > 44 ? 41 : 44, path, group->process_count,
+                        amounts[0], amounts[1], amounts[2]);
     }
 
-    mvprintw(max_y - 2, 0, "Processes: %zu | Selected %d of %zu", count,
-             state->selected_index + 1, count);
+    for (size_t i = 0; i < groups->count; i++) {
+        processes += groups->rows[i].process_count;
+    }
 
-    int y, x;
-    getyx(stdscr, y, x);
-    mvaddch(y, x - 1, ' ');
+    screen_put_line(screen, max_y - 2, A_NORMAL,
+                    "Cgroups: %zu holding %zu processes | Selected %zu of %zu",
+                    count, processes, count > 0 ? state->cgroup_index + 1 : 0,
+                    count);
 
-    mvprintw(max_y - 1, 0, "Q:Quit  ↑↓:Navigate  K:Kill  R:Refresh Now");
+    if (state->message[0] != '\0') {
+        screen_put_line(screen, max_y - 1, A_BOLD, "%s", state->message);
+        return;
+    }
+
+    screen_put_line(screen, max_y - 1, A_NORMAL, "%s",
+                    "Q:Quit  ↑↓/PgUp/PgDn:Navigate  Enter:Show its processes  "
+                    "G:Back to processes  R:Refresh Now  O:Profile");
 }
 
-static bool should_refresh(AppState* state) {
-    if (state == NULL)
-        return false;
+// Drawn between the process list and the status line, which visible_row_count
+// leaves room for while the overlay is shown.
+static void render_profile(ScreenCache* screen, const AppState* state) {
+    const Profiler* profiler = &state->profiler;
+    int             top      = getmaxy(stdscr) - 2 - PROFILE_LINES;
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (top < 5)
+        return;
 
-    long elapsed_ms = (now.tv_sec - state->last_update.tv_sec) * 1000 +
-        (now.tv_nsec - state->last_update.tv_nsec) / 1000000;
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        StageSummary summary;
+        profile_summarize(profiler, (ProfileStage)stage, &summary);
 
-    if (elapsed_ms >= REFRESH_INTERVAL_MS || state->needs_refresh) {
-        state->last_update = now;
-        return true;
+        screen_put_line(screen, top + stage, A_DIM,
+                        "%-8s last %9.3f ms  avg %9.3f ms  p99 %9.3f ms",
+                        profile_stage_name((ProfileStage)stage),
+                        (double)summary.last_ns / NS_PER_MS,
+                        (double)summary.avg_ns / NS_PER_MS,
+                        (double)summary.p99_ns / NS_PER_MS);
     }
 
-    return false;
+    screen_put_line(screen, top + PROFILE_STAGE_COUNT, A_DIM,
+                    "%lu /proc syscalls per cycle, %zu processes, over the "
+                    "last %d samples",
+                    profiler->syscalls, profiler->processes, PROFILE_WINDOW);
+}
+
+static void format_interval(char* text, size_t size, long interval_ms) {
+    if (interval_ms < MS_PER_SECOND) {
+        snprintf(text, size, "%ldms", interval_ms);
+    } else if (interval_ms % MS_PER_SECOND == 0) {
+        snprintf(text, size, "%lds", interval_ms / MS_PER_SECOND);
+    } else {
+        snprintf(text, size, "%.1fs", (double)interval_ms / MS_PER_SECOND);
+    }
+}
+
+static void format_title(char* title, size_t size, const AppState* state,
+                         const Replay* replay, const Snapshot* snapshot) {
+    if (replay == NULL) {
+        long interval_ms = sampler_adaptive_interval(
+            state->interval_ms, state->cpu_share, snapshot->cost_ms);
+        char interval[32];
+
+        format_interval(interval, sizeof(interval), interval_ms);
+
+        if (interval_ms > state->interval_ms) {
+            snprintf(title, size,
+                     "System Memory Information (auto-refresh every %s, "
+                     "slowed to stay under %.4g%% CPU):",
+                     interval, state->cpu_share * PERCENT);
+        } else {
+            snprintf(title, size,
+                     "System Memory Information (auto-refresh every %s):",
+                     interval);
+        }
+        return;
+    }
+
+    struct timespec recorded = replay_frame_time(replay);
+    struct tm       local;
+    char            stamp[32];
+
+    localtime_r(&recorded.tv_sec, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    snprintf(title, size, "Replay: frame %zu of %zu, recorded %s",
+             state->replay_frame + 1, state->replay_frames, stamp);
 }
 
 static void init_ncurses(void) {
@@ -451,66 +1422,498 @@ static void init_ncurses(void) {
     cbreak();
     keypad(stdscr, TRUE);
     curs_set(0);
-    timeout(100);
+    // main blocks in poll, so getch only ever drains keys that are ready.
+    timeout(0);
+    // Esc closes the filter prompt without a noticeable wait.
+    set_escdelay(ESCAPE_DELAY_MS);
 }
 
 static void cleanup_ncurses(void) {
     endwin();
 }
 
-int main(void) {
-    init_ncurses();
+static void print_usage(const char* program) {
+    printf("Usage: %s [options]\n"
+           "  -b, --batch          write snapshots to stdout instead of "
+           "running the UI\n"
+           "  -n, --iterations N   stop batch mode after N snapshots "
+           "(default: never)\n"
+           "  -d, --delay MS       milliseconds between snapshots "
+           "(default: %d)\n"
+           "  -a, --adaptive PCT   lengthen the delay to keep sampling under "
+           "PCT%% of a CPU\n"
+           "  -f, --format FORMAT  batch output: text, csv or json "
+           "(default: text)\n"
+           "      --record FILE    log snapshots to FILE in batch mode, for "
+           "--replay\n"
+           "      --replay FILE    browse the snapshots logged in FILE\n"
+           "  -c, --fd-cache       keep per-process /proc files open between "
+           "refreshes\n"
+           "  -j, --jobs N         read /proc with N threads (default: up to "
+           "%d, 1 disables)\n"
+           "  -s, --status         parse /proc/PID/status instead of "
+           "/proc/PID/stat\n"
+           "  -t, --top            only order the processes within scrolling "
+           "reach\n"
+           "      --profile        show ltop's own costs (the O key), or add "
+           "them to batch output\n"
+           "      --proc-root DIR  read processes from DIR instead of /proc\n"
+           "      --proc-events    follow forks and exits through the kernel's "
+           "proc connector\n"
+           "                       instead of listing /proc each refresh "
+           "(needs root)\n"
+           "      --cgroup-root DIR\n"
+           "                       read cgroups (the G key) from DIR instead "
+           "of the cgroup2 mount\n"
+           "      --serve ADDR     serve Prometheus metrics over HTTP at "
+           "[HOST:]PORT or at a\n"
+           "                       Unix socket (unix:PATH) instead of "
+           "running the UI\n"
+           "      --serve-top N    only export the N processes with the most "
+           "memory\n"
+           "  -h, --help           show this help and exit\n",
+           program, REFRESH_INTERVAL_MS, DEFAULT_COLLECT_JOBS);
+}
+
+int main(int argc, char** argv) {
+    static const struct option long_options[] = {
+        {"batch", no_argument, NULL, 'b'},
+        {"iterations", required_argument, NULL, 'n'},
+        {"delay", required_argument, NULL, 'd'},
+        {"adaptive", required_argument, NULL, 'a'},
+        {"format", required_argument, NULL, 'f'},
+        {"record", required_argument, NULL, OPTION_RECORD},
+        {"replay", required_argument, NULL, OPTION_REPLAY},
+        {"fd-cache", no_argument, NULL, 'c'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"status", no_argument, NULL, 's'},
+        {"top", no_argument, NULL, 't'},
+        {"profile", no_argument, NULL, OPTION_PROFILE},
+        {"proc-root", required_argument, NULL, OPTION_PROC_ROOT},
+        {"proc-events", no_argument, NULL, OPTION_PROC_EVENTS},
+        {"cgroup-root", required_argument, NULL, OPTION_CGROUP_ROOT},
+        {"serve", required_argument, NULL, OPTION_SERVE},
+        {"serve-top", required_argument, NULL, OPTION_SERVE_TOP},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+
+    bool         batch_mode      = false;
+    BatchOptions batch_options   = {.format      = BATCH_FORMAT_TEXT,
+                                    .delay_ms    = REFRESH_INTERVAL_MS,
+                                    .fd          = STDOUT_FILENO,
+                                    .buffer_size = DEFAULT_BATCH_BUFFER_SIZE};
+    bool         use_fd_cache    = false;
+    ProcParser   parser          = PROC_PARSER_STAT;
+    bool         top_only        = false;
+    const char*  replay_path     = NULL;
+    bool         proc_root_set   = false;
+    bool         proc_events     = false;
+    bool         cgroup_root_set = false;
+    const char*  serve_address   = NULL;
+    long         serve_top       = 0;
+    int          jobs            = 0;
+    int          opt;
+
+    while ((opt = getopt_long(argc, argv, "bn:d:a:f:cj:sth", long_options,
+                              NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                batch_mode = true;
+                break;
+
+            case 'n':
+                batch_options.iterations = atol(optarg);
+                if (batch_options.iterations <= 0) {
+                    fprintf(stderr, "%s: invalid iteration count '%s'\n",
+                            argv[0], optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'd':
+                batch_options.delay_ms = atol(optarg);
+                if (batch_options.delay_ms < MIN_SAMPLE_INTERVAL_MS ||
+                    batch_options.delay_ms > MAX_SAMPLE_INTERVAL_MS) {
+                    fprintf(stderr, "%s: invalid delay '%s'\n", argv[0],
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case OPTION_RECORD:
+                batch_mode                = true;
+                batch_options.record_path = optarg;
+                break;
+
+            case OPTION_REPLAY:
+                replay_path = optarg;
+                break;
+
+            case 'a':
+                batch_options.cpu_share = atof(optarg) / PERCENT;
+                if (batch_options.cpu_share <= 0 ||
+                    batch_options.cpu_share > 1) {
+                    fprintf(stderr, "%s: invalid CPU percentage '%s'\n",
+                            argv[0], optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'f':
+                if (!batch_parse_format(optarg, &batch_options.format)) {
+                    fprintf(stderr, "%s: unknown format '%s'\n", argv[0],
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'c':
+                use_fd_cache = true;
+                break;
+
+            case 'j':
+                jobs = atoi(optarg);
+                if (jobs <= 0) {
+                    fprintf(stderr, "%s: invalid job count '%s'\n", argv[0],
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 's':
+                parser = PROC_PARSER_STATUS;
+                break;
+
+            case 't':
+                top_only = true;
+                break;
+
+            case OPTION_PROFILE:
+                batch_options.profile = true;
+                break;
+
+            case OPTION_PROC_ROOT:
+                if (!proc_set_root(optarg)) {
+                    fprintf(stderr, "%s: invalid proc root '%s'\n", argv[0],
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                proc_root_set = true;
+                break;
+
+            case OPTION_PROC_EVENTS:
+                proc_events = true;
+                break;
+
+            case OPTION_CGROUP_ROOT:
+                if (!cgroup_set_root(optarg)) {
+                    fprintf(stderr, "%s: invalid cgroup root '%s'\n", argv[0],
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                cgroup_root_set = true;
+                break;
+
+            case OPTION_SERVE:
+                serve_address = optarg;
+                break;
+
+            case OPTION_SERVE_TOP:
+                serve_top = atol(optarg);
+                if (serve_top <= 0) {
+                    fprintf(stderr, "%s: invalid process count '%s'\n",
+                            argv[0], optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'h':
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs      = cpus > 0 && cpus < DEFAULT_COLLECT_JOBS ? (int)cpus
+                                                            : DEFAULT_COLLECT_JOBS;
+    }
+
+    // Events describe the live system, not a tree under another root.
+    if (proc_events && proc_root_set) {
+        fprintf(stderr, "%s: --proc-events does not combine with --proc-root\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (serve_address != NULL && (batch_mode || replay_path != NULL)) {
+        fprintf(stderr,
+                "%s: --serve does not combine with batch mode or --replay\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Replay* replay = NULL;
+
+    if (replay_path != NULL) {
+        if (batch_mode) {
+            fprintf(stderr, "%s: --replay does not combine with batch mode\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        replay = replay_open(replay_path);
+        if (replay == NULL) {
+            fprintf(stderr, "%s: %s is not a readable ltop recording\n",
+                    argv[0], replay_path);
+            return EXIT_FAILURE;
+        }
+    }
 
-    AppState app_state = {
-        .selected_index = 0, .should_quit = false, .needs_refresh = true};
-    clock_gettime(CLOCK_MONOTONIC, &app_state.last_update);
+    FdCache       fd_cache;
+    ProcCollector collector;
+    proc_collector_init(&collector, parser);
+
+    // Replay reads nothing from /proc, so it needs neither.
+    if (replay == NULL && jobs > 1) {
+        collector.pool = worker_pool_create(jobs, use_fd_cache);
+        if (collector.pool == NULL) {
+            fprintf(stderr, "%s: unable to start %d collection threads\n",
+                    argv[0], jobs);
+            return EXIT_FAILURE;
+        }
+    } else if (replay == NULL && use_fd_cache) {
+        if (!fd_cache_init(&fd_cache, 1)) {
+            fprintf(stderr, "%s: unable to set up the fd cache\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        collector.cache = &fd_cache;
+    }
 
-    SystemMemoryInfo last_mem_info      = {0};
-    ProcessInfo*     last_processes     = NULL;
-    size_t           last_process_count = 0;
+    if (replay == NULL && proc_events) {
+        collector.events = proc_events_open();
+        if (collector.events == NULL) {
+            fprintf(stderr,
+                    "%s: proc events unavailable, listing /proc on every "
+                    "refresh\n",
+                    argv[0]);
+        }
+    }
+
+    // Batch mode samples on this thread and never touches the terminal.
+    if (batch_mode) {
+        bool ok = batch_run(&collector, &batch_options);
+
+        proc_collector_destroy(&collector);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (serve_address != NULL) {
+        ExportOptions export_options = {.address   = serve_address,
+                                        .top       = (size_t)serve_top,
+                                        .delay_ms  = batch_options.delay_ms,
+                                        .cpu_share = batch_options.cpu_share};
+        bool          ok = export_run(&collector, &export_options);
+
+        proc_collector_destroy(&collector);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Hybrid hosts mount cgroup v2 below /sys/fs/cgroup.
+    if (replay == NULL && !cgroup_root_set) {
+        cgroup_find_root();
+    }
+
+    Sampler* sampler = NULL;
+
+    if (replay == NULL &&
+        (sampler = sampler_create(&collector, batch_options.delay_ms,
+                                  batch_options.cpu_share)) == NULL) {
+        fprintf(stderr, "%s: unable to start the sampler thread\n", argv[0]);
+        proc_collector_destroy(&collector);
+        return EXIT_FAILURE;
+    }
+
+    init_ncurses();
+
+    AppState app_state = {.selected_index = 0,
+                          .should_quit    = false,
+                          .data_stale     = false,
+                          .frame_dirty    = FRAME_DIRTY_DATA,
+                          .top_only       = top_only,
+                          .interval_ms    = batch_options.delay_ms,
+                          .cpu_share      = batch_options.cpu_share,
+                          .replay_frames  = replay_frame_count(replay),
+                          .show_profile   = batch_options.profile,
+                          .proc_events    = collector.events != NULL,
+                          .can_signal     = replay == NULL && !proc_root_set};
+
+    // Collection runs on the sampler thread; this loop only sleeps in poll
+    // until a key arrives or a new snapshot is published, so input is handled
+    // immediately however long a scan takes.
+    struct pollfd wait_fds[] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = sampler != NULL ? sampler_event_fd(sampler) : -1,
+         .events = POLLIN},
+    };
+    ScreenCache        screen         = {0};
+    const ProcessTable no_processes   = {0};
+    const CgroupList   no_cgroups     = {0};
+    unsigned long      shown_sequence = 0;
 
     while (!app_state.should_quit) {
-        if (should_refresh(&app_state)) {
-            if (last_processes != NULL) {
-                free(last_processes);
-                last_processes = NULL;
+        const Snapshot* snapshot =
+            replay != NULL ? replay_seek(replay, app_state.replay_frame)
+                           : sampler_acquire(sampler);
+
+        if (snapshot != NULL && (snapshot->sequence != shown_sequence ||
+                                 app_state.order_stale)) {
+            // A recording carries no collection costs to show.
+            if (replay == NULL && snapshot->sequence != shown_sequence) {
+                Profiler* profiler = &app_state.profiler;
+
+                profile_record(profiler, PROFILE_COLLECT, snapshot->collect_ns);
+                profile_record(profiler, PROFILE_READ,
+                               snapshot->collect_stats.read_ns);
+                profile_record(profiler, PROFILE_MEMINFO, snapshot->meminfo_ns);
+                // Most snapshots read no smaps_rollup at all.
+                if (snapshot->memory_reads > 0) {
+                    profile_record(profiler, PROFILE_SMAPS,
+                                   snapshot->memory_ns);
+                }
+                if (app_state.cgroups_sampled) {
+                    profile_record(profiler, PROFILE_CGROUP,
+                                   snapshot->cgroup_ns);
+                }
+                profiler->syscalls  = snapshot->collect_stats.syscalls;
+                profiler->processes = snapshot->processes.count;
             }
 
-            last_processes = collect_processes(&last_process_count);
+            update_view(&app_state, &snapshot->processes,
+                        snapshot->sequence == shown_sequence);
+
+            // Pushed after update_view, which found the selected row. A
+            // replay can step back, so only live snapshots are kept.
+            if (replay == NULL && snapshot->sequence != shown_sequence) {
+                const ProcessView* view = &app_state.view;
 
-            if (!read_system_memory_info(&last_mem_info)) {
-                memset(&last_mem_info, 0, sizeof(last_mem_info));
+                history_push_system(&app_state.history, &snapshot->mem_info);
+                history_push_processes(
+                    &app_state.history, &snapshot->processes,
+                    view->count > 0 ? view->rows[app_state.selected_index]
+                                    : snapshot->processes.count);
             }
+            shown_sequence = snapshot->sequence;
+        }
+
+        // Navigation only marks the frame dirty, so it redraws the cached
+        // snapshot without touching /proc.
+        if (app_state.frame_dirty != 0 && snapshot != NULL) {
+            unsigned long long render_started = profile_now_ns();
+
+            // A resize or the profile overlay changes how many rows fit.
+            scroll_to_cursor(&app_state);
+            ensure_window_sorted(&app_state, &snapshot->processes);
+
+            // After a resize or a dialog the terminal may not show what the
+            // cache remembers, so every line is drawn again.
+            if (app_state.frame_dirty &
+                (FRAME_DIRTY_RESIZE | FRAME_DIRTY_DIALOG)) {
+                screen_cache_invalidate(&screen);
+            }
+
+            char title[LINE_BUFFER_SIZE];
+            format_title(title, sizeof(title), &app_state, replay, snapshot);
+
+            if (screen_cache_begin(&screen) && snapshot->have_processes) {
+                render_memory_info(&screen, &snapshot->mem_info,
+                                   &snapshot->cpu_delta,
+                                   replay == NULL ? &app_state.history : NULL,
+                                   title);
 
-            if (last_process_count > 0) {
-                if (app_state.selected_index >= (int)last_process_count) {
-                    app_state.selected_index = last_process_count - 1;
+                if (app_state.show_cgroups) {
+                    order_cgroups(&app_state, &snapshot->cgroups);
+                    render_cgroup_list(&screen, &app_state, snapshot);
+                } else {
+                    render_process_list(&screen, &app_state, snapshot);
+                }
+
+                if (app_state.show_profile) {
+                    render_profile(&screen, &app_state);
                 }
             } else {
-                app_state.selected_index = 0;
+                clear();
+                screen_cache_invalidate(&screen);
+                mvprintw(
+                    0, 0,
+                    "Unable to read process information. Check permissions.");
             }
 
-            app_state.needs_refresh = false;
+            refresh();
+            app_state.frame_dirty = 0;
+
+            if (sampler != NULL) {
+                watch_threads(&app_state, sampler, &snapshot->processes);
+                watch_memory(&app_state, sampler, &snapshot->processes);
+            }
+            profile_record(&app_state.profiler, PROFILE_RENDER,
+                           profile_now_ns() - render_started);
         }
 
-        if (last_processes != NULL) {
-            render_memory_info(&last_mem_info);
-            render_process_list(&app_state, last_processes, last_process_count);
-        } else {
-            clear();
-            mvprintw(0, 0,
-                     "Unable to read process information. Check permissions.");
+        if (app_state.interval_stale) {
+            sampler_set_interval(sampler, app_state.interval_ms);
+            app_state.interval_stale = false;
         }
 
-        refresh();
+        // Cgroups are read while the groups or one group's processes are
+        // shown, starting with a snapshot taken right away.
+        bool cgroups_wanted =
+            app_state.show_cgroups || app_state.view.filter.cgroup != 0;
 
-        handle_user_input(&app_state, last_processes, last_process_count);
-    }
+        if (sampler != NULL && cgroups_wanted != app_state.cgroups_sampled) {
+            sampler_set_cgroups(sampler, cgroups_wanted);
+            app_state.cgroups_sampled = cgroups_wanted;
+            app_state.data_stale      = app_state.data_stale || cgroups_wanted;
+        }
+
+        if (app_state.data_stale && sampler != NULL) {
+            sampler_request_refresh(sampler);
+            app_state.data_stale = false;
+        }
+
+        // SIGWINCH interrupts poll with EINTR; the getch below then returns
+        // the KEY_RESIZE that ncurses queued.
+        poll(wait_fds, sizeof(wait_fds) / sizeof(wait_fds[0]), -1);
+
+        const ProcessTable* table =
+            snapshot != NULL ? &snapshot->processes : &no_processes;
+        const CgroupList* groups =
+            snapshot != NULL ? &snapshot->cgroups : &no_cgroups;
+
+        while (!app_state.should_quit &&
+               handle_user_input(&app_state, table, groups)) {
+        }
 
-    if (last_processes != NULL) {
-        free(last_processes);
+        // The snapshot may be recycled by the next acquire, so note which
+        // process the cursor is on while its rows are still valid.
+        remember_selection(&app_state, table);
     }
 
+    screen_cache_destroy(&screen);
+    process_view_destroy(&app_state.view);
+    pid_list_destroy(&app_state.watch);
+    pid_list_destroy(&app_state.watch_sent);
+    free(app_state.memory_watch);
+    free(app_state.memory_sent);
+    free(app_state.cgroup_order);
+    signal_targets_destroy(&app_state.tagged);
+    sampler_destroy(sampler);
+    replay_close(replay);
+    proc_collector_destroy(&collector);
     cleanup_ncurses();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,496 @@
+#include "model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MODEL_NO_SLOT           UINT32_MAX
+#define MODEL_COMPACT_MIN_BYTES 4096
+
+static size_t index_home(const ProcessModel* model, int pid,
+                         unsigned long long start_time) {
+    uint64_t hash = (uint64_t)(unsigned int)pid * 0x9E3779B97F4A7C15ull;
+    hash ^= start_time * 0xC2B2AE3D27D4EB4Full;
+    hash ^= hash >> 29;
+
+    return (size_t)hash & (model->index_capacity - 1);
+}
+
+static uint32_t* index_find(ProcessModel* model, int pid, int tgid,
+                            unsigned long long start_time) {
+    if (model->index_capacity == 0)
+        return NULL;
+
+    size_t mask = model->index_capacity - 1;
+
+    for (size_t i = index_home(model, pid, start_time);; i = (i + 1) & mask) {
+        uint32_t slot = model->index[i];
+
+        if (slot == MODEL_NO_SLOT)
+            return NULL;
+        if (model->records[slot].pid == pid &&
+            model->records[slot].tgid == tgid &&
+            model->records[slot].start_time == start_time)
+            return &model->index[i];
+    }
+}
+
+static void index_insert(ProcessModel* model, uint32_t slot) {
+    const ProcessRecord* record = &model->records[slot];
+    size_t               mask   = model->index_capacity - 1;
+    size_t i = index_home(model, record->pid, record->start_time);
+
+    while (model->index[i] != MODEL_NO_SLOT) {
+        i = (i + 1) & mask;
+    }
+
+    model->index[i] = slot;
+    model->live_count++;
+}
+
+static void index_remove(ProcessModel* model, uint32_t* cell) {
+    // Backward-shift deletion, as in the fd cache.
+    size_t mask = model->index_capacity - 1;
+    size_t hole = (size_t)(cell - model->index);
+
+    for (size_t i = (hole + 1) & mask; model->index[i] != MODEL_NO_SLOT;
+         i     = (i + 1) & mask) {
+        const ProcessRecord* record = &model->records[model->index[i]];
+        size_t home = index_home(model, record->pid, record->start_time);
+
+        bool reachable = hole <= i ? (home > hole && home <= i)
+                                   : (home > hole || home <= i);
+        if (!reachable) {
+            model->index[hole] = model->index[i];
+            hole               = i;
+        }
+    }
+
+    model->index[hole] = MODEL_NO_SLOT;
+    model->live_count--;
+}
+
+// Makes room for live processes at a load factor of at most one half.
+static bool index_reserve(ProcessModel* model, size_t live) {
+    if (live * 2 <= model->index_capacity)
+        return true;
+
+    size_t new_capacity = model->index_capacity > 0 ? model->index_capacity
+                                                    : INITIAL_CAPACITY_SIZE;
+    while (new_capacity < live * 2) {
+        new_capacity *= 2;
+    }
+
+    uint32_t* index = malloc(new_capacity * sizeof(uint32_t));
+    if (index == NULL)
+        return false;
+
+    // Every byte 0xff makes every cell MODEL_NO_SLOT.
+    memset(index, 0xff, new_capacity * sizeof(uint32_t));
+
+    uint32_t* old_index    = model->index;
+    size_t    old_capacity = model->index_capacity;
+
+    model->index          = index;
+    model->index_capacity = new_capacity;
+    model->live_count     = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_index[i] != MODEL_NO_SLOT) {
+            index_insert(model, old_index[i]);
+        }
+    }
+
+    free(old_index);
+    return true;
+}
+
+static bool grow_array(void** array, size_t element_size, size_t* capacity,
+                       size_t size) {
+    if (size <= *capacity)
+        return true;
+
+    size_t new_capacity = *capacity > 0 ? *capacity : INITIAL_CAPACITY_SIZE;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    void* grown = realloc(*array, new_capacity * element_size);
+    if (grown == NULL)
+        return false;
+
+    *array    = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool records_reserve(ProcessModel* model, size_t size) {
+    size_t capacity = model->record_capacity;
+
+    if (!grow_array((void**)&model->records, sizeof(ProcessRecord), &capacity,
+                    size))
+        return false;
+
+    // The free list can hold every slot, so pushing onto it never fails.
+    size_t free_capacity = model->record_capacity;
+    if (!grow_array((void**)&model->free_slots, sizeof(uint32_t),
+                    &free_capacity, capacity))
+        return false;
+
+    model->record_capacity = capacity;
+    return true;
+}
+
+static uint32_t allocate_slot(ProcessModel* model) {
+    if (model->free_count > 0)
+        return model->free_slots[--model->free_count];
+
+    return (uint32_t)model->record_count++;
+}
+
+static void reap_record(ProcessModel* model, uint32_t slot) {
+    ProcessRecord* record = &model->records[slot];
+    uint32_t*      cell =
+        index_find(model, record->pid, record->tgid, record->start_time);
+
+    if (cell != NULL) {
+        index_remove(model, cell);
+    }
+    if (record->tgid != 0) {
+        model->thread_records--;
+    }
+
+    model->garbage_bytes += strlen(process_model_name(model, record)) + 1;
+    record->pid                            = 0;
+    model->free_slots[model->free_count++] = slot;
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int left  = *(const int*)a;
+    int right = *(const int*)b;
+
+    return (left > right) - (left < right);
+}
+
+static bool contains_int(const int* sorted, size_t count, int value) {
+    return count > 0 &&
+           bsearch(&value, sorted, count, sizeof(int), compare_ints) != NULL;
+}
+
+// Fills model->listed_groups with the distinct tgids of scan's thread rows.
+static bool list_thread_groups(ProcessModel* model, const ProcessTable* scan) {
+    model->listed_count = 0;
+
+    for (size_t row = 0; row < scan->count; row++) {
+        if (scan->tgids[row] == 0)
+            continue;
+
+        if (!grow_array((void**)&model->listed_groups, sizeof(int),
+                        &model->listed_capacity, model->listed_count + 1))
+            return false;
+
+        model->listed_groups[model->listed_count++] = scan->tgids[row];
+    }
+
+    if (model->listed_count == 0)
+        return true;
+
+    qsort(model->listed_groups, model->listed_count, sizeof(int),
+          compare_ints);
+
+    size_t distinct = 0;
+    for (size_t i = 0; i < model->listed_count; i++) {
+        if (distinct == 0 ||
+            model->listed_groups[distinct - 1] != model->listed_groups[i]) {
+            model->listed_groups[distinct++] = model->listed_groups[i];
+        }
+    }
+    model->listed_count = distinct;
+
+    return true;
+}
+
+// Marks the thread records the last scan missed as exited, reaps the ones
+// marked before, and leaves the rest cached; see ProcessModel.
+// exits_known is false if model->exited_pids could not hold every exit, in
+// which case no thread is kept.
+static void expire_threads(ProcessModel* model, bool exits_known) {
+    for (size_t slot = 0; slot < model->record_count; slot++) {
+        ProcessRecord* record = &model->records[slot];
+
+        if (record->pid == 0 || record->tgid == 0 ||
+            record->generation == model->generation)
+            continue;
+
+        if (record->flags & PROCESS_EXITED) {
+            reap_record(model, (uint32_t)slot);
+        } else if (!exits_known ||
+                   contains_int(model->listed_groups, model->listed_count,
+                                record->tgid) ||
+                   contains_int(model->exited_pids, model->exited_count,
+                                record->tgid)) {
+            record->flags = PROCESS_EXITED;
+        } else {
+            record->flags = 0;
+        }
+    }
+}
+
+// Share of one CPU, in tenths of a percent, that used ticks make of the
+// delta ticks all CPUs spent.
+static unsigned int cpu_tenths(unsigned long long used,
+                               const SystemCpuTimes* delta) {
+    if (delta->total == 0 || used == 0)
+        return 0;
+
+    unsigned long long tenths = used * 1000 * delta->cpu_count / delta->total;
+    unsigned long long limit  = 1000ull * delta->cpu_count;
+
+    return (unsigned int)(tenths < limit ? tenths : limit);
+}
+
+// Stores the ticks spent since the previous update in model->cpu_delta, or
+// zeroes it if either update lacks the totals.
+static void update_cpu_times(ProcessModel* model, const SystemCpuTimes* now) {
+    const SystemCpuTimes* before = &model->cpu_times;
+
+    memset(&model->cpu_delta, 0, sizeof(SystemCpuTimes));
+
+    if (now != NULL && before->total > 0 && now->total > before->total &&
+        now->cpu_count > 0) {
+        model->cpu_delta = (SystemCpuTimes){
+            .user      = now->user - before->user,
+            .system    = now->system - before->system,
+            .idle      = now->idle - before->idle,
+            .total     = now->total - before->total,
+            .cpu_count = now->cpu_count};
+    }
+
+    if (now != NULL) {
+        model->cpu_times = *now;
+    } else {
+        memset(&model->cpu_times, 0, sizeof(SystemCpuTimes));
+    }
+}
+
+// Rebuilds the name arena without dead names once they make up most of it.
+static void compact_names(ProcessModel* model) {
+    if (model->garbage_bytes < MODEL_COMPACT_MIN_BYTES ||
+        model->garbage_bytes * 2 < model->names.size)
+        return;
+
+    NameArena compacted = {0};
+    if (!name_arena_reserve(&compacted,
+                            model->names.size - model->garbage_bytes))
+        return;
+
+    for (size_t slot = 0; slot < model->record_count; slot++) {
+        ProcessRecord* record = &model->records[slot];
+
+        if (record->pid != 0) {
+            name_arena_append(&compacted, process_model_name(model, record),
+                              &record->name_offset);
+        }
+    }
+
+    name_arena_destroy(&model->names);
+    model->names         = compacted;
+    model->garbage_bytes = 0;
+}
+
+void process_model_destroy(ProcessModel* model) {
+    if (model == NULL)
+        return;
+
+    free(model->records);
+    free(model->free_slots);
+    free(model->index);
+    free(model->scan_slots);
+    free(model->listed_groups);
+    free(model->exited_pids);
+    name_arena_destroy(&model->names);
+    memset(model, 0, sizeof(ProcessModel));
+}
+
+bool process_model_update(ProcessModel* model, const ProcessTable* scan,
+                          const SystemCpuTimes* cpu_times) {
+    if (model == NULL || scan == NULL)
+        return false;
+
+    // Reserve for the worst case (every scanned process is new) up front, so
+    // the update below cannot fail halfway.
+    size_t new_slots =
+        scan->count > model->free_count ? scan->count - model->free_count : 0;
+
+    if (!records_reserve(model, model->record_count + new_slots) ||
+        !index_reserve(model, model->live_count + scan->count) ||
+        !grow_array((void**)&model->scan_slots, sizeof(uint32_t),
+                    &model->scan_capacity, scan->count) ||
+        !name_arena_reserve(&model->names,
+                            model->names.size + scan->names.size) ||
+        !list_thread_groups(model, scan))
+        return false;
+
+    update_cpu_times(model, cpu_times);
+
+    model->generation++;
+    model->new_count     = 0;
+    model->changed_count = 0;
+    model->exited_count  = 0;
+    model->scan_count    = scan->count;
+
+    for (size_t row = 0; row < scan->count; row++) {
+        const char* name = process_table_name(scan, row);
+        bool        thread = scan->tgids[row] != 0;
+        uint32_t*   cell   = index_find(model, scan->pids[row],
+                                        scan->tgids[row],
+                                        scan->start_times[row]);
+
+        if (cell == NULL) {
+            uint32_t       slot   = allocate_slot(model);
+            ProcessRecord* record = &model->records[slot];
+
+            *record = (ProcessRecord){.pid        = scan->pids[row],
+                                      .tgid       = scan->tgids[row],
+                                      .ppid       = scan->ppids[row],
+                                      .start_time = scan->start_times[row],
+                                      .state      = scan->states[row],
+                                      .rss_kb     = scan->rss_kb[row],
+                                      .cpu_ticks  = scan->cpu_ticks[row],
+                                      .generation = model->generation,
+                                      .flags      = PROCESS_NEW};
+            name_arena_append(&model->names, name, &record->name_offset);
+            index_insert(model, slot);
+
+            model->scan_slots[row] = slot;
+            if (thread) {
+                model->thread_records++;
+            } else {
+                model->new_count++;
+            }
+            continue;
+        }
+
+        ProcessRecord* record = &model->records[*cell];
+        unsigned int   flags  = 0;
+
+        if (record->state != scan->states[row] ||
+            record->rss_kb != scan->rss_kb[row] ||
+            record->ppid != scan->ppids[row]) {
+            record->state  = scan->states[row];
+            record->rss_kb = scan->rss_kb[row];
+            record->ppid   = scan->ppids[row];
+            flags |= PROCESS_CHANGED;
+        }
+
+        // comm rarely changes (exec or prctl), so the stored name is only
+        // replaced when it actually differs.
+        const char* known_name = process_model_name(model, record);
+        if (strcmp(known_name, name) != 0) {
+            model->garbage_bytes += strlen(known_name) + 1;
+            name_arena_append(&model->names, name, &record->name_offset);
+            flags |= PROCESS_CHANGED;
+        }
+
+        if ((flags & PROCESS_CHANGED) && !thread) {
+            model->changed_count++;
+        }
+
+        // CPU time moves for nearly every busy process, so it is tracked
+        // without counting as a change. A thread coming back from the cache
+        // has ticks from an older update than the delta covers.
+        unsigned long long ticks = scan->cpu_ticks[row];
+        bool current = record->generation + 1 == model->generation;
+
+        record->cpu_tenths = current && ticks > record->cpu_ticks
+                                 ? cpu_tenths(ticks - record->cpu_ticks,
+                                              &model->cpu_delta)
+                                 : 0;
+        record->cpu_ticks  = ticks;
+
+        record->flags          = flags;
+        record->generation     = model->generation;
+        model->scan_slots[row] = *cell;
+    }
+
+    // Processes missing from this scan are marked exited for one update, so
+    // consumers can see them go, and reaped on the next.
+    bool exits_known = true;
+
+    for (size_t slot = 0; slot < model->record_count; slot++) {
+        ProcessRecord* record = &model->records[slot];
+
+        if (record->pid == 0 || record->tgid != 0 ||
+            record->generation == model->generation)
+            continue;
+
+        if (record->flags & PROCESS_EXITED) {
+            reap_record(model, (uint32_t)slot);
+            continue;
+        }
+
+        record->flags = PROCESS_EXITED;
+
+        // The exited PIDs only matter to cached threads.
+        if (model->thread_records > 0 && exits_known) {
+            exits_known = grow_array((void**)&model->exited_pids, sizeof(int),
+                                     &model->exited_capacity,
+                                     model->exited_count + 1);
+            if (exits_known) {
+                model->exited_pids[model->exited_count] = record->pid;
+            }
+        }
+        model->exited_count++;
+    }
+
+    if (model->thread_records > 0) {
+        if (exits_known && model->exited_count > 1) {
+            qsort(model->exited_pids, model->exited_count, sizeof(int),
+                  compare_ints);
+        }
+        expire_threads(model, exits_known);
+    }
+
+    compact_names(model);
+    return true;
+}
+
+ProcessRecord* process_model_record(ProcessModel* model, uint32_t slot,
+                                    int pid) {
+    if (model == NULL || slot >= model->record_count || pid <= 0 ||
+        model->records[slot].pid != pid)
+        return NULL;
+
+    return &model->records[slot];
+}
+
+bool process_model_export(const ProcessModel* model, ProcessTable* table) {
+    if (model == NULL || table == NULL)
+        return false;
+
+    process_table_clear(table);
+
+    for (size_t row = 0; row < model->scan_count; row++) {
+        const ProcessRecord* record  = &model->records[model->scan_slots[row]];
+        ProcessInfo          process = {.pid        = record->pid,
+                                        .tgid       = record->tgid,
+                                        .ppid       = record->ppid,
+                                        .state      = record->state,
+                                        .vm_rss_kb  = record->rss_kb,
+                                        .start_time = record->start_time,
+                                        .cpu_ticks  = record->cpu_ticks,
+                                        .cpu_tenths = record->cpu_tenths,
+                                        .memory     = record->memory,
+                                        .cgroup     = record->cgroup};
+
+        snprintf(process.name, sizeof(process.name), "%s",
+                 process_model_name(model, record));
+
+        if (!process_table_append(table, &process))
+            return false;
+
+        table->ids[table->count - 1] = model->scan_slots[row];
+    }
+
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef LTOP_MODEL_H
+#define LTOP_MODEL_H
+
+#include "table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROCESS_NEW     0x1u // first seen in the last update
+#define PROCESS_CHANGED 0x2u // state, RSS, parent or name differ from before
+#define PROCESS_EXITED  0x4u // missing from the last update, reaped on the next
+
+// What the model knows about one process. Records keep their slot for the
+// whole life of the process, so a slot index identifies it across updates.
+typedef struct {
+    int                pid;  // 0 marks a free slot
+    int                tgid; // owning process of a thread, 0 for a process
+    int                ppid; // changes when the parent exits
+    unsigned long long start_time;
+    char               state;
+    unsigned long      rss_kb;
+    unsigned long long cpu_ticks;  // utime + stime at the last update
+    unsigned int       cpu_tenths; // %CPU x 10 between the last two updates
+    uint32_t           name_offset; // into ProcessModel::names
+    unsigned int       generation;  // last update that saw this process
+    unsigned int       flags;
+    MemoryDetail       memory;
+    unsigned int       memory_generation; // update it was read in, 0 if never
+    uint32_t           cgroup;            // CgroupSet id, 0 until read
+} ProcessRecord;
+
+// Process state that persists across scans. Each update diffs a fresh scan
+// against the known records by (pid, start time): surviving processes only
+// have their changed fields written, new ones get a record, and missing ones
+// are marked exited and reaped one update later.
+//
+// Thread rows (see collect_threads) get records of their own, told apart
+// from processes by their tgid. Threads are only listed for a few processes
+// at a time, so a thread missing from a scan is only marked exited if its
+// process's tasks were listed or the process itself exited; otherwise its
+// record stays cached, unexported, until the thread is listed again. The
+// new, changed and exited counts are of processes only.
+typedef struct {
+    ProcessRecord* records;
+    size_t         record_count; // high-water mark, free slots included
+    size_t         record_capacity;
+    uint32_t*      free_slots;
+    size_t         free_count;
+
+    uint32_t* index; // open-addressed slot numbers, MODEL_NO_SLOT when empty
+    size_t    index_capacity;
+    size_t    live_count; // records in the index
+
+    NameArena names;
+    size_t    garbage_bytes; // arena bytes of replaced or reaped names
+
+    uint32_t* scan_slots; // record slot of each row of the last scan
+    size_t    scan_count;
+    size_t    scan_capacity;
+
+    size_t thread_records;  // records with a tgid, cached ones included
+    int*   listed_groups;   // sorted tgids of the last scan's thread rows
+    size_t listed_count;
+    size_t listed_capacity;
+    int*   exited_pids;     // sorted PIDs of processes the last update
+    size_t exited_capacity; // marked exited, exited_count of them
+
+    SystemCpuTimes cpu_times; // passed to the last update
+    SystemCpuTimes cpu_delta; // ticks between the last two updates
+
+    unsigned int generation;
+    size_t       new_count;
+    size_t       changed_count;
+    size_t       exited_count;
+} ProcessModel;
+
+void process_model_destroy(ProcessModel* model);
+
+// Folds a complete scan into the model, with the /proc/stat totals read in
+// the same cycle (NULL if unknown). Each process's %CPU is its tick delta
+// against its own previous record, over the ticks one CPU spent meanwhile;
+// it is 0 on the first update that sees the process. Returns false if the
+// model could not grow; it then still describes the previous scan's
+// processes.
+bool process_model_update(ProcessModel* model, const ProcessTable* scan,
+                          const SystemCpuTimes* cpu_times);
+
+// The record in slot, as exported in ProcessTable::ids, or NULL unless it
+// still holds the process or thread pid.
+ProcessRecord* process_model_record(ProcessModel* model, uint32_t slot,
+                                    int pid);
+
+// Refills table with the processes seen by the last update, in scan order.
+bool process_model_export(const ProcessModel* model, ProcessTable* table);
+
+static inline const char* process_model_name(const ProcessModel*  model,
+                                             const ProcessRecord* record) {
+    return model->names.data + record->name_offset;
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "output.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Longest line output_printf formats in one go.
+#define OUTPUT_FORMAT_MAX 512
+
+static void write_buffer(OutputBuffer* out) {
+    size_t written = 0;
+
+    while (!out->failed && written < out->size) {
+        ssize_t result =
+            write(out->fd, out->data + written, out->size - written);
+
+        if (result < 0) {
+            if (errno != EINTR) {
+                out->failed = true;
+            }
+            continue;
+        }
+
+        written += (size_t)result;
+    }
+
+    out->size = 0;
+}
+
+// Makes room in a full buffer: writes it out, or grows it when there is no
+// file descriptor. Returns false if it is still full.
+static bool make_room(OutputBuffer* out) {
+    if (out->fd >= 0) {
+        write_buffer(out);
+        return true;
+    }
+
+    char* data = out->failed ? NULL : realloc(out->data, out->capacity * 2);
+    if (data == NULL) {
+        out->failed = true;
+        return false;
+    }
+
+    out->data = data;
+    out->capacity *= 2;
+    return true;
+}
+
+bool output_buffer_init(OutputBuffer* out, int fd, size_t capacity) {
+    if (out == NULL || capacity == 0)
+        return false;
+
+    memset(out, 0, sizeof(OutputBuffer));
+
+    out->data = malloc(capacity);
+    if (out->data == NULL)
+        return false;
+
+    out->fd       = fd;
+    out->capacity = capacity;
+    return true;
+}
+
+void output_buffer_destroy(OutputBuffer* out) {
+    if (out == NULL)
+        return;
+
+    free(out->data);
+    memset(out, 0, sizeof(OutputBuffer));
+}
+
+void output_reset(OutputBuffer* out) {
+    if (out != NULL) {
+        out->size   = 0;
+        out->failed = false;
+    }
+}
+
+bool output_flush(OutputBuffer* out) {
+    if (out == NULL)
+        return false;
+
+    write_buffer(out);
+    return !out->failed;
+}
+
+void output_append(OutputBuffer* out, const char* data, size_t len) {
+    while (len > 0) {
+        if (out->size == out->capacity && !make_room(out))
+            return;
+
+        size_t chunk = out->capacity - out->size;
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        memcpy(out->data + out->size, data, chunk);
+        out->size += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void output_string(OutputBuffer* out, const char* str) {
+    output_append(out, str, strlen(str));
+}
+
+void output_char(OutputBuffer* out, char ch) {
+    if (out->size == out->capacity && !make_room(out))
+        return;
+
+    out->data[out->size++] = ch;
+}
+
+void output_unsigned(OutputBuffer* out, unsigned long long value) {
+    char  digits[20];
+    char* end = digits + sizeof(digits);
+    char* p   = end;
+
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    output_append(out, p, (size_t)(end - p));
+}
+
+void output_printf(OutputBuffer* out, const char* format, ...) {
+    char    line[OUTPUT_FORMAT_MAX];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (len < 0)
+        return;
+
+    output_append(out, line,
+                  (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+}
+
+void output_json_string(OutputBuffer* out, const char* str) {
+    static const char hex[] = "0123456789abcdef";
+
+    output_char(out, '"');
+
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            output_char(out, '\\');
+            output_char(out, (char)*p);
+        } else if (*p < 0x20) {
+            char escape[] = {'\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xf]};
+            output_append(out, escape, sizeof(escape));
+        } else {
+            output_char(out, (char)*p);
+        }
+    }
+
+    output_char(out, '"');
+}
+
+void output_csv_field(OutputBuffer* out, const char* str) {
+    output_char(out, '"');
+
+    for (const char* p = str; *p; p++) {
+        if (*p == '"') {
+            output_char(out, '"');
+        }
+        output_char(out, *p);
+    }
+
+    output_char(out, '"');
+}
@@ -0,0 +1,41 @@
+#ifndef LTOP_OUTPUT_H
+#define LTOP_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Fixed-size write buffer in front of a file descriptor. Appends only copy
+// into the buffer; it is written out when full and on output_flush, so a
+// snapshot that fits costs a single write(2).
+//
+// With an fd of -1 nothing is written: the buffer grows to hold everything
+// appended until output_reset, keeping its capacity for the next fill.
+typedef struct {
+    int    fd;
+    char*  data;
+    size_t size;
+    size_t capacity;
+    bool   failed; // a write failed; later output is dropped
+} OutputBuffer;
+
+bool output_buffer_init(OutputBuffer* out, int fd, size_t capacity);
+void output_buffer_destroy(OutputBuffer* out);
+
+// Drops what is buffered without writing it, and any earlier failure.
+void output_reset(OutputBuffer* out);
+
+// Writes out everything buffered. Returns false if any write so far failed.
+bool output_flush(OutputBuffer* out);
+
+void output_append(OutputBuffer* out, const char* data, size_t len);
+void output_string(OutputBuffer* out, const char* str);
+void output_char(OutputBuffer* out, char ch);
+void output_unsigned(OutputBuffer* out, unsigned long long value);
+void output_printf(OutputBuffer* out, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// str as the contents of a JSON string or of a CSV field, quotes included.
+void output_json_string(OutputBuffer* out, const char* str);
+void output_csv_field(OutputBuffer* out, const char* str);
+
+#endif
@@ -0,0 +1,188 @@
+#include "pool.h"
+#include "table.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    WorkerPool*  pool;
+    pthread_t    thread;
+    int          index;
+    bool         use_fd_cache;
+    FdCache      cache;
+    ProcessTable rows;  // this worker's slice of the last scan
+    CollectStats stats; // and what reading it cost
+    bool         ok;
+} Worker;
+
+struct WorkerPool {
+    pthread_mutex_t lock;
+    pthread_cond_t  work_ready;
+    pthread_cond_t  work_done;
+
+    // Current job, published under lock and read-only while workers run.
+    ProcParser   parser;
+    const int*   pids;
+    size_t       pid_count;
+    unsigned int job_generation;
+    int          pending; // workers still busy with the current job
+    bool         shutting_down;
+
+    Worker* workers;
+    int     worker_count;
+    int     started; // threads actually created
+};
+
+static void run_slice(Worker* worker) {
+    WorkerPool* pool  = worker->pool;
+    size_t      begin = pool->pid_count * (size_t)worker->index /
+        (size_t)pool->worker_count;
+    size_t end = pool->pid_count * (size_t)(worker->index + 1) /
+        (size_t)pool->worker_count;
+
+    memset(&worker->stats, 0, sizeof(CollectStats));
+    worker->ok = collect_process_range(
+        worker->use_fd_cache ? &worker->cache : NULL, pool->parser,
+        pool->pids + begin, end - begin, &worker->rows, &worker->stats);
+}
+
+static void* worker_main(void* arg) {
+    Worker*      worker          = arg;
+    WorkerPool*  pool            = worker->pool;
+    unsigned int seen_generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;) {
+        while (!pool->shutting_down && pool->job_generation == seen_generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+
+        if (pool->shutting_down)
+            break;
+
+        seen_generation = pool->job_generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_slice(worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+WorkerPool* worker_pool_create(int worker_count, bool use_fd_cache) {
+    if (worker_count <= 0)
+        return NULL;
+
+    WorkerPool* pool = calloc(1, sizeof(WorkerPool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->workers = calloc((size_t)worker_count, sizeof(Worker));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->worker_count = worker_count;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (int i = 0; i < worker_count; i++) {
+        Worker* worker = &pool->workers[i];
+
+        worker->pool         = pool;
+        worker->index        = i;
+        worker->use_fd_cache = use_fd_cache;
+
+        if (use_fd_cache &&
+            !fd_cache_init(&worker->cache, (unsigned int)worker_count)) {
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+
+    return pool;
+}
+
+void worker_pool_destroy(WorkerPool* pool) {
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        fd_cache_destroy(&pool->workers[i].cache);
+        process_table_destroy(&pool->workers[i].rows);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+bool worker_pool_collect(WorkerPool* pool, ProcParser parser, const int* pids,
+                         size_t count, ProcessTable* table,
+                         CollectStats* stats) {
+    if (pool == NULL || table == NULL)
+        return false;
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->parser    = parser;
+    pool->pids      = pids;
+    pool->pid_count = count;
+    pool->pending   = pool->worker_count;
+    pool->job_generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    // Slices are contiguous and merged in worker order, so the table comes
+    // out in the same order as a single-threaded scan.
+    bool ok = true;
+
+    process_table_clear(table);
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (stats != NULL) {
+            stats->read_ns += pool->workers[i].stats.read_ns;
+            stats->syscalls += pool->workers[i].stats.syscalls;
+        }
+    }
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        ok = pool->workers[i].ok && ok;
+        if (!process_table_append_table(table, &pool->workers[i].rows))
+            return false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,25 @@
+#ifndef LTOP_POOL_H
+#define LTOP_POOL_H
+
+#include "proc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEFAULT_COLLECT_JOBS 4
+
+// Starts worker_count collection threads. Each worker keeps its own slice
+// table between refreshes and, with use_fd_cache, its own share of the fd
+// budget. Returns NULL on failure.
+WorkerPool* worker_pool_create(int worker_count, bool use_fd_cache);
+void        worker_pool_destroy(WorkerPool* pool);
+
+// Splits pids into one contiguous slice per worker, reads the slices in
+// parallel and merges them into table in the original order, adding the
+// workers' costs to stats unless it is NULL. Blocks until every worker is
+// done.
+bool worker_pool_collect(WorkerPool* pool, ProcParser parser, const int* pids,
+                         size_t count, ProcessTable* table,
+                         CollectStats* stats);
+
+#endif
@@ -0,0 +1,1137 @@
+#include "proc.h"
+#include "events.h"
+#include "pool.h"
+#include "table.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define PROC_DIRENT_BUFFER_SIZE (64 * 1024)
+
+// Record layout returned by getdents64(2), which glibc does not declare
+// without _GNU_SOURCE.
+typedef struct {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+} LinuxDirent64;
+
+// Set once before collection starts, then only read.
+static char proc_root_path[PROC_ROOT_MAX] = PROC_ROOT_DEFAULT;
+
+// /proc syscalls issued by the calling thread, for CollectStats.
+static _Thread_local unsigned long proc_syscalls;
+
+static const char* const proc_file_names[PROC_FILE_COUNT] = {
+    [PROC_FILE_STAT]   = "stat",
+    [PROC_FILE_STATUS] = "status",
+};
+
+static int           parse_pid(const char* name);
+static size_t        fd_cache_slot(const FdCache* cache, int pid);
+static FdCacheEntry* fd_cache_lookup(FdCache* cache, int pid);
+static FdCacheEntry* fd_cache_insert(FdCache* cache, int pid);
+static void          fd_cache_remove(FdCache* cache, FdCacheEntry* entry);
+static ssize_t read_proc_file(FdCache* cache, int pid, ProcFile file, char* buf,
+                              size_t size);
+static unsigned long long read_process_start_time(int pid);
+static bool read_pid_directory(const char* path, PidList* list);
+static unsigned long long monotonic_ns(void);
+
+static int parse_pid(const char* name) {
+    // PIDs are capped well below INT_MAX (PID_MAX_LIMIT is 2^22), so more
+    // than nine digits cannot name a process.
+    int pid = 0;
+
+    for (int i = 0; name[i] != '\0'; i++) {
+        if (name[i] < '0' || name[i] > '9' || i >= 9)
+            return 0;
+        pid = pid * 10 + (name[i] - '0');
+    }
+
+    return pid;
+}
+
+bool proc_set_root(const char* root) {
+    if (root == NULL || root[0] == '\0' || strlen(root) >= PROC_ROOT_MAX)
+        return false;
+
+    snprintf(proc_root_path, sizeof(proc_root_path), "%s", root);
+    return true;
+}
+
+void proc_collector_init(ProcCollector* collector, ProcParser parser) {
+    if (collector == NULL)
+        return;
+
+    memset(collector, 0, sizeof(ProcCollector));
+    collector->parser     = parser;
+    collector->meminfo_fd = -1;
+    collector->stat_fd    = -1;
+}
+
+void proc_collector_destroy(ProcCollector* collector) {
+    if (collector == NULL)
+        return;
+
+    worker_pool_destroy(collector->pool);
+    fd_cache_destroy(collector->cache);
+    proc_events_close(collector->events);
+    pid_list_destroy(&collector->pids);
+    pid_list_destroy(&collector->tids);
+
+    if (collector->meminfo_fd >= 0) {
+        close(collector->meminfo_fd);
+    }
+    if (collector->stat_fd >= 0) {
+        close(collector->stat_fd);
+    }
+
+    proc_collector_init(collector, collector->parser);
+}
+
+static size_t fd_cache_slot(const FdCache* cache, int pid) {
+    // Fibonacci hashing spreads the mostly sequential PIDs across the table.
+    return ((unsigned int)pid * 2654435769u) & (cache->capacity - 1);
+}
+
+bool fd_cache_init(FdCache* cache, unsigned int shares) {
+    if (cache == NULL)
+        return false;
+
+    memset(cache, 0, sizeof(FdCache));
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+
+    if (limit.rlim_cur == RLIM_INFINITY) {
+        cache->fd_budget = (size_t)-1;
+    } else if (limit.rlim_cur > FD_CACHE_RESERVED_FDS) {
+        cache->fd_budget = limit.rlim_cur - FD_CACHE_RESERVED_FDS;
+    }
+
+    if (shares > 1) {
+        cache->fd_budget /= shares;
+    }
+
+    cache->capacity = INITIAL_CAPACITY_SIZE;
+    cache->entries  = calloc(cache->capacity, sizeof(FdCacheEntry));
+
+    return cache->entries != NULL;
+}
+
+void fd_cache_destroy(FdCache* cache) {
+    if (cache == NULL || cache->entries == NULL)
+        return;
+
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].pid == 0)
+            continue;
+
+        for (int file = 0; file < PROC_FILE_COUNT; file++) {
+            if (cache->entries[i].fds[file] >= 0) {
+                close(cache->entries[i].fds[file]);
+                proc_syscalls++;
+            }
+        }
+    }
+
+    free(cache->entries);
+    memset(cache, 0, sizeof(FdCache));
+}
+
+static FdCacheEntry* fd_cache_lookup(FdCache* cache, int pid) {
+    if (cache == NULL || cache->entries == NULL)
+        return NULL;
+
+    size_t mask = cache->capacity - 1;
+
+    for (size_t i = fd_cache_slot(cache, pid);; i = (i + 1) & mask) {
+        if (cache->entries[i].pid == pid)
+            return &cache->entries[i];
+        if (cache->entries[i].pid == 0)
+            return NULL;
+    }
+}
+
+static bool fd_cache_grow(FdCache* cache) {
+    size_t        old_capacity = cache->capacity;
+    FdCacheEntry* old_entries  = cache->entries;
+
+    FdCacheEntry* entries = calloc(old_capacity * 2, sizeof(FdCacheEntry));
+    if (entries == NULL)
+        return false;
+
+    cache->entries  = entries;
+    cache->capacity = old_capacity * 2;
+
+    size_t mask = cache->capacity - 1;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].pid == 0)
+            continue;
+
+        size_t slot = fd_cache_slot(cache, old_entries[i].pid);
+        while (entries[slot].pid != 0) {
+            slot = (slot + 1) & mask;
+        }
+        entries[slot] = old_entries[i];
+    }
+
+    free(old_entries);
+    return true;
+}
+
+static FdCacheEntry* fd_cache_insert(FdCache* cache, int pid) {
+    if (cache == NULL || cache->entries == NULL || pid <= 0)
+        return NULL;
+
+    // Keep the load factor at or below one half.
+    if ((cache->count + 1) * 2 > cache->capacity && !fd_cache_grow(cache))
+        return NULL;
+
+    size_t mask = cache->capacity - 1;
+    size_t slot = fd_cache_slot(cache, pid);
+
+    while (cache->entries[slot].pid != 0) {
+        slot = (slot + 1) & mask;
+    }
+
+    FdCacheEntry* entry = &cache->entries[slot];
+
+    entry->pid        = pid;
+    entry->start_time = 0;
+    entry->generation = cache->generation;
+    for (int file = 0; file < PROC_FILE_COUNT; file++) {
+        entry->fds[file] = -1;
+    }
+    cache->count++;
+
+    return entry;
+}
+
+static void fd_cache_remove(FdCache* cache, FdCacheEntry* entry) {
+    if (cache == NULL || entry == NULL || entry->pid == 0)
+        return;
+
+    for (int file = 0; file < PROC_FILE_COUNT; file++) {
+        if (entry->fds[file] >= 0) {
+            close(entry->fds[file]);
+            proc_syscalls++;
+            cache->open_fds--;
+        }
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones.
+    size_t mask = cache->capacity - 1;
+    size_t hole = (size_t)(entry - cache->entries);
+
+    for (size_t i = (hole + 1) & mask; cache->entries[i].pid != 0;
+         i     = (i + 1) & mask) {
+        size_t home = fd_cache_slot(cache, cache->entries[i].pid);
+
+        // Move the entry into the hole unless its home slot lies cyclically
+        // in (hole, i], in which case it is already reachable.
+        bool reachable = hole <= i ? (home > hole && home <= i)
+                                   : (home > hole || home <= i);
+        if (!reachable) {
+            cache->entries[hole] = cache->entries[i];
+            hole                 = i;
+        }
+    }
+
+    cache->entries[hole].pid = 0;
+    cache->count--;
+}
+
+void fd_cache_begin_scan(FdCache* cache) {
+    if (cache != NULL) {
+        cache->generation++;
+    }
+}
+
+void fd_cache_end_scan(FdCache* cache) {
+    if (cache == NULL || cache->entries == NULL)
+        return;
+
+    // Close descriptors of processes that were not seen in this scan. A
+    // removal may shift a later entry into slot i, so only advance past
+    // slots that were kept.
+    size_t i = 0;
+    while (i < cache->capacity) {
+        FdCacheEntry* entry = &cache->entries[i];
+
+        if (entry->pid != 0 && entry->generation != cache->generation) {
+            fd_cache_remove(cache, entry);
+        } else {
+            i++;
+        }
+    }
+}
+
+static ssize_t read_proc_file(FdCache* cache, int pid, ProcFile file, char* buf,
+                              size_t size) {
+    ssize_t       len   = -1;
+    FdCacheEntry* entry = fd_cache_lookup(cache, pid);
+
+    if (entry != NULL && entry->fds[file] >= 0) {
+        len = pread(entry->fds[file], buf, size - 1, 0);
+        proc_syscalls++;
+
+        if (len > 0) {
+            entry->generation = cache->generation;
+            buf[len]          = '\0';
+            return len;
+        }
+
+        // The process behind this descriptor is gone; the PID may already
+        // belong to a new process, which gets a fresh entry below.
+        fd_cache_remove(cache, entry);
+        entry = NULL;
+    }
+
+    char proc_path[PROC_PATH_MAX];
+    snprintf(proc_path, sizeof(proc_path), "%s/%d/%s", proc_root_path, pid,
+             proc_file_names[file]);
+
+    int fd = open(proc_path, O_RDONLY | O_CLOEXEC);
+    proc_syscalls++;
+    if (fd < 0)
+        return -1;
+
+    len = pread(fd, buf, size - 1, 0);
+    proc_syscalls++;
+
+    if (len <= 0) {
+        close(fd);
+        proc_syscalls++;
+        return -1;
+    }
+    buf[len] = '\0';
+
+    if (cache != NULL && cache->open_fds < cache->fd_budget) {
+        if (entry == NULL) {
+            entry = fd_cache_insert(cache, pid);
+        }
+
+        if (entry != NULL) {
+            entry->fds[file]  = fd;
+            entry->generation = cache->generation;
+            cache->open_fds++;
+            return len;
+        }
+    }
+
+    close(fd);
+    proc_syscalls++;
+    return len;
+}
+
+static unsigned long long read_process_start_time(int pid) {
+    char        buf[PROC_READ_BUFFER_SIZE];
+    ProcessInfo scratch;
+
+    if (read_proc_file(NULL, pid, PROC_FILE_STAT, buf, sizeof(buf)) < 0)
+        return 0;
+
+    if (!parse_process_stat(buf, &scratch))
+        return 0;
+
+    return scratch.start_time;
+}
+
+static unsigned long cached_page_size_kb = 4;
+static pthread_once_t page_size_once      = PTHREAD_ONCE_INIT;
+
+static void init_page_size(void) {
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (page_size >= 1024) {
+        cached_page_size_kb = (unsigned long)page_size / 1024;
+    }
+}
+
+static unsigned long page_size_kb(void) {
+    // Parsers run on collection worker threads as well.
+    pthread_once(&page_size_once, init_page_size);
+    return cached_page_size_kb;
+}
+
+// Advances past count space-separated fields, or returns NULL at the end of
+// the buffer.
+static const char* skip_fields(const char* cursor, int count) {
+    while (count-- > 0) {
+        while (*cursor != ' ') {
+            if (*cursor == '\0')
+                return NULL;
+            cursor++;
+        }
+        cursor++;
+    }
+
+    return cursor;
+}
+
+static bool parse_decimal(const char* cursor, unsigned long long* value) {
+    if (*cursor < '0' || *cursor > '9')
+        return false;
+
+    unsigned long long result = 0;
+
+    while (*cursor >= '0' && *cursor <= '9') {
+        result = result * 10 + (unsigned long long)(*cursor - '0');
+        cursor++;
+    }
+
+    *value = result;
+    return true;
+}
+
+bool parse_process_stat(const char* buf, ProcessInfo* process) {
+    if (buf == NULL || process == NULL)
+        return false;
+
+    // comm sits in parentheses and may itself contain spaces or ')', so
+    // everything after it is located from the last ')'.
+    const char* comm_start = strchr(buf, '(');
+    const char* comm_end   = strrchr(buf, ')');
+
+    if (comm_start == NULL || comm_end == NULL || comm_end < comm_start)
+        return false;
+
+    size_t name_len = (size_t)(comm_end - comm_start - 1);
+    if (name_len >= sizeof(process->name)) {
+        name_len = sizeof(process->name) - 1;
+    }
+    memcpy(process->name, comm_start + 1, name_len);
+    process->name[name_len] = '\0';
+
+    // Field 3 (state) follows ") ".
+    const char* field = comm_end + 1;
+    if (field[0] != ' ' || field[1] == '\0')
+        return false;
+    field++;
+    process->state = *field;
+
+    // Field 4 is the parent's PID. Fields 14 and 15 are utime and stime,
+    // field 22 starttime, all in clock ticks, and field 24 the resident set
+    // in pages (the same counter that statm and VmRSS report).
+    unsigned long long ppid, utime, stime, start_time, rss_pages;
+
+    field = skip_fields(field, 4 - 3);
+    if (field == NULL || !parse_decimal(field, &ppid))
+        return false;
+
+    field = skip_fields(field, 14 - 4);
+    if (field == NULL || !parse_decimal(field, &utime))
+        return false;
+
+    field = skip_fields(field, 15 - 14);
+    if (field == NULL || !parse_decimal(field, &stime))
+        return false;
+
+    field = skip_fields(field, 22 - 15);
+    if (field == NULL || !parse_decimal(field, &start_time))
+        return false;
+
+    field = skip_fields(field, 24 - 22);
+    if (field == NULL || !parse_decimal(field, &rss_pages))
+        return false;
+
+    process->ppid       = (int)ppid;
+    process->start_time = start_time;
+    process->cpu_ticks  = utime + stime;
+    process->vm_rss_kb  = (unsigned long)rss_pages * page_size_kb();
+
+    return true;
+}
+
+bool parse_process_status(const char* buf, ProcessInfo* process) {
+    if (buf == NULL || process == NULL)
+        return false;
+
+    bool name_found  = false;
+    bool state_found = false;
+    bool rss_found   = false;
+    bool ppid_found  = false;
+
+    for (const char* line = buf; *line != '\0';) {
+        const char* line_end = strchr(line, '\n');
+        if (line_end == NULL) {
+            line_end = line + strlen(line);
+        }
+
+        if (!name_found && strncmp(line, "Name:", 5) == 0) {
+            const char* name_start = line + 5;
+            while (name_start < line_end &&
+                   isspace((unsigned char)*name_start)) {
+                name_start++;
+            }
+
+            size_t name_len = (size_t)(line_end - name_start);
+            if (name_len >= sizeof(process->name)) {
+                name_len = sizeof(process->name) - 1;
+            }
+            memcpy(process->name, name_start, name_len);
+            process->name[name_len] = '\0';
+            name_found              = true;
+        } else if (!state_found && strncmp(line, "State:", 6) == 0) {
+            const char* state_ptr = line + 6;
+            while (state_ptr < line_end && isspace((unsigned char)*state_ptr)) {
+                state_ptr++;
+            }
+            if (state_ptr < line_end) {
+                process->state = *state_ptr;
+                state_found    = true;
+            }
+        } else if (!rss_found && strncmp(line, "VmRSS:", 6) == 0) {
+            if (sscanf(line + 6, "%lu", &process->vm_rss_kb) == 1) {
+                rss_found = true;
+            }
+        } else if (!ppid_found && strncmp(line, "PPid:", 5) == 0) {
+            ppid_found = sscanf(line + 5, "%d", &process->ppid) == 1;
+        }
+
+        if ((name_found && state_found && rss_found && ppid_found) ||
+            *line_end == '\0') {
+            break;
+        }
+
+        line = line_end + 1;
+    }
+
+    if (!name_found) {
+        snprintf(process->name, sizeof(process->name), "?");
+    }
+    if (!state_found) {
+        process->state = '?';
+    }
+    if (!rss_found) {
+        process->vm_rss_kb = 0;
+    }
+    if (!ppid_found) {
+        process->ppid = 0;
+    }
+
+    return true;
+}
+
+bool read_process_info(FdCache* cache, ProcParser parser,
+                       ProcessInfo* process) {
+    if (process == NULL || process->pid <= 0) {
+        return false;
+    }
+
+    char buf[PROC_READ_BUFFER_SIZE];
+
+    if (parser == PROC_PARSER_STAT &&
+        read_proc_file(cache, process->pid, PROC_FILE_STAT, buf,
+                       sizeof(buf)) > 0 &&
+        parse_process_stat(buf, process)) {
+        return true;
+    }
+
+    if (read_proc_file(cache, process->pid, PROC_FILE_STATUS, buf,
+                       sizeof(buf)) < 0) {
+        return false;
+    }
+
+    parse_process_status(buf, process);
+
+    // status carries no start time. Cached processes look it up once per
+    // lifetime; uncached ones leave it unknown rather than pay a second open
+    // every cycle.
+    FdCacheEntry* entry = fd_cache_lookup(cache, process->pid);
+
+    if (entry != NULL && entry->start_time == 0) {
+        entry->start_time = read_process_start_time(process->pid);
+    }
+    process->start_time = entry != NULL ? entry->start_time : 0;
+
+    return true;
+}
+
+// Fields of SystemMemoryInfo by meminfo key. Keys are compared by length
+// first, so most lines are rejected without touching their text.
+typedef struct {
+    const char* key;
+    size_t      length;
+    size_t      offset;
+} MeminfoField;
+
+#define MEMINFO_FIELD(key, field) \
+    {key, sizeof(key) - 1, offsetof(SystemMemoryInfo, field)}
+
+static const MeminfoField meminfo_fields[] = {
+    MEMINFO_FIELD("MemTotal", mem_total_kb),
+    MEMINFO_FIELD("MemFree", mem_free_kb),
+    MEMINFO_FIELD("MemAvailable", mem_available_kb),
+    MEMINFO_FIELD("Buffers", buffers_kb),
+    MEMINFO_FIELD("Cached", mem_cached_kb),
+    MEMINFO_FIELD("SwapTotal", swap_total_kb),
+    MEMINFO_FIELD("SwapFree", swap_free_kb),
+};
+
+#define MEMINFO_FIELD_COUNT \
+    (sizeof(meminfo_fields) / sizeof(meminfo_fields[0]))
+#define MEMINFO_ALL_FIELDS  ((1u << MEMINFO_FIELD_COUNT) - 1)
+
+bool parse_meminfo(const char* buf, SystemMemoryInfo* mem_info) {
+    if (buf == NULL || mem_info == NULL)
+        return false;
+
+    memset(mem_info, 0, sizeof(SystemMemoryInfo));
+
+    unsigned int found = 0;
+
+    // Every wanted key sits in the first twenty or so of ~55 lines, so the
+    // scan stops as soon as the last one is seen.
+    const char* line = buf;
+
+    while (*line != '\0' && found != MEMINFO_ALL_FIELDS) {
+        const char* colon = strchr(line, ':');
+        if (colon == NULL)
+            break;
+
+        size_t length = (size_t)(colon - line);
+
+        for (size_t i = 0; i < MEMINFO_FIELD_COUNT; i++) {
+            const MeminfoField* field = &meminfo_fields[i];
+
+            if ((found & (1u << i)) || field->length != length ||
+                memcmp(line, field->key, length) != 0)
+                continue;
+
+            const char* cursor = colon + 1;
+            while (*cursor == ' ') {
+                cursor++;
+            }
+
+            unsigned long long value;
+            if (parse_decimal(cursor, &value)) {
+                *(long*)((char*)mem_info + field->offset) = (long)value;
+                found |= 1u << i;
+            }
+            break;
+        }
+
+        const char* line_end = strchr(colon, '\n');
+        if (line_end == NULL)
+            break;
+        line = line_end + 1;
+    }
+
+    return found == MEMINFO_ALL_FIELDS;
+}
+
+// smaps_rollup keys that MemoryDetail is made of.
+enum {
+    SMAPS_PSS,
+    SMAPS_SHARED_CLEAN,
+    SMAPS_SHARED_DIRTY,
+    SMAPS_PRIVATE_CLEAN,
+    SMAPS_PRIVATE_DIRTY,
+    SMAPS_SWAP,
+    SMAPS_FIELD_COUNT
+};
+
+static const char* const smaps_keys[SMAPS_FIELD_COUNT] = {
+    [SMAPS_PSS]           = "Pss",
+    [SMAPS_SHARED_CLEAN]  = "Shared_Clean",
+    [SMAPS_SHARED_DIRTY]  = "Shared_Dirty",
+    [SMAPS_PRIVATE_CLEAN] = "Private_Clean",
+    [SMAPS_PRIVATE_DIRTY] = "Private_Dirty",
+    [SMAPS_SWAP]          = "Swap",
+};
+
+#define SMAPS_ALL_FIELDS ((1u << SMAPS_FIELD_COUNT) - 1)
+
+bool parse_smaps_rollup(const char* buf, MemoryDetail* memory) {
+    if (buf == NULL || memory == NULL)
+        return false;
+
+    memset(memory, 0, sizeof(MemoryDetail));
+
+    unsigned long long values[SMAPS_FIELD_COUNT] = {0};
+    unsigned int       found                     = 0;
+
+    // The first line names the range the rollup covers and has no colon
+    // right after its first word, so it matches no key.
+    for (const char* line = buf; *line != '\0' && found != SMAPS_ALL_FIELDS;) {
+        const char* colon    = strchr(line, ':');
+        const char* line_end = strchr(line, '\n');
+
+        if (colon != NULL && (line_end == NULL || colon < line_end)) {
+            size_t length = (size_t)(colon - line);
+
+            for (size_t i = 0; i < SMAPS_FIELD_COUNT; i++) {
+                if ((found & (1u << i)) || strlen(smaps_keys[i]) != length ||
+                    memcmp(line, smaps_keys[i], length) != 0)
+                    continue;
+
+                const char* cursor = colon + 1;
+                while (*cursor == ' ') {
+                    cursor++;
+                }
+
+                if (parse_decimal(cursor, &values[i])) {
+                    found |= 1u << i;
+                }
+                break;
+            }
+        }
+
+        if (line_end == NULL)
+            break;
+        line = line_end + 1;
+    }
+
+    if (found != SMAPS_ALL_FIELDS)
+        return false;
+
+    memory->pss_kb    = (unsigned long)values[SMAPS_PSS];
+    memory->uss_kb    = (unsigned long)(values[SMAPS_PRIVATE_CLEAN] +
+                                     values[SMAPS_PRIVATE_DIRTY]);
+    memory->swap_kb   = (unsigned long)values[SMAPS_SWAP];
+    memory->shared_kb = (unsigned long)(values[SMAPS_SHARED_CLEAN] +
+                                        values[SMAPS_SHARED_DIRTY]);
+    memory->known     = true;
+    return true;
+}
+
+// Reads a system-wide file of the proc root through *kept_fd, opening it on
+// first use, or opens and closes it when kept_fd is NULL. The kernel
+// regenerates these files on every read from offset 0, so one pread into a
+// buffer well above their size sees a fresh copy.
+static ssize_t read_kept_file(int* kept_fd, const char* name, char* buf,
+                              size_t size) {
+    int fd = kept_fd != NULL ? *kept_fd : -1;
+
+    if (fd < 0) {
+        char path[PROC_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", proc_root_path, name);
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        proc_syscalls++;
+        if (fd < 0)
+            return -1;
+
+        if (kept_fd != NULL) {
+            *kept_fd = fd;
+        }
+    }
+
+    ssize_t len = pread(fd, buf, size - 1, 0);
+    proc_syscalls++;
+
+    if (kept_fd == NULL) {
+        close(fd);
+        proc_syscalls++;
+    }
+
+    if (len <= 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
+}
+
+bool read_process_memory(int pid, MemoryDetail* memory, CollectStats* stats) {
+    if (memory == NULL || pid <= 0)
+        return false;
+
+    unsigned long syscalls_before = proc_syscalls;
+    char          name[PROC_PATH_MAX];
+    char          buf[PROC_READ_BUFFER_SIZE];
+
+    snprintf(name, sizeof(name), "%d/smaps_rollup", pid);
+
+    bool ok = read_kept_file(NULL, name, buf, sizeof(buf)) > 0 &&
+              parse_smaps_rollup(buf, memory);
+
+    if (!ok) {
+        memset(memory, 0, sizeof(MemoryDetail));
+    }
+    if (stats != NULL) {
+        stats->syscalls += proc_syscalls - syscalls_before;
+    }
+    return ok;
+}
+
+bool parse_process_cgroup(const char* buf, char* path, size_t size) {
+    if (buf == NULL || path == NULL || size == 0)
+        return false;
+
+    for (const char* line = buf; *line != '\0';) {
+        const char* line_end = strchr(line, '\n');
+        size_t      length   = line_end != NULL ? (size_t)(line_end - line)
+                                                : strlen(line);
+
+        if (length > 3 && memcmp(line, "0::", 3) == 0) {
+            if (length - 3 >= size)
+                return false;
+
+            memcpy(path, line + 3, length - 3);
+            path[length - 3] = '\0';
+            return true;
+        }
+
+        if (line_end == NULL)
+            break;
+        line = line_end + 1;
+    }
+
+    return false;
+}
+
+bool read_process_cgroup(int pid, char* path, size_t size,
+                         CollectStats* stats) {
+    if (path == NULL || pid <= 0)
+        return false;
+
+    unsigned long syscalls_before = proc_syscalls;
+    char          name[PROC_PATH_MAX];
+    char          buf[PROC_READ_BUFFER_SIZE];
+
+    snprintf(name, sizeof(name), "%d/cgroup", pid);
+
+    bool ok = read_kept_file(NULL, name, buf, sizeof(buf)) > 0 &&
+              parse_process_cgroup(buf, path, size);
+
+    if (stats != NULL) {
+        stats->syscalls += proc_syscalls - syscalls_before;
+    }
+    return ok;
+}
+
+bool read_system_memory_info(ProcCollector* collector,
+                             SystemMemoryInfo* mem_info) {
+    if (mem_info == NULL)
+        return false;
+
+    memset(mem_info, 0, sizeof(SystemMemoryInfo));
+
+    char buf[MEMINFO_BUFFER_SIZE];
+
+    if (read_kept_file(collector != NULL ? &collector->meminfo_fd : NULL,
+                       "meminfo", buf, sizeof(buf)) < 0)
+        return false;
+
+    // Kernels without MemAvailable (before 3.14) still report the rest.
+    parse_meminfo(buf, mem_info);
+    return true;
+}
+
+bool parse_cpu_times(const char* buf, SystemCpuTimes* times) {
+    if (buf == NULL || times == NULL)
+        return false;
+
+    memset(times, 0, sizeof(SystemCpuTimes));
+
+    if (strncmp(buf, "cpu ", 4) != 0)
+        return false;
+
+    // user nice system idle iowait irq softirq steal; guest time is already
+    // part of user.
+    unsigned long long columns[8] = {0};
+    const char*        cursor     = buf + 4;
+
+    for (int i = 0; i < 8; i++) {
+        while (*cursor == ' ') {
+            cursor++;
+        }
+        if (!parse_decimal(cursor, &columns[i]))
+            break;
+
+        while (*cursor >= '0' && *cursor <= '9') {
+            cursor++;
+        }
+    }
+
+    times->user   = columns[0] + columns[1];
+    times->system = columns[2] + columns[5] + columns[6];
+    times->idle   = columns[3] + columns[4];
+    times->total  = times->user + times->system + times->idle + columns[7];
+
+    for (const char* line = strchr(cursor, '\n'); line != NULL;
+         line             = strchr(line + 1, '\n')) {
+        if (strncmp(line + 1, "cpu", 3) != 0)
+            break;
+        times->cpu_count++;
+    }
+
+    return times->total > 0 && times->cpu_count > 0;
+}
+
+bool read_system_cpu_times(ProcCollector* collector, SystemCpuTimes* times) {
+    if (times == NULL)
+        return false;
+
+    memset(times, 0, sizeof(SystemCpuTimes));
+
+    char buf[PROC_STAT_BUFFER_SIZE];
+
+    if (read_kept_file(collector != NULL ? &collector->stat_fd : NULL, "stat",
+                       buf, sizeof(buf)) < 0)
+        return false;
+
+    return parse_cpu_times(buf, times);
+}
+
+void pid_list_destroy(PidList* list) {
+    if (list == NULL)
+        return;
+
+    free(list->pids);
+    memset(list, 0, sizeof(PidList));
+}
+
+bool pid_list_push(PidList* list, int pid) {
+    if (list->count >= list->capacity) {
+        size_t new_capacity =
+            list->capacity > 0 ? list->capacity * 2 : INITIAL_CAPACITY_SIZE;
+        int* grown = realloc(list->pids, new_capacity * sizeof(int));
+
+        if (grown == NULL)
+            return false;
+
+        list->pids     = grown;
+        list->capacity = new_capacity;
+    }
+
+    list->pids[list->count++] = pid;
+    return true;
+}
+
+bool pid_list_assign(PidList* list, const int* pids, size_t count) {
+    if (list == NULL)
+        return false;
+
+    list->count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!pid_list_push(list, pids[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// Refills list with the numeric entries of the directory at path.
+static bool read_pid_directory(const char* path, PidList* list) {
+    list->count = 0;
+
+    int proc_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    proc_syscalls++;
+
+    if (proc_fd < 0)
+        return false;
+
+    // One getdents64 call returns a few thousand entries, so even hosts with
+    // tens of thousands of PIDs are enumerated in a handful of syscalls.
+    _Alignas(LinuxDirent64) char dirents[PROC_DIRENT_BUFFER_SIZE];
+    long                         nread;
+    bool                         ok = true;
+
+    while (ok && (nread = syscall(SYS_getdents64, proc_fd, dirents,
+                                  sizeof(dirents))) > 0) {
+        proc_syscalls++;
+
+        for (long offset = 0; offset < nread;) {
+            const LinuxDirent64* entry =
+                (const LinuxDirent64*)(dirents + offset);
+            offset += entry->d_reclen;
+
+            int pid = parse_pid(entry->d_name);
+
+            if (pid > 0 && !pid_list_push(list, pid)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    // The last getdents64, which returned 0 or failed, and the close.
+    proc_syscalls += ok ? 2 : 1;
+    close(proc_fd);
+    return ok && nread == 0;
+}
+
+bool discover_pids(PidList* list) {
+    if (list == NULL)
+        return false;
+
+    return read_pid_directory(proc_root_path, list);
+}
+
+static unsigned long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long long)now.tv_sec * 1000000000ull +
+           (unsigned long long)now.tv_nsec;
+}
+
+bool collect_process_range(FdCache* cache, ProcParser parser, const int* pids,
+                           size_t count, ProcessTable* table,
+                           CollectStats* stats) {
+    if (table == NULL)
+        return false;
+
+    unsigned long syscalls_before = proc_syscalls;
+    bool          ok              = true;
+
+    process_table_clear(table);
+    fd_cache_begin_scan(cache);
+
+    for (size_t i = 0; i < count; i++) {
+        ProcessInfo process = {.pid = pids[i]};
+
+        // clock_gettime goes through the vDSO, so timing each read costs no
+        // syscall and stays small next to the read itself.
+        unsigned long long started = stats != NULL ? monotonic_ns() : 0;
+        bool               found   = read_process_info(cache, parser, &process);
+
+        if (stats != NULL) {
+            stats->read_ns += monotonic_ns() - started;
+        }
+
+        if (!found)
+            continue;
+
+        if (!process_table_append(table, &process)) {
+            ok = false;
+            break;
+        }
+    }
+
+    // A partial scan must not close descriptors of processes it never
+    // reached, so only a complete one sweeps.
+    if (ok) {
+        fd_cache_end_scan(cache);
+    }
+
+    if (stats != NULL) {
+        stats->syscalls += proc_syscalls - syscalls_before;
+    }
+
+    return ok;
+}
+
+bool collect_processes(ProcCollector* collector, ProcessTable* table) {
+    if (collector == NULL || table == NULL)
+        return false;
+
+    unsigned long syscalls_before = proc_syscalls;
+
+    memset(&collector->stats, 0, sizeof(CollectStats));
+
+    ProcEvents* events     = collector->events;
+    bool        discovered = events != NULL &&
+                             proc_events_pids(events, &collector->pids);
+
+    if (!discovered) {
+        discovered = discover_pids(&collector->pids);
+    }
+
+    collector->stats.syscalls += proc_syscalls - syscalls_before;
+    if (events != NULL) {
+        collector->stats.syscalls += events->recvs;
+    }
+
+    if (!discovered) {
+        process_table_clear(table);
+        return false;
+    }
+
+    bool collected;
+
+    if (collector->pool != NULL) {
+        collected = worker_pool_collect(collector->pool, collector->parser,
+                                        collector->pids.pids,
+                                        collector->pids.count, table,
+                                        &collector->stats);
+    } else {
+        collected = collect_process_range(collector->cache, collector->parser,
+                                          collector->pids.pids,
+                                          collector->pids.count, table,
+                                          &collector->stats);
+    }
+
+    // The processes that could be read are the set the next refresh reads;
+    // the others exited and were reaped. A failed keep leaves the set
+    // unsynced, so the next refresh lists /proc again.
+    if (collected && events != NULL) {
+        proc_events_keep(events, table);
+    }
+
+    return collected;
+}
+
+// read_process_info for one task of tgid. Without the fd cache the status
+// fallback could not supply a start time, which identifies the thread, so
+// stat is read whichever parser the processes use.
+static bool read_thread_info(int tgid, ProcessInfo* thread) {
+    char name[PROC_PATH_MAX];
+    char buf[PROC_READ_BUFFER_SIZE];
+
+    snprintf(name, sizeof(name), "%d/task/%d/stat", tgid, thread->pid);
+    if (read_kept_file(NULL, name, buf, sizeof(buf)) > 0 &&
+        parse_process_stat(buf, thread))
+        return true;
+
+    snprintf(name, sizeof(name), "%d/task/%d/status", tgid, thread->pid);
+    if (read_kept_file(NULL, name, buf, sizeof(buf)) < 0)
+        return false;
+
+    parse_process_status(buf, thread);
+    return true;
+}
+
+bool collect_threads(ProcCollector* collector, const int* pids, size_t count,
+                     ProcessTable* table) {
+    if (collector == NULL || table == NULL)
+        return false;
+
+    unsigned long syscalls_before = proc_syscalls;
+    bool          ok              = true;
+
+    for (size_t i = 0; ok && i < count; i++) {
+        char path[PROC_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%d/task", proc_root_path, pids[i]);
+
+        // A process that exited since discovery has no task directory left.
+        if (!read_pid_directory(path, &collector->tids))
+            continue;
+
+        for (size_t t = 0; t < collector->tids.count; t++) {
+            ProcessInfo thread = {.pid  = collector->tids.pids[t],
+                                  .tgid = pids[i]};
+
+            unsigned long long started = monotonic_ns();
+            bool               found   = read_thread_info(pids[i], &thread);
+            collector->stats.read_ns += monotonic_ns() - started;
+
+            if (found && !process_table_append(table, &thread)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    collector->stats.syscalls += proc_syscalls - syscalls_before;
+    return ok;
+}
@@ -0,0 +1,237 @@
+#ifndef LTOP_PROC_H
+#define LTOP_PROC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define PROC_ROOT_DEFAULT     "/proc"
+#define PROC_ROOT_MAX         256
+#define PROC_PATH_MAX         (PROC_ROOT_MAX + 64)
+#define PROC_NAME_MAX         128
+#define LINE_BUFFER_SIZE      256
+#define INITIAL_CAPACITY_SIZE 128
+#define PROC_READ_BUFFER_SIZE 4096
+#define MEMINFO_BUFFER_SIZE   8192
+// Enough of /proc/stat for the cpu lines of a few hundred CPUs.
+#define PROC_STAT_BUFFER_SIZE (16 * 1024)
+#define FD_CACHE_RESERVED_FDS 64
+
+// What /proc/PID/smaps_rollup adds to RSS: pages mapped by several
+// processes are split among them in PSS and left out of USS. Producing it
+// walks every mapping of the process, so it costs far more than stat and
+// is only read for a few processes at a time (see sampler_watch_memory).
+typedef struct {
+    unsigned long pss_kb;
+    unsigned long uss_kb;    // private pages, freed when the process exits
+    unsigned long swap_kb;
+    unsigned long shared_kb; // resident pages other processes map too
+    bool          known;     // false until read, and for kernel threads
+} MemoryDetail;
+
+typedef struct {
+    int                pid;  // the thread id for a thread
+    int                tgid; // owning process of a thread, 0 for a process
+    int                ppid; // parent process, 0 for the roots
+    char               name[PROC_NAME_MAX];
+    char               state;
+    unsigned long      vm_rss_kb;
+    unsigned long long start_time; // clock ticks after boot, 0 if unknown
+    unsigned long long cpu_ticks;  // utime + stime, 0 if unknown
+    unsigned int       cpu_tenths; // %CPU of one CPU x 10, set by the model
+    MemoryDetail       memory;     // kept by the model, unread by scans
+    uint32_t           cgroup;     // the same, see CgroupSet; 0 if unknown
+} ProcessInfo;
+
+typedef struct {
+    long mem_total_kb;
+    long mem_free_kb;
+    long mem_available_kb;
+    long mem_cached_kb;
+    long swap_total_kb;
+    long swap_free_kb;
+    long buffers_kb;
+} SystemMemoryInfo;
+
+// Aggregate cpu line of /proc/stat, in clock ticks.
+typedef struct {
+    unsigned long long user;   // user and nice
+    unsigned long long system; // system, irq and softirq
+    unsigned long long idle;   // idle and iowait
+    unsigned long long total;  // every column, steal included
+    unsigned int       cpu_count;
+} SystemCpuTimes;
+
+// part as a percentage of all the ticks in delta, 0 if there are none.
+static inline double cpu_times_percent(const SystemCpuTimes* delta,
+                                       unsigned long long    part) {
+    return delta->total > 0 ? 100.0 * (double)part / (double)delta->total : 0;
+}
+
+// Column-oriented process table filled by collect_processes; see table.h.
+typedef struct ProcessTable ProcessTable;
+
+// Fixed set of collection threads; see pool.h.
+typedef struct WorkerPool WorkerPool;
+
+// Process set kept by kernel fork and exit events; see events.h.
+typedef struct ProcEvents ProcEvents;
+
+// Grow-only PID buffer refilled by discover_pids.
+typedef struct {
+    int*   pids;
+    size_t count;
+    size_t capacity;
+} PidList;
+
+// Per-process files read during collection.
+typedef enum {
+    PROC_FILE_STAT,
+    PROC_FILE_STATUS,
+    PROC_FILE_COUNT
+} ProcFile;
+
+// How read_process_info extracts name, state and RSS. The stat parser is the
+// fast path; status is the verbose fallback.
+typedef enum {
+    PROC_PARSER_STAT,
+    PROC_PARSER_STATUS
+} ProcParser;
+
+// Cached descriptors of one process. A descriptor stays bound to the process
+// it was opened for: once that process exits, reads fail with ESRCH even if
+// the PID has been reused, so a recycled PID is never read through a stale
+// fd.
+typedef struct {
+    int                pid; // 0 marks an empty slot
+    int                fds[PROC_FILE_COUNT]; // -1 until first opened
+    unsigned long long start_time;
+    unsigned int       generation; // last scan that saw this process
+} FdCacheEntry;
+
+// Open-addressed (linear probing) table of per-PID descriptors, kept across
+// refreshes so each live process costs a single pread per file and cycle.
+typedef struct {
+    FdCacheEntry* entries;
+    size_t        capacity; // power of two
+    size_t        count;
+    size_t        open_fds;
+    size_t        fd_budget; // max descriptors held open, from RLIMIT_NOFILE
+    unsigned int  generation;
+} FdCache;
+
+// Cost of one collection, summed over the threads that took part.
+typedef struct {
+    unsigned long long read_ns;  // spent in read_process_info
+    unsigned long      syscalls; // open, pread, close and getdents64 on /proc,
+                                 // recv on the proc connector
+} CollectStats;
+
+// Long-lived collection state threaded through every refresh, set up by
+// proc_collector_init.
+typedef struct {
+    ProcParser   parser;
+    FdCache*     cache; // NULL opens and closes every file on each read
+    WorkerPool*  pool;  // NULL reads every process on the calling thread
+    ProcEvents*  events; // NULL lists /proc on every refresh
+    PidList      pids;  // PIDs found by the last discovery pass
+    PidList      tids;  // scratch for collect_threads
+    CollectStats stats; // of the last collect_processes
+    int          meminfo_fd; // kept open across reads, -1 until first read
+    int          stat_fd;    // the same for /proc/stat
+} ProcCollector;
+
+// Makes every reader below use root in place of /proc, for instance a
+// synthetic tree built by bench/gen_proc_tree. Must be called before any
+// collection starts. Returns false if root does not fit PROC_ROOT_MAX.
+bool proc_set_root(const char* root);
+
+void proc_collector_init(ProcCollector* collector, ProcParser parser);
+
+// Also destroys the collector's pool, fd cache and events.
+void proc_collector_destroy(ProcCollector* collector);
+
+// shares splits the RLIMIT_NOFILE budget between caches used side by side,
+// one per collection thread.
+bool fd_cache_init(FdCache* cache, unsigned int shares);
+void fd_cache_destroy(FdCache* cache);
+
+// Brackets one scan. Ending it closes the descriptors of processes that were
+// not read since the scan began.
+void fd_cache_begin_scan(FdCache* cache);
+void fd_cache_end_scan(FdCache* cache);
+
+// Parsers over the NUL-terminated contents of /proc/PID/stat and
+// /proc/PID/status. Neither modifies its input.
+bool parse_process_stat(const char* buf, ProcessInfo* process);
+bool parse_process_status(const char* buf, ProcessInfo* process);
+
+// Parser over the NUL-terminated contents of /proc/meminfo. Returns false
+// unless every field of mem_info was found; missing ones are left at 0.
+bool parse_meminfo(const char* buf, SystemMemoryInfo* mem_info);
+
+// Parser over the NUL-terminated contents of /proc/PID/smaps_rollup. Returns
+// false, leaving memory unknown, unless every field was found; the rollup of
+// a kernel thread is empty.
+bool parse_smaps_rollup(const char* buf, MemoryDetail* memory);
+
+// Copies the cgroup v2 path out of the NUL-terminated contents of
+// /proc/PID/cgroup (its "0::" line). Returns false if there is none, as on
+// hosts that only mount cgroup v1, or it does not fit size.
+bool parse_process_cgroup(const char* buf, char* path, size_t size);
+
+// Parser over the start of /proc/stat: the aggregate cpu line and the
+// per-CPU lines after it, which are only counted.
+bool parse_cpu_times(const char* buf, SystemCpuTimes* times);
+
+bool read_process_info(FdCache* cache, ProcParser parser,
+                       ProcessInfo* process);
+
+// Reads meminfo through the collector's descriptor, opening it on first use.
+// A NULL collector opens and closes the file on each call.
+bool read_system_memory_info(ProcCollector* collector,
+                             SystemMemoryInfo* mem_info);
+
+// Reads /proc/stat the same way, once per refresh.
+bool read_system_cpu_times(ProcCollector* collector, SystemCpuTimes* times);
+
+// Reads /proc/PID/smaps_rollup, opening and closing it, and adds the
+// syscalls to stats unless it is NULL.
+bool read_process_memory(int pid, MemoryDetail* memory, CollectStats* stats);
+
+// Reads the cgroup v2 path of pid the same way.
+bool read_process_cgroup(int pid, char* path, size_t size,
+                         CollectStats* stats);
+
+void pid_list_destroy(PidList* list);
+bool pid_list_push(PidList* list, int pid);
+bool pid_list_assign(PidList* list, const int* pids, size_t count);
+
+// Refills list with the numeric entries of the proc root, in directory order.
+bool discover_pids(PidList* list);
+
+// Refills table with the readable processes among pids, in the given order,
+// and adds the cost to stats unless it is NULL. Returns false if the table
+// could not grow; it then holds the processes gathered so far.
+bool collect_process_range(FdCache* cache, ProcParser parser, const int* pids,
+                           size_t count, ProcessTable* table,
+                           CollectStats* stats);
+
+// Discovers PIDs and refills table with every readable process, on the
+// collector's worker pool if it has one. With events the PIDs come from
+// their set, which is then replaced with the processes read, and /proc is
+// only listed when the set has to be rebuilt. Returns false if /proc could
+// not be read or the table could not grow.
+bool collect_processes(ProcCollector* collector, ProcessTable* table);
+
+// Appends a row for every task in /proc/PID/task of each of pids, main
+// thread included, with tgid set to the owning PID. Threads are read on the
+// calling thread without the fd cache: only a handful of processes is
+// expected, and their threads come and go too often to keep files open.
+// Processes that exited are skipped; their cost is added to the collector's
+// stats. Returns false if the table could not grow.
+bool collect_threads(ProcCollector* collector, const int* pids, size_t count,
+                     ProcessTable* table);
+
+#endif
@@ -0,0 +1,81 @@
+#include "profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SECOND 1000000000ull
+
+static int compare_durations(const void* a, const void* b) {
+    unsigned long long left  = *(const unsigned long long*)a;
+    unsigned long long right = *(const unsigned long long*)b;
+
+    return (left > right) - (left < right);
+}
+
+unsigned long long profile_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long long)now.tv_sec * NS_PER_SECOND +
+           (unsigned long long)now.tv_nsec;
+}
+
+void profile_record(Profiler* profiler, ProfileStage stage,
+                    unsigned long long ns) {
+    if (profiler == NULL || stage >= PROFILE_STAGE_COUNT)
+        return;
+
+    StageTimes* times = &profiler->stages[stage];
+
+    if (times->count == PROFILE_WINDOW) {
+        times->total -= times->samples[times->next];
+    } else {
+        times->count++;
+    }
+
+    times->samples[times->next] = ns;
+    times->total += ns;
+    times->next = (times->next + 1) % PROFILE_WINDOW;
+}
+
+void profile_summarize(const Profiler* profiler, ProfileStage stage,
+                       StageSummary* summary) {
+    if (summary == NULL)
+        return;
+
+    memset(summary, 0, sizeof(StageSummary));
+
+    if (profiler == NULL || stage >= PROFILE_STAGE_COUNT)
+        return;
+
+    const StageTimes* times = &profiler->stages[stage];
+    if (times->count == 0)
+        return;
+
+    // Sorting a copy of at most PROFILE_WINDOW samples is cheap next to one
+    // /proc scan, and only happens when the numbers are shown.
+    unsigned long long sorted[PROFILE_WINDOW];
+    memcpy(sorted, times->samples, times->count * sizeof(sorted[0]));
+    qsort(sorted, times->count, sizeof(sorted[0]), compare_durations);
+
+    size_t rank = (times->count * 99 + 99) / 100; // ceil(0.99 * count)
+
+    summary->last_ns =
+        times->samples[(times->next + PROFILE_WINDOW - 1) % PROFILE_WINDOW];
+    summary->avg_ns = times->total / times->count;
+    summary->p99_ns = sorted[rank - 1];
+}
+
+const char* profile_stage_name(ProfileStage stage) {
+    static const char* const names[PROFILE_STAGE_COUNT] = {
+        [PROFILE_COLLECT] = "collect",
+        [PROFILE_READ]    = "read",
+        [PROFILE_MEMINFO] = "meminfo",
+        [PROFILE_SMAPS]   = "smaps",
+        [PROFILE_CGROUP]  = "cgroup",
+        [PROFILE_RENDER]  = "render",
+    };
+
+    return stage < PROFILE_STAGE_COUNT ? names[stage] : "?";
+}
@@ -0,0 +1,52 @@
+#ifndef LTOP_PROFILE_H
+#define LTOP_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Samples kept per stage for the average and the 99th percentile.
+#define PROFILE_WINDOW 256
+
+typedef enum {
+    PROFILE_COLLECT, // collect_processes as a whole
+    PROFILE_READ,    // read_process_info, summed over processes and threads
+    PROFILE_MEMINFO, // read_system_memory_info
+    PROFILE_SMAPS,   // smaps_rollup of the processes watched for memory
+    PROFILE_CGROUP,  // process cgroups and group memory accounting
+    PROFILE_RENDER,  // drawing or formatting one snapshot
+    PROFILE_STAGE_COUNT
+} ProfileStage;
+
+typedef struct {
+    unsigned long long samples[PROFILE_WINDOW]; // ring of durations in ns
+    size_t             count;
+    size_t             next;
+    unsigned long long total; // of the samples in the window
+} StageTimes;
+
+typedef struct {
+    unsigned long long last_ns;
+    unsigned long long avg_ns;
+    unsigned long long p99_ns;
+} StageSummary;
+
+// ltop's own cost, fed after every sample and every frame.
+typedef struct {
+    StageTimes    stages[PROFILE_STAGE_COUNT];
+    unsigned long syscalls;  // /proc syscalls of the last collection
+    size_t        processes; // processes in the last collection
+} Profiler;
+
+// CLOCK_MONOTONIC in nanoseconds.
+unsigned long long profile_now_ns(void);
+
+void profile_record(Profiler* profiler, ProfileStage stage,
+                    unsigned long long ns);
+
+// Zeroes summary while the stage has no samples.
+void profile_summarize(const Profiler* profiler, ProfileStage stage,
+                       StageSummary* summary);
+
+const char* profile_stage_name(ProfileStage stage);
+
+#endif
@@ -0,0 +1,1013 @@
+#include "record.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define RECORD_MAGIC       "LTOPREC3"
+#define RECORD_MAGIC_SIZE  8
+#define RECORD_VARINT_MAX  10 // bytes in a 64-bit LEB128 varint
+// A names frame and a delta frame, each a prefix and its sections.
+#define RECORD_PARTS_MAX   10
+// Ids are model slots, so they stay below the peak process count. Larger
+// ones in a log mean it is corrupt.
+#define RECORD_MAX_ID      (1u << 22)
+#define RECORD_NO_NAME     UINT32_MAX
+#define MS_PER_SECOND      1000
+#define NS_PER_MS          1000000L
+
+#define RECORD_CHANGED_STATE  0x1u
+#define RECORD_CHANGED_RSS    0x2u
+#define RECORD_CHANGED_NAME   0x4u
+#define RECORD_CHANGED_CPU    0x8u
+#define RECORD_CHANGED_PARENT 0x10u
+
+typedef enum {
+    RECORD_FRAME_NAMES = 1,
+    RECORD_FRAME_KEY   = 2,
+    RECORD_FRAME_DELTA = 3
+} RecordFrameType;
+
+// Last recorded or replayed state of the process behind one id.
+typedef struct {
+    int                pid; // 0 when no process holds the id
+    int                ppid;
+    unsigned long long start_time;
+    unsigned long      rss_kb;
+    unsigned int       cpu_tenths;
+    uint32_t           name_id;
+    char               state;
+} RecordSlot;
+
+typedef struct {
+    uint8_t* data;
+    size_t   size;
+    size_t   capacity;
+} ByteBuffer;
+
+// Read cursor over one frame payload. Any read past the end clears ok.
+typedef struct {
+    const uint8_t* pos;
+    const uint8_t* end;
+    bool           ok;
+} ByteReader;
+
+struct RecordWriter {
+    int          fd;
+    bool         failed; // the recording ended, see record_write_frame
+    size_t       frames;
+    long long    time_ms;
+    SystemMemoryInfo mem_info;
+
+    // Sections of the frame being written, assembled once counts are known.
+    ByteBuffer header;
+    ByteBuffer exited;
+    ByteBuffer added;
+    ByteBuffer changed;
+    ByteBuffer names; // pending names frame payload
+    size_t     exited_count;
+    size_t     added_count;
+    size_t     changed_count;
+    size_t     pending_names;
+
+    RecordSlot*   slots;
+    unsigned int* seen; // stamp of the last frame that held each id
+    size_t        slot_capacity;
+    unsigned int  stamp;
+    uint32_t*     live_ids; // ids in the previous frame
+    uint32_t*     next_ids;
+    size_t        live_count;
+    size_t        live_capacity;
+
+    // Interned names: text in an arena, found through an open-addressed
+    // hash of name ids.
+    NameArena name_text;
+    uint32_t* name_offsets;
+    size_t    name_count;
+    size_t    name_capacity;
+    uint32_t* name_index;
+    size_t    name_index_capacity; // power of two
+};
+
+typedef struct {
+    size_t  offset; // of the payload
+    size_t  length;
+    uint8_t type;
+} ReplayFrame;
+
+typedef struct {
+    const char* text; // inside the mapping, not NUL-terminated
+    size_t      length;
+} ReplayName;
+
+struct Replay {
+    const uint8_t* map;
+    size_t         map_size;
+
+    ReplayFrame* frames;
+    size_t       frame_count;
+    size_t*      keyframes; // frame numbers of keyframes, ascending
+    size_t       keyframe_count;
+    ReplayName*  names;
+    size_t       name_count;
+
+    RecordSlot*      slots;
+    size_t           slot_capacity;
+    size_t           current; // decoded frame, frame_count if none
+    long long        time_ms;
+    SystemMemoryInfo mem_info;
+    SystemCpuTimes   cpu_delta;
+    size_t           new_count;
+    size_t           exited_count;
+    Snapshot         snapshot;
+};
+
+static const size_t memory_fields[] = {
+    offsetof(SystemMemoryInfo, mem_total_kb),
+    offsetof(SystemMemoryInfo, mem_free_kb),
+    offsetof(SystemMemoryInfo, mem_available_kb),
+    offsetof(SystemMemoryInfo, mem_cached_kb),
+    offsetof(SystemMemoryInfo, swap_total_kb),
+    offsetof(SystemMemoryInfo, swap_free_kb),
+    offsetof(SystemMemoryInfo, buffers_kb),
+};
+
+#define MEMORY_FIELD_COUNT (sizeof(memory_fields) / sizeof(memory_fields[0]))
+
+static const size_t cpu_fields[] = {
+    offsetof(SystemCpuTimes, user),
+    offsetof(SystemCpuTimes, system),
+    offsetof(SystemCpuTimes, idle),
+    offsetof(SystemCpuTimes, total),
+};
+
+#define CPU_FIELD_COUNT (sizeof(cpu_fields) / sizeof(cpu_fields[0]))
+
+static unsigned long long* cpu_field(SystemCpuTimes* times, size_t field) {
+    return (unsigned long long*)((char*)times + cpu_fields[field]);
+}
+
+static long* memory_field(SystemMemoryInfo* mem_info, size_t field) {
+    return (long*)((char*)mem_info + memory_fields[field]);
+}
+
+static bool grow_array(void** array, size_t element_size, size_t* capacity,
+                       size_t size) {
+    if (size <= *capacity)
+        return true;
+
+    size_t new_capacity = *capacity > 0 ? *capacity : INITIAL_CAPACITY_SIZE;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    void* grown = realloc(*array, new_capacity * element_size);
+    if (grown == NULL)
+        return false;
+
+    *array    = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Grows slots (and seen, if given) to hold id, zeroing the new entries.
+static bool reserve_slots(RecordSlot** slots, unsigned int** seen,
+                          size_t* capacity, size_t id) {
+    size_t old_capacity  = *capacity;
+    size_t new_capacity  = old_capacity;
+    size_t seen_capacity = old_capacity;
+
+    if (!grow_array((void**)slots, sizeof(RecordSlot), &new_capacity, id + 1))
+        return false;
+    if (seen != NULL &&
+        !grow_array((void**)seen, sizeof(unsigned int), &seen_capacity,
+                    new_capacity))
+        return false;
+
+    memset(*slots + old_capacity, 0,
+           (new_capacity - old_capacity) * sizeof(RecordSlot));
+    if (seen != NULL) {
+        memset(*seen + old_capacity, 0,
+               (new_capacity - old_capacity) * sizeof(unsigned int));
+    }
+
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool put_bytes(ByteBuffer* buffer, const void* data, size_t len) {
+    if (!grow_array((void**)&buffer->data, 1, &buffer->capacity,
+                    buffer->size + len))
+        return false;
+
+    memcpy(buffer->data + buffer->size, data, len);
+    buffer->size += len;
+    return true;
+}
+
+static size_t encode_varint(uint8_t* bytes, uint64_t value) {
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        bytes[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[len++] = (uint8_t)value;
+
+    return len;
+}
+
+static bool put_varint(ByteBuffer* buffer, uint64_t value) {
+    uint8_t bytes[RECORD_VARINT_MAX];
+    return put_bytes(buffer, bytes, encode_varint(bytes, value));
+}
+
+// A section holding just value, encoded into bytes.
+static ByteBuffer varint_section(uint8_t* bytes, uint64_t value) {
+    return (ByteBuffer){.data     = bytes,
+                        .size     = encode_varint(bytes, value),
+                        .capacity = RECORD_VARINT_MAX};
+}
+
+static bool put_signed(ByteBuffer* buffer, long long value) {
+    // Zigzag: small magnitudes of either sign stay short.
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    return put_varint(buffer, zigzag);
+}
+
+static uint64_t get_varint(ByteReader* reader) {
+    uint64_t value = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->end)
+            break;
+
+        uint8_t byte = *reader->pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+
+    reader->ok = false;
+    return 0;
+}
+
+static long long get_signed(ByteReader* reader) {
+    uint64_t zigzag = get_varint(reader);
+    return (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+}
+
+static uint8_t get_byte(ByteReader* reader) {
+    if (reader->pos >= reader->end) {
+        reader->ok = false;
+        return 0;
+    }
+
+    return *reader->pos++;
+}
+
+static void free_buffer(ByteBuffer* buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(ByteBuffer));
+}
+
+static long long timespec_ms(const struct timespec* time) {
+    return (long long)time->tv_sec * MS_PER_SECOND + time->tv_nsec / NS_PER_MS;
+}
+
+static uint64_t hash_name(const char* name) {
+    // FNV-1a.
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static const char* interned_name(const RecordWriter* writer, uint32_t id) {
+    return writer->name_text.data + writer->name_offsets[id];
+}
+
+static bool rebuild_name_index(RecordWriter* writer, size_t capacity) {
+    uint32_t* index = malloc(capacity * sizeof(uint32_t));
+    if (index == NULL)
+        return false;
+
+    // Every byte 0xff makes every cell RECORD_NO_NAME.
+    memset(index, 0xff, capacity * sizeof(uint32_t));
+
+    for (uint32_t id = 0; id < writer->name_count; id++) {
+        size_t i = (size_t)hash_name(interned_name(writer, id)) & (capacity - 1);
+
+        while (index[i] != RECORD_NO_NAME) {
+            i = (i + 1) & (capacity - 1);
+        }
+        index[i] = id;
+    }
+
+    free(writer->name_index);
+    writer->name_index          = index;
+    writer->name_index_capacity = capacity;
+    return true;
+}
+
+// Returns the id of name, adding it to the pending names frame the first
+// time it is seen, or RECORD_NO_NAME if it could not be stored.
+static uint32_t intern_name(RecordWriter* writer, const char* name) {
+    if ((writer->name_count + 1) * 2 > writer->name_index_capacity) {
+        size_t capacity = writer->name_index_capacity > 0
+                              ? writer->name_index_capacity * 2
+                              : INITIAL_CAPACITY_SIZE;
+        if (!rebuild_name_index(writer, capacity))
+            return RECORD_NO_NAME;
+    }
+
+    size_t mask = writer->name_index_capacity - 1;
+    size_t i    = (size_t)hash_name(name) & mask;
+
+    for (; writer->name_index[i] != RECORD_NO_NAME; i = (i + 1) & mask) {
+        if (strcmp(interned_name(writer, writer->name_index[i]), name) == 0)
+            return writer->name_index[i];
+    }
+
+    uint32_t id  = (uint32_t)writer->name_count;
+    size_t   len = strlen(name);
+
+    if (!grow_array((void**)&writer->name_offsets, sizeof(uint32_t),
+                    &writer->name_capacity, writer->name_count + 1) ||
+        !name_arena_append(&writer->name_text, name,
+                           &writer->name_offsets[id]) ||
+        !put_varint(&writer->names, len) ||
+        !put_bytes(&writer->names, name, len))
+        return RECORD_NO_NAME;
+
+    writer->name_index[i] = id;
+    writer->name_count++;
+    writer->pending_names++;
+    return id;
+}
+
+static bool put_process(ByteBuffer* buffer, uint32_t id,
+                        const RecordSlot* slot) {
+    return put_varint(buffer, id) && put_varint(buffer, (uint64_t)slot->pid) &&
+           put_varint(buffer, slot->start_time) &&
+           put_varint(buffer, (uint64_t)slot->ppid) &&
+           put_bytes(buffer, &slot->state, 1) &&
+           put_varint(buffer, slot->rss_kb) &&
+           put_varint(buffer, slot->cpu_tenths) &&
+           put_varint(buffer, slot->name_id);
+}
+
+// Encodes one row against the previous state of its id.
+static bool record_row(RecordWriter* writer, const ProcessTable* table,
+                       size_t row, bool keyframe) {
+    uint32_t id = table->ids[row];
+
+    if (id >= RECORD_MAX_ID ||
+        !reserve_slots(&writer->slots, &writer->seen, &writer->slot_capacity,
+                       id))
+        return false;
+
+    uint32_t name_id = intern_name(writer, process_table_name(table, row));
+    if (name_id == RECORD_NO_NAME)
+        return false;
+
+    RecordSlot* slot = &writer->slots[id];
+    RecordSlot  next = {.pid        = table->pids[row],
+                        .ppid       = table->ppids[row],
+                        .start_time = table->start_times[row],
+                        .rss_kb     = table->rss_kb[row],
+                        .cpu_tenths = table->cpu_tenths[row],
+                        .name_id    = name_id,
+                        .state      = table->states[row]};
+    bool        same = slot->pid == next.pid &&
+                slot->start_time == next.start_time;
+
+    writer->seen[id]                          = writer->stamp;
+    writer->next_ids[writer->live_count++] = id;
+
+    if (keyframe || !same) {
+        // An id handed to a new process reports its old one as exited.
+        if (!keyframe && slot->pid != 0) {
+            if (!put_varint(&writer->exited, id))
+                return false;
+            writer->exited_count++;
+        }
+
+        *slot = next;
+        writer->added_count++;
+        return put_process(&writer->added, id, slot);
+    }
+
+    unsigned int mask = 0;
+    mask |= slot->state != next.state ? RECORD_CHANGED_STATE : 0;
+    mask |= slot->rss_kb != next.rss_kb ? RECORD_CHANGED_RSS : 0;
+    mask |= slot->name_id != next.name_id ? RECORD_CHANGED_NAME : 0;
+    mask |= slot->cpu_tenths != next.cpu_tenths ? RECORD_CHANGED_CPU : 0;
+    mask |= slot->ppid != next.ppid ? RECORD_CHANGED_PARENT : 0;
+
+    if (mask == 0)
+        return true;
+
+    uint8_t mask_byte = (uint8_t)mask;
+    bool    ok = put_varint(&writer->changed, id) &&
+              put_bytes(&writer->changed, &mask_byte, 1);
+
+    if (mask & RECORD_CHANGED_STATE) {
+        ok = ok && put_bytes(&writer->changed, &next.state, 1);
+    }
+    if (mask & RECORD_CHANGED_RSS) {
+        ok = ok && put_signed(&writer->changed,
+                              (long long)next.rss_kb - (long long)slot->rss_kb);
+    }
+    if (mask & RECORD_CHANGED_NAME) {
+        ok = ok && put_varint(&writer->changed, next.name_id);
+    }
+    if (mask & RECORD_CHANGED_CPU) {
+        ok = ok && put_signed(&writer->changed,
+                              (long long)next.cpu_tenths -
+                                  (long long)slot->cpu_tenths);
+    }
+    if (mask & RECORD_CHANGED_PARENT) {
+        ok = ok && put_varint(&writer->changed, (uint64_t)next.ppid);
+    }
+
+    *slot = next;
+    writer->changed_count++;
+    return ok;
+}
+
+// Points parts at one frame: prefix, filled in with its type and length,
+// then sections. Returns how many parts it took.
+static size_t frame_parts(struct iovec* parts, uint8_t* prefix,
+                          RecordFrameType type,
+                          const ByteBuffer* const* sections,
+                          size_t section_count) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < section_count; i++) {
+        length += sections[i]->size;
+    }
+
+    prefix[0] = (uint8_t)type;
+    parts[0]  = (struct iovec){.iov_base = prefix,
+                               .iov_len  = 1 + encode_varint(prefix + 1,
+                                                             length)};
+
+    for (size_t i = 0; i < section_count; i++) {
+        parts[i + 1] = (struct iovec){.iov_base = sections[i]->data,
+                                      .iov_len  = sections[i]->size};
+    }
+
+    return section_count + 1;
+}
+
+// Writes parts with one writev(2), and more only if it comes up short.
+static bool write_parts(int fd, struct iovec* parts, size_t count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, (int)count);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written < 0)
+            return false;
+
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            count--;
+        }
+
+        if (count > 0) {
+            parts->iov_base = (uint8_t*)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
+    }
+
+    return true;
+}
+
+RecordWriter* record_writer_create(const char* path) {
+    if (path == NULL)
+        return NULL;
+
+    RecordWriter* writer = calloc(1, sizeof(RecordWriter));
+    if (writer == NULL)
+        return NULL;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(writer);
+        return NULL;
+    }
+
+    struct iovec magic = {.iov_base = RECORD_MAGIC,
+                          .iov_len  = RECORD_MAGIC_SIZE};
+
+    if (!write_parts(fd, &magic, 1)) {
+        close(fd);
+        free(writer);
+        return NULL;
+    }
+
+    writer->fd = fd;
+    return writer;
+}
+
+void record_writer_destroy(RecordWriter* writer) {
+    if (writer == NULL)
+        return;
+
+    close(writer->fd);
+
+    free_buffer(&writer->header);
+    free_buffer(&writer->exited);
+    free_buffer(&writer->added);
+    free_buffer(&writer->changed);
+    free_buffer(&writer->names);
+    free(writer->slots);
+    free(writer->seen);
+    free(writer->live_ids);
+    free(writer->next_ids);
+    name_arena_destroy(&writer->name_text);
+    free(writer->name_offsets);
+    free(writer->name_index);
+    free(writer);
+}
+
+bool record_write_frame(RecordWriter* writer, const ProcessTable* table,
+                        const SystemMemoryInfo* mem_info,
+                        const SystemCpuTimes*   cpu_delta,
+                        const struct timespec*  wall_time) {
+    if (writer == NULL || table == NULL || mem_info == NULL ||
+        cpu_delta == NULL || wall_time == NULL || writer->failed)
+        return false;
+
+    size_t live_capacity = writer->live_capacity;
+    if (!grow_array((void**)&writer->live_ids, sizeof(uint32_t),
+                    &live_capacity, table->count) ||
+        !grow_array((void**)&writer->next_ids, sizeof(uint32_t),
+                    &writer->live_capacity, table->count))
+        return false;
+
+    bool      keyframe = writer->frames % RECORD_KEYFRAME_INTERVAL == 0;
+    long long time_ms  = timespec_ms(wall_time);
+
+    writer->header.size    = 0;
+    writer->exited.size    = 0;
+    writer->added.size     = 0;
+    writer->changed.size   = 0;
+    writer->names.size     = 0;
+    writer->exited_count   = 0;
+    writer->added_count    = 0;
+    writer->changed_count  = 0;
+    writer->pending_names  = 0;
+
+    if (++writer->stamp == 0) {
+        memset(writer->seen, 0, writer->slot_capacity * sizeof(unsigned int));
+        writer->stamp = 1;
+    }
+
+    size_t previous_count = writer->live_count;
+    writer->live_count    = 0;
+
+    // A frame that fails halfway leaves the writer out of step with the
+    // log, so any failure below ends the recording.
+    bool ok = true;
+
+    for (size_t row = 0; row < table->count && ok; row++) {
+        ok = record_row(writer, table, row, keyframe);
+    }
+
+    // Ids of the previous frame that this one did not claim have exited.
+    for (size_t i = 0; i < previous_count && ok; i++) {
+        uint32_t id = writer->live_ids[i];
+
+        if (writer->seen[id] == writer->stamp)
+            continue;
+
+        if (!keyframe) {
+            ok = put_varint(&writer->exited, id);
+            writer->exited_count++;
+        }
+        writer->slots[id].pid = 0;
+    }
+
+    uint32_t* swap   = writer->live_ids;
+    writer->live_ids = writer->next_ids;
+    writer->next_ids = swap;
+
+    ok = ok && put_signed(&writer->header,
+                          keyframe ? time_ms : time_ms - writer->time_ms);
+
+    for (size_t field = 0; field < MEMORY_FIELD_COUNT && ok; field++) {
+        long value    = *memory_field((SystemMemoryInfo*)mem_info, field);
+        long previous = *memory_field(&writer->mem_info, field);
+        ok = put_signed(&writer->header, keyframe ? value : value - previous);
+    }
+
+    ok = ok && put_varint(&writer->header, cpu_delta->cpu_count);
+    for (size_t field = 0; field < CPU_FIELD_COUNT && ok; field++) {
+        ok = put_varint(&writer->header,
+                        *cpu_field((SystemCpuTimes*)cpu_delta, field));
+    }
+
+    if (!keyframe) {
+        ok = ok && put_varint(&writer->header, writer->exited_count);
+    }
+
+    uint8_t    count_bytes[3][RECORD_VARINT_MAX];
+    ByteBuffer added_count = varint_section(count_bytes[0], writer->added_count);
+    ByteBuffer changed_count =
+        varint_section(count_bytes[1], writer->changed_count);
+    ByteBuffer name_count =
+        varint_section(count_bytes[2], writer->pending_names);
+
+    if (ok) {
+        struct iovec parts[RECORD_PARTS_MAX];
+        uint8_t      prefixes[2][1 + RECORD_VARINT_MAX];
+        size_t       part_count = 0;
+
+        if (writer->pending_names > 0) {
+            const ByteBuffer* names[] = {&name_count, &writer->names};
+            part_count += frame_parts(parts, prefixes[0], RECORD_FRAME_NAMES,
+                                      names, 2);
+        }
+
+        if (keyframe) {
+            const ByteBuffer* sections[] = {&writer->header, &added_count,
+                                            &writer->added};
+            part_count += frame_parts(parts + part_count, prefixes[1],
+                                      RECORD_FRAME_KEY, sections, 3);
+        } else {
+            const ByteBuffer* sections[] = {&writer->header, &writer->exited,
+                                            &added_count, &writer->added,
+                                            &changed_count, &writer->changed};
+            part_count += frame_parts(parts + part_count, prefixes[1],
+                                      RECORD_FRAME_DELTA, sections, 6);
+        }
+
+        ok = write_parts(writer->fd, parts, part_count);
+    }
+
+    if (!ok) {
+        writer->failed = true;
+        return false;
+    }
+
+    writer->time_ms  = time_ms;
+    writer->mem_info = *mem_info;
+    writer->frames++;
+    return true;
+}
+
+static bool index_frames(Replay* replay) {
+    size_t frame_capacity    = 0;
+    size_t keyframe_capacity = 0;
+    size_t name_capacity     = 0;
+
+    ByteReader file = {.pos = replay->map + RECORD_MAGIC_SIZE,
+                       .end = replay->map + replay->map_size,
+                       .ok  = true};
+
+    while (file.pos < file.end) {
+        uint8_t  type   = get_byte(&file);
+        uint64_t length = get_varint(&file);
+
+        // A frame cut short ends the log.
+        if (!file.ok || length > (uint64_t)(file.end - file.pos))
+            break;
+
+        ByteReader payload = {.pos = file.pos,
+                              .end = file.pos + length,
+                              .ok  = true};
+        file.pos += length;
+
+        if (type == RECORD_FRAME_NAMES) {
+            uint64_t count = get_varint(&payload);
+
+            for (uint64_t i = 0; i < count && payload.ok; i++) {
+                uint64_t len = get_varint(&payload);
+
+                if (len > (uint64_t)(payload.end - payload.pos)) {
+                    payload.ok = false;
+                    break;
+                }
+                if (!grow_array((void**)&replay->names, sizeof(ReplayName),
+                                &name_capacity, replay->name_count + 1))
+                    return false;
+
+                replay->names[replay->name_count++] = (ReplayName){
+                    .text = (const char*)payload.pos, .length = len};
+                payload.pos += len;
+            }
+
+            if (!payload.ok)
+                return false;
+            continue;
+        }
+
+        if (type != RECORD_FRAME_KEY && type != RECORD_FRAME_DELTA)
+            return false;
+
+        // Deltas are only meaningful after the first keyframe.
+        if (replay->frame_count == 0 && type != RECORD_FRAME_KEY)
+            return false;
+
+        if (!grow_array((void**)&replay->frames, sizeof(ReplayFrame),
+                        &frame_capacity, replay->frame_count + 1))
+            return false;
+
+        if (type == RECORD_FRAME_KEY) {
+            if (!grow_array((void**)&replay->keyframes, sizeof(size_t),
+                            &keyframe_capacity, replay->keyframe_count + 1))
+                return false;
+            replay->keyframes[replay->keyframe_count++] = replay->frame_count;
+        }
+
+        replay->frames[replay->frame_count++] = (ReplayFrame){
+            .offset = (size_t)(payload.pos - replay->map),
+            .length = (size_t)length,
+            .type   = type};
+    }
+
+    return replay->frame_count > 0;
+}
+
+static RecordSlot* replay_slot(Replay* replay, uint64_t id) {
+    if (id >= RECORD_MAX_ID ||
+        !reserve_slots(&replay->slots, NULL, &replay->slot_capacity,
+                       (size_t)id))
+        return NULL;
+
+    return &replay->slots[id];
+}
+
+static bool decode_process(Replay* replay, ByteReader* reader) {
+    RecordSlot* slot = replay_slot(replay, get_varint(reader));
+    if (slot == NULL)
+        return false;
+
+    slot->pid        = (int)get_varint(reader);
+    slot->start_time = get_varint(reader);
+    slot->ppid       = (int)get_varint(reader);
+    slot->state      = (char)get_byte(reader);
+    slot->rss_kb     = (unsigned long)get_varint(reader);
+    slot->cpu_tenths = (unsigned int)get_varint(reader);
+    slot->name_id    = (uint32_t)get_varint(reader);
+
+    return reader->ok && slot->pid > 0 && slot->name_id < replay->name_count;
+}
+
+static bool decode_changed(Replay* replay, ByteReader* reader) {
+    RecordSlot* slot = replay_slot(replay, get_varint(reader));
+    if (slot == NULL || slot->pid == 0)
+        return false;
+
+    uint8_t mask = get_byte(reader);
+
+    if (mask & RECORD_CHANGED_STATE) {
+        slot->state = (char)get_byte(reader);
+    }
+    if (mask & RECORD_CHANGED_RSS) {
+        slot->rss_kb = (unsigned long)((long long)slot->rss_kb +
+                                       get_signed(reader));
+    }
+    if (mask & RECORD_CHANGED_NAME) {
+        slot->name_id = (uint32_t)get_varint(reader);
+    }
+    if (mask & RECORD_CHANGED_CPU) {
+        slot->cpu_tenths = (unsigned int)((long long)slot->cpu_tenths +
+                                          get_signed(reader));
+    }
+    if (mask & RECORD_CHANGED_PARENT) {
+        slot->ppid = (int)get_varint(reader);
+    }
+
+    return reader->ok && slot->name_id < replay->name_count;
+}
+
+static bool decode_frame(Replay* replay, size_t index) {
+    const ReplayFrame* frame    = &replay->frames[index];
+    bool               keyframe = frame->type == RECORD_FRAME_KEY;
+    ByteReader         reader   = {.pos = replay->map + frame->offset,
+                                   .end = replay->map + frame->offset +
+                                    frame->length,
+                                   .ok  = true};
+
+    long long time = get_signed(&reader);
+    replay->time_ms = keyframe ? time : replay->time_ms + time;
+
+    for (size_t field = 0; field < MEMORY_FIELD_COUNT; field++) {
+        long  value   = (long)get_signed(&reader);
+        long* current = memory_field(&replay->mem_info, field);
+        *current      = keyframe ? value : *current + value;
+    }
+
+    replay->cpu_delta.cpu_count = (unsigned int)get_varint(&reader);
+    for (size_t field = 0; field < CPU_FIELD_COUNT; field++) {
+        *cpu_field(&replay->cpu_delta, field) = get_varint(&reader);
+    }
+
+    replay->new_count    = 0;
+    replay->exited_count = 0;
+
+    if (keyframe) {
+        if (replay->slots != NULL) {
+            memset(replay->slots, 0,
+                   replay->slot_capacity * sizeof(RecordSlot));
+        }
+    } else {
+        uint64_t exited = get_varint(&reader);
+
+        for (uint64_t i = 0; i < exited && reader.ok; i++) {
+            RecordSlot* slot = replay_slot(replay, get_varint(&reader));
+            if (slot == NULL)
+                return false;
+            slot->pid = 0;
+        }
+        replay->exited_count = (size_t)exited;
+    }
+
+    uint64_t added = get_varint(&reader);
+    for (uint64_t i = 0; i < added && reader.ok; i++) {
+        if (!decode_process(replay, &reader))
+            return false;
+    }
+    if (!keyframe) {
+        replay->new_count = (size_t)added;
+
+        uint64_t changed = get_varint(&reader);
+        for (uint64_t i = 0; i < changed && reader.ok; i++) {
+            if (!decode_changed(replay, &reader))
+                return false;
+        }
+    }
+
+    return reader.ok;
+}
+
+static bool export_frame(Replay* replay) {
+    Snapshot* snapshot = &replay->snapshot;
+
+    process_table_clear(&snapshot->processes);
+
+    for (size_t id = 0; id < replay->slot_capacity; id++) {
+        const RecordSlot* slot = &replay->slots[id];
+        if (slot->pid == 0)
+            continue;
+
+        const ReplayName* name    = &replay->names[slot->name_id];
+        size_t            len     = name->length < PROC_NAME_MAX - 1
+                                        ? name->length
+                                        : PROC_NAME_MAX - 1;
+        ProcessInfo       process = {.pid        = slot->pid,
+                                     .ppid       = slot->ppid,
+                                     .state      = slot->state,
+                                     .vm_rss_kb  = slot->rss_kb,
+                                     .start_time = slot->start_time,
+                                     .cpu_tenths = slot->cpu_tenths};
+
+        memcpy(process.name, name->text, len);
+        process.name[len] = '\0';
+
+        if (!process_table_append(&snapshot->processes, &process))
+            return false;
+
+        snapshot->processes.ids[snapshot->processes.count - 1] = (uint32_t)id;
+    }
+
+    if (!process_table_fold_names(&snapshot->processes))
+        return false;
+
+    snapshot->mem_info       = replay->mem_info;
+    snapshot->cpu_delta      = replay->cpu_delta;
+    snapshot->have_processes = true;
+    snapshot->new_count      = replay->new_count;
+    snapshot->exited_count   = replay->exited_count;
+    return true;
+}
+
+Replay* replay_open(const char* path) {
+    if (path == NULL)
+        return NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < RECORD_MAGIC_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return NULL;
+
+    Replay* replay = calloc(1, sizeof(Replay));
+    if (replay == NULL) {
+        munmap(map, (size_t)info.st_size);
+        return NULL;
+    }
+
+    replay->map      = map;
+    replay->map_size = (size_t)info.st_size;
+
+    if (memcmp(replay->map, RECORD_MAGIC, RECORD_MAGIC_SIZE) != 0 ||
+        !index_frames(replay)) {
+        replay_close(replay);
+        return NULL;
+    }
+
+    replay->current = replay->frame_count;
+    return replay;
+}
+
+void replay_close(Replay* replay) {
+    if (replay == NULL)
+        return;
+
+    munmap((void*)replay->map, replay->map_size);
+    free(replay->frames);
+    free(replay->keyframes);
+    free(replay->names);
+    free(replay->slots);
+    process_table_destroy(&replay->snapshot.processes);
+    free(replay);
+}
+
+size_t replay_frame_count(const Replay* replay) {
+    return replay != NULL ? replay->frame_count : 0;
+}
+
+const Snapshot* replay_seek(Replay* replay, size_t frame) {
+    if (replay == NULL || frame >= replay->frame_count)
+        return NULL;
+
+    if (frame == replay->current)
+        return &replay->snapshot;
+
+    // Nearest keyframe at or before frame.
+    size_t low  = 0;
+    size_t high = replay->keyframe_count;
+
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+
+        if (replay->keyframes[middle] <= frame) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    size_t start = replay->keyframes[low];
+
+    // Stepping forward from the decoded frame beats restarting from the
+    // keyframe when that frame lies between the two.
+    if (replay->current < replay->frame_count && replay->current < frame &&
+        replay->current >= start) {
+        start = replay->current + 1;
+    }
+
+    for (size_t i = start; i <= frame; i++) {
+        if (!decode_frame(replay, i)) {
+            replay->current = replay->frame_count;
+            return NULL;
+        }
+    }
+
+    if (!export_frame(replay)) {
+        replay->current = replay->frame_count;
+        return NULL;
+    }
+
+    replay->current           = frame;
+    replay->snapshot.sequence = frame + 1;
+    return &replay->snapshot;
+}
+
+struct timespec replay_frame_time(const Replay* replay) {
+    struct timespec time = {0};
+
+    if (replay != NULL) {
+        time.tv_sec  = replay->time_ms / MS_PER_SECOND;
+        time.tv_nsec = replay->time_ms % MS_PER_SECOND * NS_PER_MS;
+    }
+
+    return time;
+}
@@ -0,0 +1,64 @@
+#ifndef LTOP_RECORD_H
+#define LTOP_RECORD_H
+
+#include "proc.h"
+#include "sampler.h"
+#include "table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Every this many frames the recorder writes a keyframe holding every
+// process, so replay can seek without decoding the log from the start.
+#define RECORD_KEYFRAME_INTERVAL 64
+
+// Snapshot log. After an 8-byte magic the file is a sequence of frames,
+// each a type byte and a varint payload length:
+//
+//   names     strings interned from here on, numbered in file order
+//   keyframe  wall time, memory info, CPU ticks and every process
+//   delta     wall time and memory info as differences to the frame
+//             before, CPU ticks, the ids of exited processes, new
+//             processes, and the changed fields of the rest
+//
+// CPU ticks are the system-wide ticks spent since the previous snapshot,
+// stored as they are in every frame.
+//
+// Processes are keyed by the table's stable ids (model record slots), and
+// each name is stored once and then referred to by number. Integers are
+// LEB128 varints, zigzag encoded where they can be negative. A frame cut
+// short by a crash is ignored on replay.
+typedef struct RecordWriter RecordWriter;
+
+// Creates or truncates the log at path. Returns NULL on failure.
+RecordWriter* record_writer_create(const char* path);
+void          record_writer_destroy(RecordWriter* writer);
+
+// Appends a frame for table, which must carry model ids. It goes out with
+// the names frame it needs in a single writev(2), followed by more only if
+// that one comes up short.
+bool record_write_frame(RecordWriter* writer, const ProcessTable* table,
+                        const SystemMemoryInfo* mem_info,
+                        const SystemCpuTimes*   cpu_delta,
+                        const struct timespec*  wall_time);
+
+typedef struct Replay Replay;
+
+// Maps the log at path and indexes its frames. Returns NULL if it cannot be
+// read or holds no frame.
+Replay* replay_open(const char* path);
+void    replay_close(Replay* replay);
+
+size_t replay_frame_count(const Replay* replay);
+
+// Returns frame as a snapshot whose sequence is frame + 1, decoding forward
+// from the closest keyframe at or before it, or from the current frame when
+// that is closer. The result stays valid until the next call. Returns NULL
+// if the log is corrupt.
+const Snapshot* replay_seek(Replay* replay, size_t frame);
+
+// Wall-clock time of the last frame returned by replay_seek.
+struct timespec replay_frame_time(const Replay* replay);
+
+#endif
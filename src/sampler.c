@@ -0,0 +1,492 @@
+#include "sampler.h"
+#include "events.h"
+#include "model.h"
+#include "profile.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Triple buffer: the sampler fills its back slot and swaps it with the
+// shared middle slot; the UI swaps its front slot with the middle one when
+// the fresh bit is set. Neither side ever blocks the other, and the UI
+// always sees a whole snapshot.
+#define SNAPSHOT_SLOTS       3
+#define SNAPSHOT_SLOT_MASK   0x3u
+#define SNAPSHOT_FRESH       0x4u
+#define MS_PER_SECOND        1000
+#define NS_PER_MS            1000000L
+#define NS_PER_SECOND        1000000000L
+// Weight of the newest sample in the smoothed sampling cost.
+#define COST_SMOOTHING       0.3
+
+struct Sampler {
+    ProcCollector* collector;
+    ProcessTable   scan;  // raw output of the last collection
+    PidList        thread_pids; // copy of watched_pids for one snapshot
+    MemoryWatch*   memory_watches; // and of watched_memory
+    size_t         memory_watch_count;
+    size_t         memory_watch_capacity;
+    CgroupSet      cgroups; // every group seen while cgroups were on
+    bool           cgroups_on; // cgroups_enabled for one snapshot
+    ProcessModel   model; // processes tracked across scans
+    Snapshot       slots[SNAPSHOT_SLOTS];
+    unsigned int   back;   // written only by the sampler thread
+    unsigned int   front;  // read only by the UI thread
+    atomic_uint    middle; // slot index | SNAPSHOT_FRESH
+    unsigned long  sequence;
+    int            event_fd;
+
+    double          cpu_share; // 0 keeps the interval fixed
+    double          cost_ms;   // smoothed CPU time of one snapshot
+
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    PidList         watched_pids; // processes whose threads are listed
+    MemoryWatch*    watched_memory; // see sampler_watch_memory
+    size_t          watched_memory_count;
+    size_t          watched_memory_capacity;
+    bool            cgroups_enabled;
+    long            interval_ms;
+    bool            interval_changed;
+    bool            refresh_requested;
+    bool            shutting_down;
+};
+
+static double cpu_time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+
+    return (double)now.tv_sec * MS_PER_SECOND + (double)now.tv_nsec / NS_PER_MS;
+}
+
+// Copies the watched memory list for one snapshot. Called with the lock
+// held. On failure the previous snapshot's copy is kept.
+static void copy_memory_watches(Sampler* sampler) {
+    size_t count = sampler->watched_memory_count;
+
+    if (count > sampler->memory_watch_capacity) {
+        MemoryWatch* grown = realloc(sampler->memory_watches,
+                                     count * sizeof(MemoryWatch));
+        if (grown == NULL)
+            return;
+
+        sampler->memory_watches        = grown;
+        sampler->memory_watch_capacity = count;
+    }
+
+    if (count > 0) {
+        memcpy(sampler->memory_watches, sampler->watched_memory,
+               count * sizeof(MemoryWatch));
+    }
+    sampler->memory_watch_count = count;
+}
+
+// Reads smaps_rollup for the watched processes whose figures are missing or
+// MEMORY_SAMPLE_UPDATES old, into their model records. A process that left
+// the model is skipped; it will not be watched once the UI catches up.
+static void sample_memory(Sampler* sampler, Snapshot* snapshot) {
+    ProcessModel* model = &sampler->model;
+
+    snapshot->memory_reads = 0;
+
+    for (size_t i = 0; i < sampler->memory_watch_count; i++) {
+        const MemoryWatch* watch = &sampler->memory_watches[i];
+        ProcessRecord*     record =
+            process_model_record(model, watch->id, watch->pid);
+
+        if (record == NULL ||
+            (record->memory_generation != 0 &&
+             model->generation - record->memory_generation <
+                 MEMORY_SAMPLE_UPDATES))
+            continue;
+
+        // A kernel thread or an unreadable process is retried at the same
+        // pace, not on every snapshot.
+        read_process_memory(record->pid, &record->memory,
+                            &snapshot->collect_stats);
+        record->memory_generation = model->generation;
+        snapshot->memory_reads++;
+    }
+}
+
+// Gives every process of the last update the id of its cgroup, reading
+// /proc/PID/cgroup for the ones new to it, and lists the groups in the
+// snapshot. Called after a successful model update.
+static void sample_cgroups(Sampler* sampler, Snapshot* snapshot) {
+    ProcessModel* model = &sampler->model;
+    CgroupSet*    set   = &sampler->cgroups;
+
+    cgroup_set_begin_tally(set);
+
+    for (size_t row = 0; row < model->scan_count; row++) {
+        ProcessRecord* record = &model->records[model->scan_slots[row]];
+
+        if (record->tgid != 0)
+            continue;
+
+        // A process that moves to another group keeps the first one; the
+        // cost of rereading every process each cycle is what this avoids.
+        if (record->cgroup == 0) {
+            char path[CGROUP_PATH_MAX];
+
+            record->cgroup = read_process_cgroup(record->pid, path,
+                                                 sizeof(path),
+                                                 &snapshot->collect_stats)
+                                 ? cgroup_set_intern(set, path)
+                                 : CGROUP_UNREADABLE;
+        }
+
+        cgroup_set_count(set, record->cgroup);
+    }
+
+    if (!cgroup_set_export(set, &snapshot->cgroups)) {
+        snapshot->cgroups.count = 0;
+    }
+}
+
+static void take_snapshot(Sampler* sampler, Snapshot* snapshot) {
+    // Process CPU time also counts the collection threads of the pool.
+    double             started         = cpu_time_ms();
+    unsigned long long collect_started = profile_now_ns();
+    bool collected = collect_processes(sampler->collector, &sampler->scan);
+
+    pthread_mutex_lock(&sampler->lock);
+    bool copied = pid_list_assign(&sampler->thread_pids,
+                                  sampler->watched_pids.pids,
+                                  sampler->watched_pids.count);
+    copy_memory_watches(sampler);
+    sampler->cgroups_on = sampler->cgroups_enabled;
+    pthread_mutex_unlock(&sampler->lock);
+
+    // Only a table that cannot grow fails the snapshot; a watch list that
+    // could not be copied just leaves the threads out.
+    if (collected && copied && sampler->thread_pids.count > 0) {
+        collected = collect_threads(sampler->collector,
+                                    sampler->thread_pids.pids,
+                                    sampler->thread_pids.count,
+                                    &sampler->scan);
+    }
+
+    snapshot->collect_ns    = profile_now_ns() - collect_started;
+    snapshot->collect_stats = sampler->collector->stats;
+
+    ProcEvents* events          = sampler->collector->events;
+    snapshot->short_lived_count = events != NULL ? events->short_lived : 0;
+
+    // Read right after the scan, so the totals cover the same interval as
+    // the processes' tick counters.
+    SystemCpuTimes cpu_times;
+    bool have_cpu = read_system_cpu_times(sampler->collector, &cpu_times);
+
+    // A failed or partial scan would mark every missed process as exited,
+    // so only complete scans reach the model.
+    bool updated = collected &&
+                   process_model_update(&sampler->model, &sampler->scan,
+                                        have_cpu ? &cpu_times : NULL);
+
+    unsigned long long memory_started = profile_now_ns();
+
+    if (updated) {
+        sample_memory(sampler, snapshot);
+    }
+    snapshot->memory_ns = profile_now_ns() - memory_started;
+
+    unsigned long long cgroup_started = profile_now_ns();
+
+    snapshot->cgroups.count = 0;
+    if (updated && sampler->cgroups_on) {
+        sample_cgroups(sampler, snapshot);
+    }
+    snapshot->cgroup_ns = profile_now_ns() - cgroup_started;
+
+    snapshot->have_processes =
+        updated &&
+        process_model_export(&sampler->model, &snapshot->processes) &&
+        process_table_fold_names(&snapshot->processes);
+
+    if (snapshot->have_processes) {
+        snapshot->new_count    = sampler->model.new_count;
+        snapshot->exited_count = sampler->model.exited_count;
+        snapshot->cpu_delta    = sampler->model.cpu_delta;
+    } else {
+        process_table_clear(&snapshot->processes);
+        snapshot->new_count    = 0;
+        snapshot->exited_count = 0;
+        memset(&snapshot->cpu_delta, 0, sizeof(snapshot->cpu_delta));
+    }
+
+    unsigned long long meminfo_started = profile_now_ns();
+
+    if (!read_system_memory_info(sampler->collector,
+                                 &snapshot->mem_info)) {
+        memset(&snapshot->mem_info, 0, sizeof(snapshot->mem_info));
+    }
+    snapshot->meminfo_ns = profile_now_ns() - meminfo_started;
+
+    double cost       = cpu_time_ms() - started;
+    sampler->cost_ms  = sampler->sequence == 0
+                            ? cost
+                            : sampler->cost_ms * (1 - COST_SMOOTHING) +
+                                  cost * COST_SMOOTHING;
+    snapshot->cost_ms = sampler->cost_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &snapshot->taken_at);
+    snapshot->sequence = ++sampler->sequence;
+}
+
+static void add_ms(struct timespec* time, long ms) {
+    time->tv_sec += ms / MS_PER_SECOND;
+    time->tv_nsec += (ms % MS_PER_SECOND) * NS_PER_MS;
+    if (time->tv_nsec >= NS_PER_SECOND) {
+        time->tv_sec++;
+        time->tv_nsec -= NS_PER_SECOND;
+    }
+}
+
+// When the snapshot taken at taken_at is due to be followed by the next.
+// Called with the lock held.
+static struct timespec next_deadline(const Sampler*         sampler,
+                                     const struct timespec* taken_at) {
+    long interval_ms = sampler_adaptive_interval(
+        sampler->interval_ms, sampler->cpu_share, sampler->cost_ms);
+
+    struct timespec deadline = *taken_at;
+    add_ms(&deadline, interval_ms);
+    return deadline;
+}
+
+static void publish_snapshot(Sampler* sampler) {
+    unsigned int previous =
+        atomic_exchange(&sampler->middle, sampler->back | SNAPSHOT_FRESH);
+    sampler->back = previous & SNAPSHOT_SLOT_MASK;
+
+    uint64_t one = 1;
+    if (write(sampler->event_fd, &one, sizeof(one)) < 0) {
+        // The counter only saturates if the UI stopped draining it, in which
+        // case it is already due to wake up.
+    }
+}
+
+static void* sampler_main(void* arg) {
+    Sampler* sampler = arg;
+
+    for (;;) {
+        Snapshot* snapshot = &sampler->slots[sampler->back];
+
+        take_snapshot(sampler, snapshot);
+        struct timespec taken_at = snapshot->taken_at;
+        publish_snapshot(sampler);
+
+        pthread_mutex_lock(&sampler->lock);
+
+        struct timespec deadline = next_deadline(sampler, &taken_at);
+
+        int rc = 0;
+        while (!sampler->shutting_down && !sampler->refresh_requested &&
+               rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&sampler->wake, &sampler->lock,
+                                        &deadline);
+
+            // A new interval counts from the last snapshot, not from now.
+            if (sampler->interval_changed) {
+                sampler->interval_changed = false;
+                deadline = next_deadline(sampler, &taken_at);
+                rc       = 0;
+            }
+        }
+
+        bool done                  = sampler->shutting_down;
+        sampler->refresh_requested = false;
+        pthread_mutex_unlock(&sampler->lock);
+
+        if (done)
+            break;
+    }
+
+    return NULL;
+}
+
+Sampler* sampler_create(ProcCollector* collector, long interval_ms,
+                        double cpu_share) {
+    if (collector == NULL || interval_ms <= 0 || cpu_share < 0)
+        return NULL;
+
+    Sampler* sampler = calloc(1, sizeof(Sampler));
+    if (sampler == NULL)
+        return NULL;
+
+    sampler->collector   = collector;
+    sampler->interval_ms = interval_ms;
+    sampler->cpu_share   = cpu_share;
+    sampler->back        = 0;
+    sampler->front       = 1;
+    atomic_init(&sampler->middle, 2);
+
+    sampler->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sampler->event_fd < 0) {
+        free(sampler);
+        return NULL;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sampler->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&sampler->lock, NULL);
+
+    if (pthread_create(&sampler->thread, NULL, sampler_main, sampler) != 0) {
+        pthread_mutex_destroy(&sampler->lock);
+        pthread_cond_destroy(&sampler->wake);
+        close(sampler->event_fd);
+        free(sampler);
+        return NULL;
+    }
+
+    return sampler;
+}
+
+void sampler_destroy(Sampler* sampler) {
+    if (sampler == NULL)
+        return;
+
+    pthread_mutex_lock(&sampler->lock);
+    sampler->shutting_down = true;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+
+    pthread_join(sampler->thread, NULL);
+
+    for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+        process_table_destroy(&sampler->slots[i].processes);
+        cgroup_list_destroy(&sampler->slots[i].cgroups);
+    }
+    process_table_destroy(&sampler->scan);
+    process_model_destroy(&sampler->model);
+    pid_list_destroy(&sampler->thread_pids);
+    pid_list_destroy(&sampler->watched_pids);
+    free(sampler->memory_watches);
+    free(sampler->watched_memory);
+    cgroup_set_destroy(&sampler->cgroups);
+
+    pthread_mutex_destroy(&sampler->lock);
+    pthread_cond_destroy(&sampler->wake);
+    close(sampler->event_fd);
+    free(sampler);
+}
+
+int sampler_event_fd(const Sampler* sampler) {
+    return sampler != NULL ? sampler->event_fd : -1;
+}
+
+void sampler_set_interval(Sampler* sampler, long interval_ms) {
+    if (sampler == NULL || interval_ms <= 0)
+        return;
+
+    pthread_mutex_lock(&sampler->lock);
+    sampler->interval_ms      = interval_ms;
+    sampler->interval_changed = true;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+long sampler_adaptive_interval(long interval_ms, double cpu_share,
+                               double cost_ms) {
+    if (cpu_share <= 0 || cost_ms <= 0)
+        return interval_ms;
+
+    double needed = cost_ms / cpu_share;
+
+    if (needed > MAX_SAMPLE_INTERVAL_MS)
+        return MAX_SAMPLE_INTERVAL_MS;
+
+    return needed > (double)interval_ms ? (long)needed + 1 : interval_ms;
+}
+
+void sampler_request_refresh(Sampler* sampler) {
+    if (sampler == NULL)
+        return;
+
+    pthread_mutex_lock(&sampler->lock);
+    sampler->refresh_requested = true;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+bool sampler_watch_threads(Sampler* sampler, const int* pids, size_t count) {
+    if (sampler == NULL)
+        return false;
+
+    pthread_mutex_lock(&sampler->lock);
+    bool ok = pid_list_assign(&sampler->watched_pids, pids, count);
+    pthread_mutex_unlock(&sampler->lock);
+
+    return ok;
+}
+
+bool sampler_watch_memory(Sampler* sampler, const MemoryWatch* watches,
+                          size_t count) {
+    if (sampler == NULL || (watches == NULL && count > 0))
+        return false;
+
+    bool ok = true;
+
+    pthread_mutex_lock(&sampler->lock);
+
+    if (count > sampler->watched_memory_capacity) {
+        MemoryWatch* grown = realloc(sampler->watched_memory,
+                                     count * sizeof(MemoryWatch));
+        if (grown != NULL) {
+            sampler->watched_memory          = grown;
+            sampler->watched_memory_capacity = count;
+        }
+        ok = grown != NULL;
+    }
+
+    if (ok) {
+        if (count > 0) {
+            memcpy(sampler->watched_memory, watches,
+                   count * sizeof(MemoryWatch));
+        }
+        sampler->watched_memory_count = count;
+    }
+
+    pthread_mutex_unlock(&sampler->lock);
+    return ok;
+}
+
+void sampler_set_cgroups(Sampler* sampler, bool enabled) {
+    if (sampler == NULL)
+        return;
+
+    pthread_mutex_lock(&sampler->lock);
+    sampler->cgroups_enabled = enabled;
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+const Snapshot* sampler_acquire(Sampler* sampler) {
+    if (sampler == NULL)
+        return NULL;
+
+    uint64_t pending;
+    if (read(sampler->event_fd, &pending, sizeof(pending)) < 0) {
+        // EAGAIN: nothing new since the last acquire.
+    }
+
+    if (atomic_load(&sampler->middle) & SNAPSHOT_FRESH) {
+        unsigned int previous =
+            atomic_exchange(&sampler->middle, sampler->front);
+        sampler->front = previous & SNAPSHOT_SLOT_MASK;
+    }
+
+    const Snapshot* snapshot = &sampler->slots[sampler->front];
+
+    return snapshot->sequence > 0 ? snapshot : NULL;
+}
@@ -0,0 +1,102 @@
+#ifndef LTOP_SAMPLER_H
+#define LTOP_SAMPLER_H
+
+#include "cgroup.h"
+#include "proc.h"
+#include "table.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MIN_SAMPLE_INTERVAL_MS 100
+#define MAX_SAMPLE_INTERVAL_MS (60 * 60 * 1000)
+// Snapshots a process's smaps_rollup figures are shown for before they are
+// read again.
+#define MEMORY_SAMPLE_UPDATES  5
+
+// One complete sample. Once handed to the UI a snapshot is never written
+// again until the UI trades it back in with the next sampler_acquire.
+typedef struct {
+    ProcessTable     processes;      // with its names folded for filters
+    SystemMemoryInfo mem_info;
+    SystemCpuTimes   cpu_delta;      // ticks spent since the last snapshot
+    bool             have_processes; // false if /proc could not be read
+    size_t           new_count;      // processes that appeared since the last
+    size_t           exited_count;   // snapshot, and ones that went away
+    size_t           short_lived_count; // came and went in between, seen
+                                        // only through proc events
+    unsigned long    sequence;       // 1 for the first snapshot
+    struct timespec  taken_at;       // CLOCK_MONOTONIC
+    double           cost_ms;        // smoothed CPU time of one sample
+    // Wall time of this sample's collect_processes and
+    // read_system_memory_info, and what the collection cost per thread.
+    unsigned long long collect_ns;
+    unsigned long long meminfo_ns;
+    CollectStats       collect_stats;
+    // Time and reads spent on the watched processes' smaps_rollup.
+    unsigned long long memory_ns;
+    size_t             memory_reads;
+    // The groups of the processes, while cgroups are sampled, and the time
+    // spent on them.
+    CgroupList         cgroups;
+    unsigned long long cgroup_ns;
+} Snapshot;
+
+// A process whose memory detail to keep current: the id of its row in a
+// snapshot, which is its model slot, and its PID to confirm the slot still
+// holds it.
+typedef struct {
+    uint32_t id;
+    int      pid;
+} MemoryWatch;
+
+typedef struct Sampler Sampler;
+
+// Starts a thread that samples through collector every interval_ms, or
+// sooner on request. With a cpu_share above 0 the interval is stretched
+// whenever sampling would otherwise use more than that fraction of one CPU.
+// The sampler uses but does not own the collector, which must stay
+// untouched by the caller until sampler_destroy returns.
+Sampler* sampler_create(ProcCollector* collector, long interval_ms,
+                        double cpu_share);
+void     sampler_destroy(Sampler* sampler);
+
+// Changes the base interval; the next snapshot is rescheduled right away.
+void sampler_set_interval(Sampler* sampler, long interval_ms);
+
+// The interval that keeps sampling at cost_ms of CPU time each within
+// cpu_share of one CPU, and never below interval_ms. A cpu_share of 0
+// returns interval_ms.
+long sampler_adaptive_interval(long interval_ms, double cpu_share,
+                               double cost_ms);
+
+// An eventfd that becomes readable whenever a new snapshot is published.
+int sampler_event_fd(const Sampler* sampler);
+
+// Wakes the sampler to take a snapshot now instead of at the next tick.
+void sampler_request_refresh(Sampler* sampler);
+
+// Replaces the processes whose threads later snapshots list, next to the
+// processes themselves (see collect_threads). Fails only if the list could
+// not be copied, leaving the previous one in place.
+bool sampler_watch_threads(Sampler* sampler, const int* pids, size_t count);
+
+// Replaces the processes whose memory detail later snapshots keep current
+// (see MemoryDetail), typically the ones on screen. Each is read when first
+// watched and again every MEMORY_SAMPLE_UPDATES snapshots; the others keep
+// the figures they had. Fails only if the list could not be copied.
+bool sampler_watch_memory(Sampler* sampler, const MemoryWatch* watches,
+                          size_t count);
+
+// Turns reading cgroups on or off from the next snapshot on. While on, each
+// process's cgroup is read once, when first seen, and every snapshot lists
+// the groups with their memory accounting.
+void sampler_set_cgroups(Sampler* sampler, bool enabled);
+
+// Returns the newest published snapshot, or NULL before the first one. The
+// result stays valid and unchanged until the next call. Also drains the
+// event fd.
+const Snapshot* sampler_acquire(Sampler* sampler);
+
+#endif
@@ -0,0 +1,111 @@
+#include "screen.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* line_text(const ScreenCache* cache, int y) {
+    return cache->text + (size_t)y * (size_t)(cache->columns + 1);
+}
+
+// Records the scratch line as the contents of line y. Returns false if that
+// is what the line already shows, or true if the caller has to draw it.
+static bool update_line(ScreenCache* cache, int y, attr_t attrs) {
+    char* cached = line_text(cache, y);
+
+    if (cache->valid[y] && cache->attrs[y] == attrs &&
+        strcmp(cached, cache->scratch) == 0)
+        return false;
+
+    memcpy(cached, cache->scratch, (size_t)cache->columns + 1);
+    cache->attrs[y] = attrs;
+    cache->valid[y] = true;
+    return true;
+}
+
+void screen_cache_destroy(ScreenCache* cache) {
+    if (cache == NULL)
+        return;
+
+    free(cache->text);
+    free(cache->attrs);
+    free(cache->valid);
+    free(cache->scratch);
+    memset(cache, 0, sizeof(ScreenCache));
+}
+
+bool screen_cache_begin(ScreenCache* cache) {
+    if (cache == NULL)
+        return false;
+
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+
+    if (cache->text != NULL && max_y == cache->lines && max_x == cache->columns)
+        return true;
+
+    screen_cache_destroy(cache);
+    clear();
+
+    if (max_y <= 0 || max_x <= 0)
+        return false;
+
+    cache->text  = malloc((size_t)max_y * (size_t)(max_x + 1));
+    cache->attrs = malloc((size_t)max_y * sizeof(attr_t));
+    cache->valid   = calloc((size_t)max_y, sizeof(bool));
+    cache->scratch = malloc((size_t)max_x + 1);
+
+    if (cache->text == NULL || cache->attrs == NULL || cache->valid == NULL ||
+        cache->scratch == NULL) {
+        screen_cache_destroy(cache);
+        return false;
+    }
+
+    cache->lines   = max_y;
+    cache->columns = max_x;
+    return true;
+}
+
+void screen_cache_invalidate(ScreenCache* cache) {
+    if (cache == NULL || cache->valid == NULL)
+        return;
+
+    memset(cache->valid, 0, (size_t)cache->lines * sizeof(bool));
+}
+
+void screen_put_line(ScreenCache* cache, int y, attr_t attrs,
+                     const char* format, ...) {
+    if (cache == NULL || format == NULL || y < 0 || y >= cache->lines)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(cache->scratch, (size_t)cache->columns + 1, format, args);
+    va_end(args);
+
+    if (!update_line(cache, y, attrs))
+        return;
+
+    attron(attrs);
+    mvaddstr(y, 0, cache->scratch);
+    attroff(attrs);
+
+    // Text that fills the line leaves the cursor on the next one.
+    if ((int)strlen(cache->scratch) < cache->columns) {
+        clrtoeol();
+    }
+}
+
+void screen_put_hline(ScreenCache* cache, int y, char ch) {
+    if (cache == NULL || y < 0 || y >= cache->lines)
+        return;
+
+    memset(cache->scratch, ch, (size_t)cache->columns);
+    cache->scratch[cache->columns] = '\0';
+
+    if (!update_line(cache, y, A_NORMAL))
+        return;
+
+    mvhline(y, 0, (chtype)(unsigned char)ch, cache->columns);
+}
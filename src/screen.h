@@ -0,0 +1,39 @@
+#ifndef LTOP_SCREEN_H
+#define LTOP_SCREEN_H
+
+#include <ncurses.h>
+#include <stdbool.h>
+
+// The text and attributes last drawn on each line of stdscr. Lines are
+// formatted every frame but only handed to ncurses when they differ from
+// what is already on screen, so an idle frame touches no line at all and
+// refresh() has nothing to send.
+typedef struct {
+    int     lines;
+    int     columns;
+    char*   text;    // lines rows of columns + 1 bytes
+    attr_t* attrs;   // per line
+    bool*   valid;   // false until the line is drawn through the cache
+    char*   scratch; // columns + 1 bytes to format the next line into
+} ScreenCache;
+
+void screen_cache_destroy(ScreenCache* cache);
+
+// Starts a frame. A changed terminal size clears the screen and forgets
+// every line. Returns false if the cache could not grow; nothing can be
+// drawn through it until a later begin succeeds.
+bool screen_cache_begin(ScreenCache* cache);
+
+// Forgets every line, after something drew on stdscr behind the cache.
+void screen_cache_invalidate(ScreenCache* cache);
+
+// Draws line y as the formatted text, truncated to the screen width and
+// cleared to the end of the line, unless it is already shown that way.
+void screen_put_line(ScreenCache* cache, int y, attr_t attrs,
+                     const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// Fills line y with ch, unless it is already filled with it.
+void screen_put_hline(ScreenCache* cache, int y, char ch);
+
+#endif
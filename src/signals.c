@@ -0,0 +1,207 @@
+#include "signals.h"
+#include "proc.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// The position of pid, or where it would be inserted.
+static size_t find_target(const SignalTargets* targets, int pid) {
+    size_t low  = 0;
+    size_t high = targets->count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (targets->targets[middle].pid < pid) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+bool signal_targets_toggle(SignalTargets* targets, int pid,
+                           unsigned long long start_time) {
+    if (targets == NULL || pid <= 0)
+        return false;
+
+    size_t index = find_target(targets, pid);
+
+    if (index < targets->count && targets->targets[index].pid == pid) {
+        bool same = targets->targets[index].start_time == start_time;
+
+        memmove(targets->targets + index, targets->targets + index + 1,
+                (targets->count - index - 1) * sizeof(SignalTarget));
+        targets->count--;
+
+        // A tag left on an earlier process of this PID makes way for it.
+        if (same)
+            return true;
+        return signal_targets_toggle(targets, pid, start_time);
+    }
+
+    if (targets->count == targets->capacity) {
+        size_t capacity = targets->capacity > 0 ? targets->capacity * 2
+                                                : INITIAL_CAPACITY_SIZE;
+        SignalTarget* grown =
+            realloc(targets->targets, capacity * sizeof(SignalTarget));
+
+        if (grown == NULL)
+            return false;
+
+        targets->targets  = grown;
+        targets->capacity = capacity;
+    }
+
+    memmove(targets->targets + index + 1, targets->targets + index,
+            (targets->count - index) * sizeof(SignalTarget));
+    targets->targets[index] = (SignalTarget){.pid        = pid,
+                                             .start_time = start_time};
+    targets->count++;
+    return true;
+}
+
+bool signal_targets_contains(const SignalTargets* targets, int pid,
+                             unsigned long long start_time) {
+    if (targets == NULL || targets->count == 0)
+        return false;
+
+    size_t index = find_target(targets, pid);
+
+    return index < targets->count && targets->targets[index].pid == pid &&
+           targets->targets[index].start_time == start_time;
+}
+
+void signal_targets_retain(SignalTargets* targets, const ProcessTable* table) {
+    if (targets == NULL || table == NULL || targets->count == 0)
+        return;
+
+    // Tags still found have their PID negated, then the rest are dropped.
+    for (size_t row = 0; row < table->count; row++) {
+        if (table->tgids[row] != 0)
+            continue;
+
+        size_t index = find_target(targets, table->pids[row]);
+
+        if (index < targets->count &&
+            targets->targets[index].pid == table->pids[row] &&
+            targets->targets[index].start_time == table->start_times[row]) {
+            targets->targets[index].pid = -targets->targets[index].pid;
+        }
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < targets->count; i++) {
+        if (targets->targets[i].pid < 0) {
+            targets->targets[kept]     = targets->targets[i];
+            targets->targets[kept].pid = -targets->targets[kept].pid;
+            kept++;
+        }
+    }
+
+    targets->count = kept;
+}
+
+void signal_targets_clear(SignalTargets* targets) {
+    if (targets != NULL) {
+        targets->count = 0;
+    }
+}
+
+void signal_targets_destroy(SignalTargets* targets) {
+    if (targets == NULL)
+        return;
+
+    free(targets->targets);
+    memset(targets, 0, sizeof(SignalTargets));
+}
+
+#ifdef SYS_pidfd_open
+static int open_pidfd(int pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int send_pidfd_signal(int pidfd, int signo) {
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, signo, NULL, 0);
+}
+#else
+static int open_pidfd(int pid) {
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+static int send_pidfd_signal(int pidfd, int signo) {
+    (void)pidfd;
+    (void)signo;
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+// Whether pid still names the process that started at start_time.
+static bool same_process(int pid, unsigned long long start_time) {
+    ProcessInfo process = {.pid = pid};
+
+    if (!read_process_info(NULL, PROC_PARSER_STAT, &process))
+        return false;
+
+    return start_time == 0 || process.start_time == start_time;
+}
+
+static void count_failure(SignalResult* result, int error) {
+    if (error == ESRCH) {
+        result->gone++;
+        return;
+    }
+
+    if (result->failed++ == 0) {
+        result->error = error;
+    }
+}
+
+SignalResult signal_send(const SignalTarget* targets, size_t count,
+                         int signo) {
+    SignalResult result = {0};
+    bool         pidfds = true;
+
+    for (size_t i = 0; i < count && targets != NULL; i++) {
+        int pid   = targets[i].pid;
+        int pidfd = pidfds ? open_pidfd(pid) : -1;
+
+        if (pidfd < 0 && pidfds && errno == ENOSYS) {
+            pidfds = false;
+        }
+
+        if (pidfd < 0 && pidfds) {
+            count_failure(&result, errno);
+            continue;
+        }
+
+        // Once pinned, the descriptor keeps referring to this PID's process
+        // even if it exits and the PID is reused, so a start time read
+        // afterwards that still matches proves it is the one in the
+        // snapshot.
+        if (!same_process(pid, targets[i].start_time)) {
+            result.gone++;
+        } else if ((pidfds ? send_pidfd_signal(pidfd, signo)
+                           : kill(pid, signo)) == 0) {
+            result.sent++;
+        } else {
+            count_failure(&result, errno);
+        }
+
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef LTOP_SIGNALS_H
+#define LTOP_SIGNALS_H
+
+#include "table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A process to signal. The start time tells it apart from a later process
+// that was given the same PID.
+typedef struct {
+    int                pid;
+    unsigned long long start_time; // clock ticks after boot, 0 if unknown
+} SignalTarget;
+
+// Tagged processes, sorted by PID.
+typedef struct {
+    SignalTarget* targets;
+    size_t        count;
+    size_t        capacity;
+} SignalTargets;
+
+// What became of one signal_send.
+typedef struct {
+    size_t sent;
+    size_t gone;   // exited, or their PID now names another process
+    size_t failed; // refused, such as another user's processes
+    int    error;  // errno of the first failure
+} SignalResult;
+
+// Tags the process, or untags it if it is tagged. Returns false if the set
+// could not grow.
+bool signal_targets_toggle(SignalTargets* targets, int pid,
+                           unsigned long long start_time);
+bool signal_targets_contains(const SignalTargets* targets, int pid,
+                             unsigned long long start_time);
+
+// Untags the processes that are not among the process rows of table.
+void signal_targets_retain(SignalTargets* targets, const ProcessTable* table);
+
+void signal_targets_clear(SignalTargets* targets);
+void signal_targets_destroy(SignalTargets* targets);
+
+// Sends signo to every target in one pass. Each PID is pinned with
+// pidfd_open and the start time read back from /proc before
+// pidfd_send_signal, so a PID that was recycled since the snapshot is
+// skipped as gone instead of signalled. Targets with an unknown start time
+// are signalled unverified. Kernels without pidfds fall back to kill after
+// the same check, which leaves a short window for reuse.
+SignalResult signal_send(const SignalTarget* targets, size_t count,
+                         int signo);
+
+#endif
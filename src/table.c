@@ -0,0 +1,246 @@
+#include "table.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_ARENA_INITIAL_SIZE (INITIAL_CAPACITY_SIZE * 16)
+
+static bool grow_column(void** column, size_t element_size, size_t capacity) {
+    void* grown = realloc(*column, capacity * element_size);
+
+    if (grown == NULL)
+        return false;
+
+    *column = grown;
+    return true;
+}
+
+static bool process_table_reserve(ProcessTable* table, size_t size) {
+    if (size <= table->capacity)
+        return true;
+
+    size_t new_capacity =
+        table->capacity > 0 ? table->capacity : INITIAL_CAPACITY_SIZE;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    // Columns that were already grown keep their new size if a later one
+    // fails; capacity is only raised once all of them fit.
+    if (!grow_column((void**)&table->pids, sizeof(*table->pids),
+                     new_capacity) ||
+        !grow_column((void**)&table->states, sizeof(*table->states),
+                     new_capacity) ||
+        !grow_column((void**)&table->rss_kb, sizeof(*table->rss_kb),
+                     new_capacity) ||
+        !grow_column((void**)&table->cpu_tenths, sizeof(*table->cpu_tenths),
+                     new_capacity) ||
+        !grow_column((void**)&table->name_offsets,
+                     sizeof(*table->name_offsets), new_capacity) ||
+        !grow_column((void**)&table->start_times, sizeof(*table->start_times),
+                     new_capacity) ||
+        !grow_column((void**)&table->cpu_ticks, sizeof(*table->cpu_ticks),
+                     new_capacity) ||
+        !grow_column((void**)&table->ids, sizeof(*table->ids), new_capacity) ||
+        !grow_column((void**)&table->tgids, sizeof(*table->tgids),
+                     new_capacity) ||
+        !grow_column((void**)&table->ppids, sizeof(*table->ppids),
+                     new_capacity) ||
+        !grow_column((void**)&table->memory, sizeof(*table->memory),
+                     new_capacity) ||
+        !grow_column((void**)&table->cgroups, sizeof(*table->cgroups),
+                     new_capacity)) {
+        return false;
+    }
+
+    table->capacity = new_capacity;
+    return true;
+}
+
+bool name_arena_reserve(NameArena* arena, size_t size) {
+    if (size > UINT32_MAX)
+        return false;
+
+    if (size <= arena->capacity)
+        return true;
+
+    size_t new_capacity =
+        arena->capacity > 0 ? arena->capacity : NAME_ARENA_INITIAL_SIZE;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    char* grown = realloc(arena->data, new_capacity);
+    if (grown == NULL)
+        return false;
+
+    arena->data     = grown;
+    arena->capacity = new_capacity;
+
+    return true;
+}
+
+bool name_arena_append(NameArena* arena, const char* name, uint32_t* offset) {
+    size_t len = strlen(name) + 1;
+
+    if (!name_arena_reserve(arena, arena->size + len))
+        return false;
+
+    memcpy(arena->data + arena->size, name, len);
+    *offset = (uint32_t)arena->size;
+    arena->size += len;
+
+    return true;
+}
+
+void name_arena_destroy(NameArena* arena) {
+    if (arena == NULL)
+        return;
+
+    free(arena->data);
+    memset(arena, 0, sizeof(NameArena));
+}
+
+void process_table_destroy(ProcessTable* table) {
+    if (table == NULL)
+        return;
+
+    free(table->pids);
+    free(table->states);
+    free(table->rss_kb);
+    free(table->cpu_tenths);
+    free(table->name_offsets);
+    free(table->start_times);
+    free(table->cpu_ticks);
+    free(table->ids);
+    free(table->tgids);
+    free(table->ppids);
+    free(table->memory);
+    free(table->cgroups);
+    free(table->names.data);
+    free(table->folded_names.data);
+    memset(table, 0, sizeof(ProcessTable));
+}
+
+void process_table_clear(ProcessTable* table) {
+    if (table == NULL)
+        return;
+
+    table->count             = 0;
+    table->names.size        = 0;
+    table->folded_names.size = 0;
+}
+
+bool process_table_append(ProcessTable* table, const ProcessInfo* process) {
+    if (table == NULL || process == NULL)
+        return false;
+
+    if (!process_table_reserve(table, table->count + 1))
+        return false;
+
+    size_t row = table->count;
+
+    if (!name_arena_append(&table->names, process->name,
+                           &table->name_offsets[row]))
+        return false;
+
+    table->pids[row]        = process->pid;
+    table->states[row]      = process->state;
+    table->rss_kb[row]      = process->vm_rss_kb;
+    table->cpu_tenths[row]  = process->cpu_tenths;
+    table->start_times[row] = process->start_time;
+    table->cpu_ticks[row]   = process->cpu_ticks;
+    table->ids[row]         = (uint32_t)row;
+    table->tgids[row]       = process->tgid;
+    table->ppids[row]       = process->ppid;
+    table->memory[row]      = process->memory;
+    table->cgroups[row]     = process->cgroup;
+    table->count++;
+
+    return true;
+}
+
+bool process_table_append_table(ProcessTable*       table,
+                                const ProcessTable* rows) {
+    if (table == NULL || rows == NULL)
+        return false;
+
+    if (rows->count == 0)
+        return true;
+
+    if (!process_table_reserve(table, table->count + rows->count) ||
+        !name_arena_reserve(&table->names, table->names.size + rows->names.size))
+        return false;
+
+    size_t   base        = table->count;
+    uint32_t name_offset = (uint32_t)table->names.size;
+
+    memcpy(table->pids + base, rows->pids, rows->count * sizeof(*rows->pids));
+    memcpy(table->states + base, rows->states,
+           rows->count * sizeof(*rows->states));
+    memcpy(table->rss_kb + base, rows->rss_kb,
+           rows->count * sizeof(*rows->rss_kb));
+    memcpy(table->cpu_tenths + base, rows->cpu_tenths,
+           rows->count * sizeof(*rows->cpu_tenths));
+    memcpy(table->start_times + base, rows->start_times,
+           rows->count * sizeof(*rows->start_times));
+    memcpy(table->cpu_ticks + base, rows->cpu_ticks,
+           rows->count * sizeof(*rows->cpu_ticks));
+    memcpy(table->tgids + base, rows->tgids,
+           rows->count * sizeof(*rows->tgids));
+    memcpy(table->ppids + base, rows->ppids,
+           rows->count * sizeof(*rows->ppids));
+    memcpy(table->memory + base, rows->memory,
+           rows->count * sizeof(*rows->memory));
+    memcpy(table->cgroups + base, rows->cgroups,
+           rows->count * sizeof(*rows->cgroups));
+
+    for (size_t i = 0; i < rows->count; i++) {
+        table->name_offsets[base + i] = rows->name_offsets[i] + name_offset;
+        table->ids[base + i]          = (uint32_t)(base + i);
+    }
+
+    memcpy(table->names.data + table->names.size, rows->names.data,
+           rows->names.size);
+    table->names.size += rows->names.size;
+    table->count += rows->count;
+
+    return true;
+}
+
+bool process_table_fold_names(ProcessTable* table) {
+    if (table == NULL ||
+        !name_arena_reserve(&table->folded_names, table->names.size))
+        return false;
+
+    // Names are ASCII for all but a few processes, and folding byte by byte
+    // keeps every offset valid for both arenas.
+    for (size_t i = 0; i < table->names.size; i++) {
+        table->folded_names.data[i] =
+            (char)tolower((unsigned char)table->names.data[i]);
+    }
+    table->folded_names.size = table->names.size;
+
+    return true;
+}
+
+void process_table_get(const ProcessTable* table, size_t index,
+                       ProcessInfo* process) {
+    if (table == NULL || process == NULL || index >= table->count)
+        return;
+
+    process->pid        = table->pids[index];
+    process->tgid       = table->tgids[index];
+    process->ppid       = table->ppids[index];
+    process->state      = table->states[index];
+    process->vm_rss_kb  = table->rss_kb[index];
+    process->start_time = table->start_times[index];
+    process->cpu_ticks  = table->cpu_ticks[index];
+    process->cpu_tenths = table->cpu_tenths[index];
+    process->memory     = table->memory[index];
+    process->cgroup     = table->cgroups[index];
+    snprintf(process->name, sizeof(process->name), "%s",
+             process_table_name(table, index));
+}
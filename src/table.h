@@ -0,0 +1,81 @@
+#ifndef LTOP_TABLE_H
+#define LTOP_TABLE_H
+
+#include "proc.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Process names stored back to back as NUL-terminated strings and referenced
+// by byte offset, so rows carry a 4-byte offset instead of a name buffer.
+typedef struct {
+    char*  data;
+    size_t size;
+    size_t capacity;
+} NameArena;
+
+// Column-oriented process table. The hot columns (pid, state, RSS, %CPU,
+// name offset) are dense arrays that sorting, filtering and rendering scan;
+// names live in the arena, and start times, CPU tick counters, ids, owning
+// processes, parents, memory detail and cgroups, only needed to identify a
+// process, to compute its usage, to place it in the tree or for optional
+// columns, sit in their own columns.
+//
+// The table is owned by the caller and refilled in place by
+// collect_processes. Capacity is kept across refreshes, so a steady-state
+// scan performs no allocation.
+struct ProcessTable {
+    int*           pids;
+    char*          states;
+    unsigned long* rss_kb;
+    unsigned int*  cpu_tenths;
+    uint32_t*      name_offsets;
+
+    unsigned long long* start_times;
+    unsigned long long* cpu_ticks;
+    uint32_t*           ids; // stable identity: model record slot, else row
+    int*                tgids; // owning process of a thread row, else 0
+    int*                ppids;
+    MemoryDetail*       memory; // smaps_rollup figures, kept by the model
+    uint32_t*           cgroups; // the same, see CgroupSet
+    NameArena           names;
+    NameArena           folded_names; // see process_table_fold_names
+
+    size_t count;
+    size_t capacity;
+};
+
+void name_arena_destroy(NameArena* arena);
+bool name_arena_reserve(NameArena* arena, size_t size);
+// Copies name, including its terminator, and stores where it landed.
+bool name_arena_append(NameArena* arena, const char* name, uint32_t* offset);
+
+void process_table_destroy(ProcessTable* table);
+void process_table_clear(ProcessTable* table);
+bool process_table_append(ProcessTable* table, const ProcessInfo* process);
+
+// Appends every row of rows, rebasing its name offsets onto table's arena.
+bool process_table_append_table(ProcessTable*       table,
+                                const ProcessTable* rows);
+
+// Fills folded_names with a lowercase copy of names, at the same offsets,
+// for filters that ignore case. The copy only holds until the table is
+// changed again.
+bool process_table_fold_names(ProcessTable* table);
+
+// Copies row index back into a standalone record.
+void process_table_get(const ProcessTable* table, size_t index,
+                       ProcessInfo* process);
+
+static inline const char* process_table_name(const ProcessTable* table,
+                                             size_t              index) {
+    return table->names.data + table->name_offsets[index];
+}
+
+static inline const char* process_table_folded_name(const ProcessTable* table,
+                                                    size_t index) {
+    return table->folded_names.data + table->name_offsets[index];
+}
+
+#endif
@@ -0,0 +1,1097 @@
+#include "view.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rows of up to this size are insertion sorted before merging.
+#define SORT_RUN_LENGTH       32
+// Shifts allowed per row before the repair pass gives up on a reused order
+// and falls back to a merge sort.
+#define SORT_REPAIR_BUDGET    8
+#define SORT_REPAIR_MIN_MOVES 64
+#define VIEW_NO_ROW           UINT32_MAX
+// PIDs stay below PID_MAX_LIMIT (2^22), so longer prefixes match nothing.
+#define PID_PREFIX_MAX_DIGITS 7
+
+typedef struct {
+    const ProcessTable* table;
+    SortKey             key;
+    bool                descending;
+    const uint32_t*     group_rows; // NULL unless thread rows are shown
+} SortContext;
+
+static int compare_values(unsigned long a, unsigned long b) {
+    return (a > b) - (a < b);
+}
+
+// Total order: ties on the sort key fall back to the PID, so equal rows
+// never swap places between refreshes.
+static int compare_rows(const SortContext* ctx, uint32_t a, uint32_t b) {
+    const ProcessTable* table  = ctx->table;
+    int                 result = 0;
+
+    // A thread sorts as its process, after which the process comes first.
+    if (ctx->group_rows != NULL) {
+        uint32_t group_a = ctx->group_rows[a];
+        uint32_t group_b = ctx->group_rows[b];
+
+        if (group_a != group_b) {
+            a = group_a;
+            b = group_b;
+        } else if (a != b && (a == group_a || b == group_b)) {
+            return a == group_a ? -1 : 1;
+        }
+    }
+
+    switch (ctx->key) {
+        case SORT_BY_NAME:
+            result = strcmp(process_table_name(table, a),
+                            process_table_name(table, b));
+            break;
+
+        case SORT_BY_STATE:
+            result = compare_values((unsigned char)table->states[a],
+                                    (unsigned char)table->states[b]);
+            break;
+
+        case SORT_BY_RSS:
+            result = compare_values(table->rss_kb[a], table->rss_kb[b]);
+            break;
+
+        case SORT_BY_CPU:
+            result = compare_values(table->cpu_tenths[a], table->cpu_tenths[b]);
+            break;
+
+        default:
+            break;
+    }
+
+    if (result == 0) {
+        result = compare_values((unsigned long)table->pids[a],
+                                (unsigned long)table->pids[b]);
+    }
+
+    return ctx->descending ? -result : result;
+}
+
+// Insertion sort that stops after budget shifts. O(n + inversions), so it
+// is cheap exactly when the input is already nearly sorted. Returns false if
+// it ran out of budget; rows is then a permutation of its input.
+static bool insertion_sort(const SortContext* ctx, uint32_t* rows, size_t count,
+                           size_t budget) {
+    size_t moves = 0;
+
+    for (size_t i = 1; i < count; i++) {
+        uint32_t row = rows[i];
+        size_t   j   = i;
+
+        while (j > 0 && compare_rows(ctx, rows[j - 1], row) > 0) {
+            rows[j] = rows[j - 1];
+            j--;
+
+            if (++moves > budget) {
+                rows[j] = row;
+                return false;
+            }
+        }
+
+        rows[j] = row;
+    }
+
+    return true;
+}
+
+static void merge_runs(const SortContext* ctx, const uint32_t* src,
+                       uint32_t* dst, size_t begin, size_t middle,
+                       size_t end) {
+    size_t left  = begin;
+    size_t right = middle;
+    size_t out   = begin;
+
+    // Runs that are already in order are copied without comparing.
+    if (left < middle && right < end &&
+        compare_rows(ctx, src[middle - 1], src[middle]) <= 0) {
+        memcpy(dst + begin, src + begin, (end - begin) * sizeof(uint32_t));
+        return;
+    }
+
+    while (left < middle && right < end) {
+        // <= keeps equal elements in input order (stable).
+        if (compare_rows(ctx, src[left], src[right]) <= 0) {
+            dst[out++] = src[left++];
+        } else {
+            dst[out++] = src[right++];
+        }
+    }
+
+    while (left < middle) {
+        dst[out++] = src[left++];
+    }
+    while (right < end) {
+        dst[out++] = src[right++];
+    }
+}
+
+// Stable bottom-up merge sort; scratch must hold count entries.
+static void merge_sort(const SortContext* ctx, uint32_t* rows,
+                       uint32_t* scratch, size_t count) {
+    for (size_t begin = 0; begin < count; begin += SORT_RUN_LENGTH) {
+        size_t length =
+            count - begin < SORT_RUN_LENGTH ? count - begin : SORT_RUN_LENGTH;
+        insertion_sort(ctx, rows + begin, length, (size_t)-1);
+    }
+
+    uint32_t* src = rows;
+    uint32_t* dst = scratch;
+
+    for (size_t width = SORT_RUN_LENGTH; width < count; width *= 2) {
+        for (size_t begin = 0; begin < count; begin += 2 * width) {
+            size_t middle = begin + width < count ? begin + width : count;
+            size_t end = begin + 2 * width < count ? begin + 2 * width : count;
+            merge_runs(ctx, src, dst, begin, middle, end);
+        }
+
+        uint32_t* swap = src;
+        src            = dst;
+        dst            = swap;
+    }
+
+    if (src != rows) {
+        memcpy(rows, src, count * sizeof(uint32_t));
+    }
+}
+
+static void sift_down(const SortContext* ctx, uint32_t* heap, size_t count,
+                      size_t i) {
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= count)
+            return;
+
+        if (child + 1 < count &&
+            compare_rows(ctx, heap[child + 1], heap[child]) > 0) {
+            child++;
+        }
+        if (compare_rows(ctx, heap[i], heap[child]) >= 0)
+            return;
+
+        uint32_t swap = heap[i];
+        heap[i]       = heap[child];
+        heap[child]   = swap;
+        i             = child;
+    }
+}
+
+// Moves the limit first rows in sort order to the front of rows, in
+// O(count log limit): rows[0, limit) is kept as a heap whose root is the
+// last of the rows selected so far, and a row that sorts before the root
+// takes its place. The rest of rows keeps the rows that were pushed out.
+static void select_top(const SortContext* ctx, uint32_t* rows, size_t count,
+                       size_t limit) {
+    for (size_t i = limit / 2; i-- > 0;) {
+        sift_down(ctx, rows, limit, i);
+    }
+
+    for (size_t i = limit; i < count; i++) {
+        if (compare_rows(ctx, rows[i], rows[0]) < 0) {
+            uint32_t swap = rows[0];
+            rows[0]       = rows[i];
+            rows[i]       = swap;
+            sift_down(ctx, rows, limit, 0);
+        }
+    }
+}
+
+static bool grow_array(void** array, size_t element_size, size_t* capacity,
+                       size_t size) {
+    if (size <= *capacity)
+        return true;
+
+    size_t new_capacity = *capacity > 0 ? *capacity : INITIAL_CAPACITY_SIZE;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    void* grown = realloc(*array, new_capacity * element_size);
+    if (grown == NULL)
+        return false;
+
+    *array    = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool view_reserve(ProcessView* view, size_t count, size_t id_limit) {
+    size_t capacity = view->capacity;
+
+    if (!grow_array((void**)&view->rows, sizeof(uint32_t), &capacity, count))
+        return false;
+
+    size_t previous_capacity = view->capacity;
+    size_t scratch_capacity  = view->capacity;
+
+    size_t group_capacity    = view->capacity;
+    size_t matched_capacity  = view->capacity;
+
+    if (!grow_array((void**)&view->previous_ids, sizeof(uint32_t),
+                    &previous_capacity, capacity) ||
+        !grow_array((void**)&view->scratch, sizeof(uint32_t),
+                    &scratch_capacity, capacity) ||
+        !grow_array((void**)&view->group_rows, sizeof(uint32_t),
+                    &group_capacity, capacity) ||
+        !grow_array((void**)&view->matched, sizeof(uint32_t),
+                    &matched_capacity, capacity))
+        return false;
+
+    view->capacity = capacity;
+
+    size_t id_capacity = view->id_capacity;
+    size_t row_capacity = view->id_capacity;
+
+    if (!grow_array((void**)&view->id_stamps, sizeof(unsigned int),
+                    &id_capacity, id_limit) ||
+        !grow_array((void**)&view->row_of_id, sizeof(uint32_t), &row_capacity,
+                    id_capacity))
+        return false;
+
+    // Fresh stamps must not match any stamp in use.
+    memset(view->id_stamps + view->id_capacity, 0,
+           (id_capacity - view->id_capacity) * sizeof(unsigned int));
+    view->id_capacity = id_capacity;
+
+    return true;
+}
+
+static void filter_clear(ViewFilter* filter) {
+    for (size_t i = 0; i < filter->term_count; i++) {
+        if (filter->terms[i].compiled) {
+            regfree(&filter->terms[i].regex);
+        }
+    }
+
+    memset(filter, 0, sizeof(ViewFilter));
+}
+
+static bool has_prefix(const char* text, size_t length, const char* prefix) {
+    size_t prefix_length = strlen(prefix);
+
+    return length >= prefix_length && memcmp(text, prefix, prefix_length) == 0;
+}
+
+// Fills in the value of a term whose kind and extent are set. Returns false
+// if it cannot be matched against; an empty value is not worth matching
+// either, but is not an error.
+static bool parse_term(ViewFilter* filter, FilterTerm* term, bool* keep) {
+    const char* value = filter->query + term->start;
+
+    *keep = term->length > 0;
+    if (!*keep)
+        return true;
+
+    switch (term->kind) {
+        case FILTER_TERM_PID:
+            // No PID starts with a zero.
+            if (value[0] == '0' || term->length > PID_PREFIX_MAX_DIGITS)
+                break;
+
+            for (size_t i = 0; i < term->length; i++) {
+                if (!isdigit((unsigned char)value[i]))
+                    break;
+                term->pid_prefix = term->pid_prefix * 10 + (value[i] - '0');
+
+                if (i + 1 == term->length)
+                    return true;
+            }
+            break;
+
+        case FILTER_TERM_REGEX: {
+            char pattern[VIEW_FILTER_QUERY_MAX];
+            snprintf(pattern, sizeof(pattern), "%.*s", (int)term->length,
+                     value);
+
+            term->compiled = regcomp(&term->regex, pattern,
+                                     REG_EXTENDED | REG_ICASE | REG_NOSUB) == 0;
+            if (term->compiled)
+                return true;
+            break;
+        }
+
+        default:
+            return true;
+    }
+
+    *keep = false;
+    return false;
+}
+
+// Splits query into terms. Returns false if one was left out as invalid.
+static bool filter_parse(ViewFilter* filter, const char* query) {
+    static const struct {
+        const char*    prefix;
+        FilterTermKind kind;
+    } prefixes[] = {
+        {"pid:", FILTER_TERM_PID},
+        {"state:", FILTER_TERM_STATE},
+        {"re:", FILTER_TERM_REGEX},
+    };
+
+    filter_clear(filter);
+    snprintf(filter->query, sizeof(filter->query), "%s", query);
+
+    size_t length = strlen(filter->query);
+    bool   ok     = true;
+
+    for (size_t i = 0; i < length; i++) {
+        filter->folded[i] = filter->query[i] == ' '
+                                ? '\0'
+                                : (char)tolower((unsigned char)filter->query[i]);
+    }
+
+    for (size_t i = 0; i < length;) {
+        if (filter->query[i] == ' ') {
+            i++;
+            continue;
+        }
+
+        size_t end = i;
+        while (end < length && filter->query[end] != ' ') {
+            end++;
+        }
+
+        if (filter->term_count == VIEW_FILTER_TERM_MAX)
+            break;
+
+        FilterTerm* term = &filter->terms[filter->term_count];
+        *term            = (FilterTerm){
+            .kind = FILTER_TERM_NAME, .start = i, .length = end - i};
+
+        for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+            if (has_prefix(filter->query + i, end - i, prefixes[p].prefix)) {
+                size_t skip = strlen(prefixes[p].prefix);
+
+                term->kind = prefixes[p].kind;
+                term->start += skip;
+                term->length -= skip;
+                break;
+            }
+        }
+
+        bool keep;
+        ok = parse_term(filter, term, &keep) && ok;
+        if (keep) {
+            filter->term_count++;
+        }
+
+        i = end;
+    }
+
+    return ok;
+}
+
+// Whether every process matching next also matches previous, each term of
+// previous being kept as it was or, for a name or a PID, extended.
+static bool filter_refines(const ViewFilter* next,
+                           const ViewFilter* previous) {
+    if (next->term_count < previous->term_count ||
+        next->cgroup != previous->cgroup)
+        return false;
+
+    for (size_t i = 0; i < previous->term_count; i++) {
+        const FilterTerm* old  = &previous->terms[i];
+        const FilterTerm* term = &next->terms[i];
+
+        if (term->kind != old->kind || term->start != old->start ||
+            term->length < old->length ||
+            memcmp(next->query + term->start, previous->query + old->start,
+                   old->length) != 0)
+            return false;
+
+        if (term->length > old->length && old->kind != FILTER_TERM_NAME &&
+            old->kind != FILTER_TERM_PID)
+            return false;
+    }
+
+    return true;
+}
+
+static bool pid_has_prefix(int pid, int prefix, size_t digits) {
+    int lowest = 1;
+    for (size_t i = 1; i < digits; i++) {
+        lowest *= 10;
+    }
+
+    if (pid < lowest)
+        return false;
+
+    while (pid >= lowest * 10) {
+        pid /= 10;
+    }
+
+    return pid == prefix;
+}
+
+static bool filter_matches(const ViewFilter* filter, const ProcessTable* table,
+                           size_t row) {
+    if (filter->cgroup != 0 && table->cgroups[row] != filter->cgroup)
+        return false;
+
+    for (size_t i = 0; i < filter->term_count; i++) {
+        const FilterTerm* term  = &filter->terms[i];
+        const char*       value = filter->query + term->start;
+        bool              match = false;
+
+        switch (term->kind) {
+            case FILTER_TERM_NAME:
+                match = strstr(process_table_folded_name(table, row),
+                               filter->folded + term->start) != NULL;
+                break;
+
+            case FILTER_TERM_REGEX:
+                match = regexec(&term->regex, process_table_name(table, row),
+                                0, NULL, 0) == 0;
+                break;
+
+            case FILTER_TERM_PID:
+                match = pid_has_prefix(table->pids[row], term->pid_prefix,
+                                       term->length);
+                break;
+
+            case FILTER_TERM_STATE:
+                match = memchr(value, table->states[row], term->length) != NULL;
+                break;
+        }
+
+        if (!match)
+            return false;
+    }
+
+    return true;
+}
+
+// Refills view->matched for table. A narrowed filter only has to look at
+// the rows the previous one matched, and an unchanged one at none.
+static void match_rows(ProcessView* view, const ProcessTable* table,
+                       bool same_rows) {
+    bool   reuse = same_rows && view->matched_valid;
+    size_t count = 0;
+
+    if (reuse && !view->filter_stale)
+        return;
+
+    if (reuse && view->filter_narrows) {
+        for (size_t i = 0; i < view->matched_count; i++) {
+            uint32_t row = view->matched[i];
+
+            if (filter_matches(&view->filter, table, row)) {
+                view->matched[count++] = row;
+            }
+        }
+    } else {
+        for (size_t row = 0; row < table->count; row++) {
+            if (table->tgids[row] == 0 &&
+                filter_matches(&view->filter, table, row)) {
+                view->matched[count++] = (uint32_t)row;
+            }
+        }
+    }
+
+    view->matched_count = count;
+    view->matched_valid = true;
+    view->filter_stale  = false;
+}
+
+bool process_view_set_filter(ProcessView* view, const char* query) {
+    if (view == NULL || query == NULL)
+        return false;
+
+    // Only the query and the terms' extents are compared, so the copy's
+    // patterns are never used or freed.
+    ViewFilter previous = view->filter;
+    bool       ok       = filter_parse(&view->filter, query);
+
+    view->filter.cgroup = previous.cgroup;
+
+    // Several key presses may arrive before the next update, so the
+    // refinement has to hold against the filter that was last matched.
+    view->filter_narrows = filter_refines(&view->filter, &previous) &&
+                           (view->filter_narrows || !view->filter_stale);
+    view->filter_stale   = true;
+    return ok;
+}
+
+void process_view_set_cgroup(ProcessView* view, uint32_t cgroup) {
+    if (view == NULL || view->filter.cgroup == cgroup)
+        return;
+
+    view->filter.cgroup  = cgroup;
+    view->filter_narrows = false;
+    view->filter_stale   = true;
+}
+
+void process_view_destroy(ProcessView* view) {
+    if (view == NULL)
+        return;
+
+    filter_clear(&view->filter);
+    free(view->matched);
+    free(view->rows);
+    free(view->previous_ids);
+    free(view->scratch);
+    free(view->row_of_id);
+    free(view->id_stamps);
+    free(view->expanded);
+    free(view->expanded_rows);
+    free(view->group_rows);
+    free(view->tree_rows.slots);
+    free(view->tree_rows.start_times);
+    free(view->tree_rows.parents);
+    free(view->tree_rows.children);
+    free(view->tree_rows.siblings);
+    free(view->tree_rows.totals);
+    free(view->tree_rows.order);
+    free(view->tree_rows.order_depths);
+    free(view->tree_rows.order_flags);
+    free(view->tree_rows.depths);
+    free(view->tree_rows.flags);
+    free(view->tree_rows.subtree_rss_kb);
+    free(view->tree_rows.collapsed);
+    memset(view, 0, sizeof(ProcessView));
+}
+
+void process_view_set_sort(ProcessView* view, SortKey key, bool descending) {
+    if (view == NULL || key >= SORT_KEY_COUNT)
+        return;
+
+    view->key            = key;
+    view->descending     = descending;
+    view->previous_valid = false;
+}
+
+void process_view_set_limit(ProcessView* view, size_t limit) {
+    if (view == NULL)
+        return;
+
+    view->limit = limit;
+}
+
+static int compare_pids(const void* a, const void* b) {
+    int left  = *(const int*)a;
+    int right = *(const int*)b;
+
+    return (left > right) - (left < right);
+}
+
+// Index of pid in the sorted pids, or count if it is not there.
+static size_t find_pid(const int* pids, size_t count, int pid) {
+    if (count == 0)
+        return 0;
+
+    const int* found = bsearch(&pid, pids, count, sizeof(int), compare_pids);
+
+    return found != NULL ? (size_t)(found - pids) : count;
+}
+
+// Removes pid from the sorted pids, or inserts it if it is not there; room
+// for one more must have been made.
+static void toggle_pid(int* pids, size_t* count, int pid) {
+    size_t index = find_pid(pids, *count, pid);
+
+    if (index < *count) {
+        memmove(pids + index, pids + index + 1,
+                (*count - index - 1) * sizeof(int));
+        (*count)--;
+        return;
+    }
+
+    size_t position = 0;
+    while (position < *count && pids[position] < pid) {
+        position++;
+    }
+
+    memmove(pids + position + 1, pids + position,
+            (*count - position) * sizeof(int));
+    pids[position] = pid;
+    (*count)++;
+}
+
+static size_t find_expanded(const ProcessView* view, int pid) {
+    return find_pid(view->expanded, view->expanded_count, pid);
+}
+
+bool process_view_is_expanded(const ProcessView* view, int pid) {
+    return view != NULL && find_expanded(view, pid) < view->expanded_count;
+}
+
+bool process_view_toggle_expanded(ProcessView* view, int pid) {
+    if (view == NULL)
+        return false;
+
+    size_t capacity = view->expanded_capacity;
+    size_t rows_capacity = view->expanded_capacity;
+
+    if (!grow_array((void**)&view->expanded, sizeof(int), &capacity,
+                    view->expanded_count + 1) ||
+        !grow_array((void**)&view->expanded_rows, sizeof(uint32_t),
+                    &rows_capacity, capacity))
+        return false;
+
+    view->expanded_capacity = capacity;
+    toggle_pid(view->expanded, &view->expanded_count, pid);
+    return true;
+}
+
+void process_view_set_tree(ProcessView* view, bool tree) {
+    if (view == NULL)
+        return;
+
+    view->tree = tree;
+}
+
+bool process_view_toggle_collapsed(ProcessView* view, int pid) {
+    if (view == NULL)
+        return false;
+
+    ViewTree* tree = &view->tree_rows;
+
+    if (!grow_array((void**)&tree->collapsed, sizeof(int),
+                    &tree->collapsed_capacity, tree->collapsed_count + 1))
+        return false;
+
+    toggle_pid(tree->collapsed, &tree->collapsed_count, pid);
+    return true;
+}
+
+// Fills group_rows for the thread rows of expanded processes: each maps to
+// its process's row, as every process row maps to itself, while threads of
+// other processes map to VIEW_NO_ROW. Returns whether any thread is shown.
+static bool group_threads(ProcessView* view, const ProcessTable* table) {
+    view->thread_count = 0;
+
+    if (view->expanded_count == 0)
+        return false;
+
+    for (size_t i = 0; i < view->expanded_count; i++) {
+        view->expanded_rows[i] = VIEW_NO_ROW;
+    }
+
+    for (size_t row = 0; row < table->count; row++) {
+        if (table->tgids[row] != 0)
+            continue;
+
+        size_t index = find_expanded(view, table->pids[row]);
+        if (index < view->expanded_count) {
+            view->expanded_rows[index] = (uint32_t)row;
+        }
+        view->group_rows[row] = (uint32_t)row;
+    }
+
+    for (size_t row = 0; row < table->count; row++) {
+        if (table->tgids[row] == 0)
+            continue;
+
+        size_t index = find_expanded(view, table->tgids[row]);
+        view->group_rows[row] = index < view->expanded_count
+                                    ? view->expanded_rows[index]
+                                    : VIEW_NO_ROW;
+
+        if (view->group_rows[row] != VIEW_NO_ROW) {
+            view->thread_count++;
+        }
+    }
+
+    return view->thread_count > 0;
+}
+
+// Reallocates array to capacity entries, as grow_array does once it has
+// picked the capacity.
+static bool resize_array(void** array, size_t element_size, size_t capacity) {
+    void* resized = realloc(*array, capacity * element_size);
+
+    if (resized == NULL)
+        return false;
+
+    *array = resized;
+    return true;
+}
+
+static bool tree_reserve(ViewTree* tree, size_t count) {
+    size_t capacity = tree->capacity;
+
+    if (!grow_array((void**)&tree->parents, sizeof(uint32_t), &capacity,
+                    count))
+        return false;
+
+    if (capacity == tree->capacity)
+        return true;
+
+    // The hash is kept at most half full.
+    if (!resize_array((void**)&tree->start_times,
+                      sizeof(*tree->start_times), capacity) ||
+        !resize_array((void**)&tree->children, sizeof(*tree->children),
+                      capacity) ||
+        !resize_array((void**)&tree->siblings, sizeof(*tree->siblings),
+                      capacity) ||
+        !resize_array((void**)&tree->totals, sizeof(*tree->totals),
+                      capacity) ||
+        !resize_array((void**)&tree->order, sizeof(*tree->order), capacity) ||
+        !resize_array((void**)&tree->order_depths,
+                      sizeof(*tree->order_depths), capacity) ||
+        !resize_array((void**)&tree->order_flags, sizeof(*tree->order_flags),
+                      capacity) ||
+        !resize_array((void**)&tree->depths, sizeof(*tree->depths),
+                      capacity) ||
+        !resize_array((void**)&tree->flags, sizeof(*tree->flags), capacity) ||
+        !resize_array((void**)&tree->subtree_rss_kb,
+                      sizeof(*tree->subtree_rss_kb), capacity) ||
+        !resize_array((void**)&tree->slots, sizeof(*tree->slots),
+                      capacity * 2))
+        return false;
+
+    tree->slot_capacity = capacity * 2;
+    tree->capacity      = capacity;
+    return true;
+}
+
+static size_t tree_home(const ViewTree* tree, int pid) {
+    return ((unsigned int)pid * 2654435769u) & (tree->slot_capacity - 1);
+}
+
+// Sorted position of the process pid, or VIEW_TREE_NONE if it is not in
+// the tree.
+static uint32_t tree_find(const ViewTree* tree, int pid) {
+    size_t mask = tree->slot_capacity - 1;
+
+    for (size_t i = tree_home(tree, pid);; i = (i + 1) & mask) {
+        if (tree->slots[i].pid == pid)
+            return tree->slots[i].position;
+        if (tree->slots[i].pid == 0)
+            return VIEW_TREE_NONE;
+    }
+}
+
+// Rearranges the sorted view->rows[0, count) as a tree, leaving out the
+// descendants of collapsed processes, and returns how many rows are left.
+// Each step is a single pass: hashing, finding parents, breaking cycles,
+// linking (backwards, so that every child list comes out in sort order),
+// the walk, the subtree totals, which reach each process after all of its
+// descendants when the walk is replayed backwards, and the listing.
+static size_t build_tree(ProcessView* view, const ProcessTable* table,
+                         size_t count) {
+    ViewTree*       tree  = &view->tree_rows;
+    const uint32_t* rows  = view->rows;
+    size_t          mask  = tree->slot_capacity - 1;
+    uint32_t        roots = VIEW_TREE_NONE;
+
+    memset(tree->slots, 0, tree->slot_capacity * sizeof(TreeSlot));
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t row = rows[i];
+        if (table->tgids[row] != 0)
+            continue;
+
+        size_t slot = tree_home(tree, table->pids[row]);
+        while (tree->slots[slot].pid != 0) {
+            slot = (slot + 1) & mask;
+        }
+
+        tree->slots[slot]    = (TreeSlot){table->pids[row], (uint32_t)i};
+        tree->start_times[i] = table->start_times[row];
+        tree->children[i]    = VIEW_TREE_NONE;
+        tree->totals[i]      = table->rss_kb[row];
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t row = rows[i];
+        if (table->tgids[row] != 0)
+            continue;
+
+        // A parent started before its children. Ordering by start time,
+        // then PID, keeps a reused PID from closing a cycle. Start times
+        // are 0 where they are unknown, and PIDs wrap, so then PPid is
+        // trusted and cycles are broken below.
+        uint32_t           parent = tree_find(tree, table->ppids[row]);
+        unsigned long long born   = tree->start_times[i];
+
+        if (parent != VIEW_TREE_NONE && born != 0 &&
+            tree->start_times[parent] != 0 &&
+            (tree->start_times[parent] > born ||
+             (tree->start_times[parent] == born &&
+              table->pids[rows[parent]] >= table->pids[row]))) {
+            parent = VIEW_TREE_NONE;
+        }
+
+        tree->parents[i] = parent;
+        tree->order[i]   = 0;
+    }
+
+    // Walks up from each process not yet visited, marking the ancestors it
+    // passes with i + 1 in order[], and stops at one visited before. Coming
+    // back to a mark of the same walk means the last link closed a cycle,
+    // which is cut there, so every process is visited once.
+    for (size_t i = 0; i < count; i++) {
+        if (table->tgids[rows[i]] != 0 || tree->order[i] != 0)
+            continue;
+
+        uint32_t mark = (uint32_t)i + 1;
+        uint32_t node = (uint32_t)i;
+
+        tree->order[node] = mark;
+        while (tree->parents[node] != VIEW_TREE_NONE) {
+            uint32_t parent = tree->parents[node];
+
+            if (tree->order[parent] == mark) {
+                tree->parents[node] = VIEW_TREE_NONE;
+                break;
+            }
+            if (tree->order[parent] != 0)
+                break;
+
+            tree->order[parent] = mark;
+            node                = parent;
+        }
+    }
+
+    for (size_t i = count; i-- > 0;) {
+        if (table->tgids[rows[i]] != 0)
+            continue;
+
+        uint32_t  parent = tree->parents[i];
+        uint32_t* head   = parent != VIEW_TREE_NONE ? &tree->children[parent]
+                                                    : &roots;
+
+        tree->siblings[i] = *head;
+        *head             = (uint32_t)i;
+    }
+
+    size_t       order_count = 0;
+    unsigned int depth       = 0;
+
+    for (uint32_t node = roots; node != VIEW_TREE_NONE;) {
+        tree->order[order_count]        = node;
+        tree->order_depths[order_count] = depth;
+        tree->order_flags[order_count++] =
+            (tree->siblings[node] == VIEW_TREE_NONE ? VIEW_TREE_LAST : 0) |
+            (tree->children[node] != VIEW_TREE_NONE ? VIEW_TREE_PARENT : 0);
+
+        if (tree->children[node] != VIEW_TREE_NONE) {
+            node = tree->children[node];
+            depth++;
+            continue;
+        }
+
+        while (node != VIEW_TREE_NONE &&
+               tree->siblings[node] == VIEW_TREE_NONE) {
+            node = tree->parents[node];
+            depth--;
+        }
+        if (node != VIEW_TREE_NONE) {
+            node = tree->siblings[node];
+        }
+    }
+
+    for (size_t i = order_count; i-- > 0;) {
+        uint32_t node = tree->order[i];
+
+        if (tree->parents[node] != VIEW_TREE_NONE) {
+            tree->totals[tree->parents[node]] += tree->totals[node];
+        }
+    }
+
+    uint32_t* shown       = view->scratch;
+    size_t    shown_count = 0;
+
+    view->thread_count = 0;
+    tree->hidden_count = 0;
+
+    for (size_t i = 0; i < order_count; i++) {
+        uint32_t     node  = tree->order[i];
+        unsigned int flags = tree->order_flags[i];
+
+        if ((flags & VIEW_TREE_PARENT) && tree->collapsed_count > 0 &&
+            find_pid(tree->collapsed, tree->collapsed_count,
+                     table->pids[rows[node]]) < tree->collapsed_count) {
+            flags |= VIEW_TREE_COLLAPSED;
+        }
+
+        tree->depths[shown_count]         = tree->order_depths[i];
+        tree->flags[shown_count]          = (unsigned char)flags;
+        tree->subtree_rss_kb[shown_count] = tree->totals[node];
+        shown[shown_count++]              = rows[node];
+
+        // A process's threads follow it in the sorted rows.
+        for (size_t j = node + 1; j < count && table->tgids[rows[j]] != 0;
+             j++) {
+            tree->depths[shown_count]         = tree->order_depths[i];
+            tree->flags[shown_count]          = 0;
+            tree->subtree_rss_kb[shown_count] = 0;
+            shown[shown_count++]              = rows[j];
+            view->thread_count++;
+        }
+
+        if (flags & VIEW_TREE_COLLAPSED) {
+            unsigned int collapsed_depth = tree->order_depths[i];
+
+            while (i + 1 < order_count &&
+                   tree->order_depths[i + 1] > collapsed_depth) {
+                i++;
+                tree->hidden_count++;
+            }
+        }
+    }
+
+    memcpy(view->rows, shown, shown_count * sizeof(uint32_t));
+    return shown_count;
+}
+
+void process_view_sort_all(ProcessView* view, const ProcessTable* table) {
+    if (view == NULL || table == NULL || view->sorted_count >= view->count)
+        return;
+
+    SortContext ctx = {.table      = table,
+                       .key        = view->key,
+                       .descending = view->descending,
+                       .group_rows = view->grouped ? view->group_rows : NULL};
+
+    merge_sort(&ctx, view->rows + view->sorted_count, view->scratch,
+               view->count - view->sorted_count);
+    if (view->sorted_count > 0) {
+        merge_runs(&ctx, view->rows, view->scratch, 0, view->sorted_count,
+                   view->count);
+        memcpy(view->rows, view->scratch, view->count * sizeof(uint32_t));
+    }
+
+    for (size_t i = 0; i < view->count; i++) {
+        view->previous_ids[i] = table->ids[view->rows[i]];
+    }
+
+    view->sorted_count   = view->count;
+    view->previous_count = view->count;
+    view->previous_valid = true;
+}
+
+bool process_view_update(ProcessView* view, const ProcessTable* table,
+                         bool same_rows) {
+    if (view == NULL || table == NULL)
+        return false;
+
+    size_t   count  = table->count;
+    uint32_t max_id = 0;
+
+    for (size_t row = 0; row < count; row++) {
+        if (table->ids[row] > max_id) {
+            max_id = table->ids[row];
+        }
+    }
+
+    if (!view_reserve(view, count, (size_t)max_id + 1) ||
+        (view->tree && !tree_reserve(&view->tree_rows, count))) {
+        view->count          = 0;
+        view->sorted_count   = 0;
+        view->thread_count   = 0;
+        view->grouped        = false;
+        view->matched_valid  = false;
+        view->previous_valid = false;
+        return false;
+    }
+
+    view->grouped = group_threads(view, table);
+    match_rows(view, table, same_rows);
+
+    SortContext ctx = {.table      = table,
+                       .key        = view->key,
+                       .descending = view->descending,
+                       .group_rows = view->grouped ? view->group_rows : NULL};
+
+    // The rows to show, held in scratch until the sorts below need it: the
+    // matching processes, then the threads of those that are expanded.
+    uint32_t* shown       = view->scratch;
+    size_t    shown_count = view->matched_count;
+
+    memcpy(shown, view->matched, shown_count * sizeof(uint32_t));
+
+    for (size_t row = 0; view->grouped && row < count; row++) {
+        uint32_t group = view->group_rows[row];
+
+        if (table->tgids[row] != 0 && group != VIEW_NO_ROW &&
+            filter_matches(&view->filter, table, group)) {
+            shown[shown_count++] = (uint32_t)row;
+        }
+    }
+
+    view->thread_count = shown_count - view->matched_count;
+
+    // Only the top rows are shown, so selecting them beats ordering all of
+    // them. The partial order says little about the next one, so the
+    // following full update sorts from scratch.
+    if (view->limit > 0 && view->limit < shown_count && !view->tree) {
+        memcpy(view->rows, shown, shown_count * sizeof(uint32_t));
+
+        select_top(&ctx, view->rows, shown_count, view->limit);
+        merge_sort(&ctx, view->rows, view->scratch, view->limit);
+
+        view->count          = shown_count;
+        view->sorted_count   = view->limit;
+        view->previous_valid = false;
+        return true;
+    }
+
+    if (++view->stamp == 0) {
+        memset(view->id_stamps, 0, view->id_capacity * sizeof(unsigned int));
+        view->stamp = 1;
+    }
+
+    for (size_t i = 0; i < shown_count; i++) {
+        view->id_stamps[table->ids[shown[i]]] = view->stamp;
+        view->row_of_id[table->ids[shown[i]]] = shown[i];
+    }
+
+    // Surviving processes keep their previous relative order; anything not
+    // claimed that way is new and goes to the tail.
+    size_t kept = 0;
+
+    if (view->previous_valid) {
+        for (size_t i = 0; i < view->previous_count; i++) {
+            uint32_t id = view->previous_ids[i];
+
+            if (id < view->id_capacity && view->id_stamps[id] == view->stamp) {
+                view->rows[kept++]  = view->row_of_id[id];
+                view->id_stamps[id] = view->stamp - 1;
+            }
+        }
+    }
+
+    size_t total = kept;
+
+    for (size_t i = 0; i < shown_count; i++) {
+        if (view->id_stamps[table->ids[shown[i]]] == view->stamp) {
+            view->rows[total++] = shown[i];
+        }
+    }
+
+    size_t budget = kept * SORT_REPAIR_BUDGET + SORT_REPAIR_MIN_MOVES;
+    if (!insertion_sort(&ctx, view->rows, kept, budget)) {
+        merge_sort(&ctx, view->rows, view->scratch, kept);
+    }
+
+    if (total > kept) {
+        merge_sort(&ctx, view->rows + kept, view->scratch, total - kept);
+
+        if (kept > 0) {
+            merge_runs(&ctx, view->rows, view->scratch, 0, kept, total);
+            memcpy(view->rows, view->scratch, total * sizeof(uint32_t));
+        }
+    }
+
+    for (size_t i = 0; i < total; i++) {
+        view->previous_ids[i] = table->ids[view->rows[i]];
+    }
+
+    view->count          = view->tree ? build_tree(view, table, total) : total;
+    view->sorted_count   = view->count;
+    view->previous_count = total;
+    view->previous_valid = true;
+
+    return true;
+}
@@ -0,0 +1,199 @@
+#ifndef LTOP_VIEW_H
+#define LTOP_VIEW_H
+
+#include "table.h"
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VIEW_FILTER_QUERY_MAX 128
+#define VIEW_FILTER_TERM_MAX  8
+
+typedef enum {
+    SORT_BY_PID,
+    SORT_BY_NAME,
+    SORT_BY_STATE,
+    SORT_BY_RSS,
+    SORT_BY_CPU,
+    SORT_KEY_COUNT
+} SortKey;
+
+typedef enum {
+    FILTER_TERM_NAME,  // WORD: names containing it, ignoring case
+    FILTER_TERM_REGEX, // re:PATTERN: POSIX extended, ignoring case
+    FILTER_TERM_PID,   // pid:DIGITS: PIDs starting with those digits
+    FILTER_TERM_STATE  // state:LETTERS: any of those states
+} FilterTermKind;
+
+typedef struct {
+    FilterTermKind kind;
+    size_t         start;  // the term's value within the query
+    size_t         length;
+    int            pid_prefix; // the digits of a PID term, as a number
+    regex_t        regex;
+    bool           compiled;
+} FilterTerm;
+
+// A parsed filter query: space-separated terms that a process has to match
+// all of. Terms that cannot be parsed (a bad pattern) are left out. A
+// cgroup, set apart from the query, restricts the processes further.
+typedef struct {
+    char       query[VIEW_FILTER_QUERY_MAX];  // as typed
+    char       folded[VIEW_FILTER_QUERY_MAX]; // lowercase, NUL between terms
+    FilterTerm terms[VIEW_FILTER_TERM_MAX];
+    size_t     term_count;
+    uint32_t   cgroup; // ProcessTable::cgroups id to match, 0 for any
+} ViewFilter;
+
+// Tree flags of a process row.
+#define VIEW_TREE_LAST      0x1u // last child of its parent
+#define VIEW_TREE_PARENT    0x2u // has children
+#define VIEW_TREE_COLLAPSED 0x4u // and they are hidden
+#define VIEW_TREE_NONE      UINT32_MAX
+
+typedef struct {
+    int      pid; // 0 marks an empty slot
+    uint32_t position;
+} TreeSlot;
+
+// Processes arranged under their parents. Rebuilt after every sort in time
+// linear in the rows: a PID hash finds each process's parent, children are
+// linked into per-process lists in arrays kept across updates, and a walk
+// without recursion lists them in display order. Siblings keep the sort
+// order. A process whose parent is filtered out, or did not start before
+// it, is a root; subtree totals count collapsed descendants but not the
+// filtered ones.
+typedef struct {
+    TreeSlot* slots;         // open-addressed PID hash of process rows
+    size_t    slot_capacity; // power of two
+
+    // By position in the sorted rows, so that building the tree reads the
+    // table once, in that order.
+    unsigned long long* start_times;
+    uint32_t*           parents;  // VIEW_TREE_NONE at the roots
+    uint32_t*           children; // first child, VIEW_TREE_NONE if none
+    uint32_t*           siblings; // next child of the same parent
+    unsigned long*      totals;   // own RSS plus that of every descendant
+
+    // Positions of every process in tree order, collapsed ones included.
+    uint32_t*      order;
+    unsigned int*  order_depths;
+    unsigned char* order_flags;
+
+    // By display position, as view->rows. A thread row has its process's
+    // depth and no flags.
+    unsigned int*  depths; // 0 at the roots
+    unsigned char* flags;  // VIEW_TREE_*
+    unsigned long* subtree_rss_kb;
+    size_t         capacity;
+
+    int*   collapsed; // sorted PIDs whose descendants are hidden
+    size_t collapsed_count;
+    size_t collapsed_capacity;
+    size_t hidden_count; // processes left out below collapsed ones
+} ViewTree;
+
+// The order in which the UI shows the rows of a snapshot. Between
+// snapshots only a few processes appear, exit or move, so each update
+// starts from the previous order (matched through the table's stable ids)
+// and repairs it with an adaptive sort instead of sorting from scratch.
+//
+// Thread rows are only shown for expanded processes, right below their
+// process and in the same order among themselves; the rest are left out.
+// A filter hides the processes that do not match it, threads included.
+// In tree mode every row is sorted, whatever the limit, and then arranged
+// as a ViewTree: processes below their parents, threads below their
+// process, and the descendants of collapsed processes left out.
+typedef struct {
+    SortKey key;
+    bool    descending;
+
+    uint32_t* rows; // row indices of the current table, in display order
+    size_t    count;
+    size_t    capacity;
+    size_t    thread_count; // thread rows among them
+
+    // With a limit, an update only selects and orders the first limit rows
+    // (a bounded heap over the table); rows from sorted_count on are in no
+    // particular order until process_view_sort_all.
+    size_t limit; // 0 orders every row
+    size_t sorted_count;
+
+    uint32_t* previous_ids; // ids of the previous update, in display order
+    size_t    previous_count;
+    bool      previous_valid; // false after the sort order changed
+    uint32_t* scratch;        // merge buffer, capacity entries
+
+    // id -> row of the current table, valid where id_stamps matches stamp.
+    uint32_t*     row_of_id;
+    unsigned int* id_stamps;
+    size_t        id_capacity;
+    unsigned int  stamp;
+
+    int*      expanded;      // sorted PIDs whose threads are shown
+    uint32_t* expanded_rows; // row of each in the current table
+    size_t    expanded_count;
+    size_t    expanded_capacity;
+    uint32_t* group_rows; // table row -> row of its process, while grouped
+    bool      grouped;    // the last update showed thread rows
+
+    ViewFilter filter;
+    // Process rows of the current table that match the filter, in table
+    // order. A query that only narrows the last one is matched against
+    // these instead of the whole table.
+    uint32_t* matched;
+    size_t    matched_count;
+    bool      matched_valid;
+    bool      filter_stale;   // changed since matched was filled
+    bool      filter_narrows; // and only narrowed it
+
+    bool     tree; // show processes under their parents
+    ViewTree tree_rows;
+} ProcessView;
+
+void process_view_destroy(ProcessView* view);
+
+// Changes the sort order; the next update then sorts from scratch.
+void process_view_set_sort(ProcessView* view, SortKey key, bool descending);
+
+// Limits later updates to ordering the top limit rows; 0 orders them all.
+void process_view_set_limit(ProcessView* view, size_t limit);
+
+// Shows or hides the threads of pid from the next update on. Returns false
+// if the expanded set could not grow.
+bool process_view_toggle_expanded(ProcessView* view, int pid);
+bool process_view_is_expanded(const ProcessView* view, int pid);
+
+// Switches tree mode on or off from the next update on.
+void process_view_set_tree(ProcessView* view, bool tree);
+
+// Hides or shows the descendants of pid in tree mode from the next update
+// on. Returns false if the collapsed set could not grow.
+bool process_view_toggle_collapsed(ProcessView* view, int pid);
+
+// Replaces the filter with query, "" for none; see ViewFilter. Returns
+// false if a term was left out for being invalid.
+bool process_view_set_filter(ProcessView* view, const char* query);
+
+// Shows only the processes of cgroup id from the next update on, or all of
+// them for 0. Kept when the query changes.
+void process_view_set_cgroup(ProcessView* view, uint32_t cgroup);
+
+static inline bool process_view_filtered(const ProcessView* view) {
+    return view->filter.term_count > 0 || view->filter.cgroup != 0;
+}
+
+// Reorders view->rows for table, whose names must be folded
+// (process_table_fold_names). same_rows says table holds the same rows as
+// at the last update, as when only the order or the filter changed. Returns
+// false if it could not grow, in which case the view is empty.
+bool process_view_update(ProcessView* view, const ProcessTable* table,
+                         bool same_rows);
+
+// Orders the rows a limited update left unsorted; table must be the one the
+// view was last updated for.
+void process_view_sort_all(ProcessView* view, const ProcessTable* table);
+
+#endif